@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2015, Rémi Bazin <bazin.remi@gmail.com>
+ * All rights reserved.
+ * See LICENSE for licensing details.
+ */
+
+#ifndef LUDECOMPOSITION_H
+#define LUDECOMPOSITION_H
+
+#include "StaticMatrix.h"
+
+/* Number of columns factored together before updating the rest of the matrix */
+#define LU_BLOCK 64
+
+template <typename T> class Matrix;
+
+template <typename T> class LUDecomposition
+{
+public:
+    /* Constructors & destructor */
+    LUDecomposition(int n, const T *data);
+    inline LUDecomposition(const StaticMatrix<T> &matrix);
+    inline LUDecomposition(const Matrix<T> &matrix);
+    inline ~LUDecomposition();
+    /* Properties */
+    inline int size() const { return _n; }
+    inline bool isSingular() const { return _singular; }
+    T det() const;
+    /* Solutions */
+    void solve(int nrhs, T *b) const;
+    inline void solve(StaticMatrix<T> &b) const;
+    inline void solve(Matrix<T> &b) const;
+    StaticMatrix<T> *getInverse() const;
+    inline Matrix<T> inverse() const;
+private:
+    LUDecomposition(const LUDecomposition<T> &other);
+    LUDecomposition<T> &operator=(const LUDecomposition<T> &other);
+    void init(int n, const T *data);
+    void factor();
+private:
+    int _n;
+    T *_lu; // L (unit diagonal omitted) below the diagonal and U above, row-major
+    int *_pivots; // Row swapped with row k at step k
+    bool _singular, _odd; // _odd if the number of row swaps is odd
+};
+
+template <typename T> LUDecomposition<T>::LUDecomposition(int n, const T *data)
+{
+    init(n, data);
+}
+
+template <typename T> inline LUDecomposition<T>::LUDecomposition(const StaticMatrix<T> &matrix)
+{
+    ASSERT(matrix.countRows() == matrix.countCols());
+    init(matrix.countRows(), matrix.constData());
+}
+
+template <typename T> inline LUDecomposition<T>::LUDecomposition(const Matrix<T> &matrix)
+{
+    ASSERT(!matrix.isNull() && (matrix.countRows() == matrix.countCols()));
+    init(matrix.countRows(), matrix.constData());
+}
+
+template <typename T> inline LUDecomposition<T>::~LUDecomposition()
+{
+    ASSERT(_lu && _pivots);
+    delete[] _pivots;
+    delete[] _lu;
+}
+
+template <typename T> void LUDecomposition<T>::init(int n, const T *data)
+{
+    ASSERT(data && (n > 0));
+    ASSERT_INT(((unsigned long long) n) * ((unsigned long long) n));
+    size_t size = n * n;
+    _n = n;
+    _lu = new T[size];
+    memcpy((void*) _lu, (const void*) data, size * sizeof(T));
+    _pivots = new int[n];
+    factor();
+}
+
+template <typename T> void LUDecomposition<T>::factor()
+{
+    /* Right-looking elimination with partial pivoting, by panels of LU_BLOCK columns: the panel is factored
+     * with whole rows being swapped, the rows of U on its right are solved, and the trailing matrix is
+     * updated with the tiled product */
+    int n = _n, k0, k1, nb, n2, i, j, k, best;
+    T *neg = new T[n * LU_BLOCK], *row, *pivotRow, maxAbs, tmpAbs, tmpT;
+    _singular = false;
+    _odd = false;
+    for (k0 = 0; k0 < n; k0 = k1)
+    {
+        nb = (n - k0 < LU_BLOCK) ? n - k0 : LU_BLOCK;
+        k1 = k0 + nb;
+        n2 = n - k1;
+        for (k = k0; k < k1; ++k)
+        {
+            maxAbs = ABS(_lu[k * n + k]);
+            best = k;
+            for (i = k + 1; i < n; ++i)
+            {
+                tmpAbs = ABS(_lu[i * n + k]);
+                if (tmpAbs > maxAbs)
+                {
+                    maxAbs = tmpAbs;
+                    best = i;
+                }
+            }
+            _pivots[k] = best;
+            pivotRow = &_lu[k * n];
+            if (best != k)
+            {
+                row = &_lu[best * n];
+                for (j = 0; j < n; ++j)
+                {
+                    tmpT = row[j];
+                    row[j] = pivotRow[j];
+                    pivotRow[j] = tmpT;
+                }
+                _odd = !_odd;
+            }
+            if (maxAbs == 0)
+            {
+                _singular = true;
+                continue;
+            }
+            tmpT = 1 / pivotRow[k];
+            for (i = k + 1; i < n; ++i)
+            {
+                row = &_lu[i * n];
+                if (row[k] == 0)
+                    continue;
+                row[k] *= tmpT;
+                for (j = k + 1; j < k1; ++j)
+                    row[j] -= row[k] * pivotRow[j];
+            }
+        }
+        if (!n2)
+            break;
+        /* U12 = L11^-1 A12 */
+        for (k = k0; k < k1; ++k)
+        {
+            pivotRow = &_lu[k * n + k1];
+            for (i = k + 1; i < k1; ++i)
+            {
+                tmpT = _lu[i * n + k];
+                if (tmpT == 0)
+                    continue;
+                row = &_lu[i * n + k1];
+                for (j = 0; j < n2; ++j)
+                    row[j] -= tmpT * pivotRow[j];
+            }
+        }
+        /* A22 -= L21 U12, with -L21 copied as the left operand */
+        for (i = 0; i < n2; ++i)
+        {
+            row = &_lu[(k1 + i) * n + k0];
+            for (j = 0; j < nb; ++j)
+                neg[i * nb + j] = -row[j];
+        }
+        StaticMatrix<T>::product(n2, n2, nb, neg, nb, 1, &_lu[k0 * n + k1], n, 1, &_lu[k1 * (n + 1)], n, false, true);
+    }
+    delete[] neg;
+}
+
+template <typename T> T LUDecomposition<T>::det() const
+{
+    if (_singular)
+        return (T) 0;
+    T result = _lu[0];
+    int step = _n + 1, index = _n * _n - 1;
+    for (; index > 0; index -= step)
+        result *= _lu[index];
+    return _odd ? -result : result;
+}
+
+template <typename T> void LUDecomposition<T>::solve(int nrhs, T *b) const
+{
+    /* b is replaced by A^-1 b, b having _n rows of nrhs values. The substitutions go by blocks of LU_BLOCK rows,
+     * the contributions of a solved block to the other rows being added with the tiled product when there
+     * are enough right-hand sides. */
+    ASSERT(b && (nrhs > 0));
+    ASSERT(!_singular);
+    int n = _n, k0, k1, nb, i, j, k;
+    bool blocked = nrhs >= MATRIX_GEMM_NR;
+    T *neg = blocked ? new T[n * LU_BLOCK] : NULL, *row, *other, tmpT;
+    for (k = 0; k < n; ++k)
+    {
+        if (_pivots[k] == k)
+            continue;
+        row = &b[k * nrhs];
+        other = &b[_pivots[k] * nrhs];
+        for (j = 0; j < nrhs; ++j)
+        {
+            tmpT = row[j];
+            row[j] = other[j];
+            other[j] = tmpT;
+        }
+    }
+    /* L y = P b */
+    for (k0 = 0; k0 < n; k0 = k1)
+    {
+        k1 = (n - k0 < LU_BLOCK) ? n : k0 + LU_BLOCK;
+        nb = k1 - k0;
+        for (i = k0 + 1; i < (blocked ? k1 : n); ++i)
+        {
+            row = &b[i * nrhs];
+            for (k = k0; k < ((i < k1) ? i : k1); ++k)
+            {
+                tmpT = _lu[i * n + k];
+                if (tmpT == 0)
+                    continue;
+                other = &b[k * nrhs];
+                for (j = 0; j < nrhs; ++j)
+                    row[j] -= tmpT * other[j];
+            }
+        }
+        if (blocked && (k1 < n))
+        {
+            for (i = k1; i < n; ++i)
+            {
+                for (k = 0; k < nb; ++k)
+                    neg[(i - k1) * nb + k] = -_lu[i * n + k0 + k];
+            }
+            StaticMatrix<T>::product(n - k1, nrhs, nb, neg, nb, 1, &b[k0 * nrhs], nrhs, 1, &b[k1 * nrhs], nrhs, false, true);
+        }
+    }
+    /* U x = y, from the last block */
+    for (k1 = n; k1 > 0; k1 = k0)
+    {
+        k0 = (k1 < LU_BLOCK) ? 0 : k1 - LU_BLOCK;
+        nb = k1 - k0;
+        if (blocked && (k1 < n))
+        {
+            for (i = 0; i < nb; ++i)
+            {
+                for (k = k1; k < n; ++k)
+                    neg[i * (n - k1) + k - k1] = -_lu[(k0 + i) * n + k];
+            }
+            StaticMatrix<T>::product(nb, nrhs, n - k1, neg, n - k1, 1, &b[k1 * nrhs], nrhs, 1, &b[k0 * nrhs], nrhs, false, true);
+        }
+        for (i = k1 - 1; i >= k0; --i)
+        {
+            row = &b[i * nrhs];
+            for (k = i + 1; k < (blocked ? k1 : n); ++k)
+            {
+                tmpT = _lu[i * n + k];
+                if (tmpT == 0)
+                    continue;
+                other = &b[k * nrhs];
+                for (j = 0; j < nrhs; ++j)
+                    row[j] -= tmpT * other[j];
+            }
+            tmpT = 1 / _lu[i * n + i];
+            for (j = 0; j < nrhs; ++j)
+                row[j] *= tmpT;
+        }
+    }
+    delete[] neg;
+}
+
+template <typename T> inline void LUDecomposition<T>::solve(StaticMatrix<T> &b) const
+{
+    ASSERT(b.countRows() == _n);
+    solve(b.countCols(), b.data());
+}
+
+template <typename T> inline void LUDecomposition<T>::solve(Matrix<T> &b) const
+{
+    ASSERT(!b.isNull() && (b.countRows() == _n));
+    solve(b.countCols(), b.data());
+}
+
+template <typename T> StaticMatrix<T> *LUDecomposition<T>::getInverse() const
+{
+    StaticMatrix<T> *result = new StaticMatrix<T>(_n, _n);
+    result->addIdentity();
+    solve(*result);
+    return result;
+}
+
+template <typename T> inline Matrix<T> LUDecomposition<T>::inverse() const
+{
+    Matrix<T> result(_n, _n);
+    result.addIdentity();
+    solve(result);
+    return result;
+}
+
+#endif // LUDECOMPOSITION_H
@@ -9,8 +9,6 @@
 
 #include "StaticMatrix.h"
 
-#define PINV_TRANSPOSE_DIFF 5
-
 template <typename T> class Matrix
 {
 private:
@@ -58,6 +56,10 @@ public:
     inline Matrix<T> &partialProduct(const Matrix<T> &m1, const Matrix<T> &m2, int i1, int i2, int j1, int j2);
     inline Matrix<T> transpose() const;
     inline Matrix<T> timesTranspose(const Matrix<T> &other) const;
+    inline Matrix<T> transposeTimes(const Matrix<T> &other) const;
+    inline Matrix<T> timesTransposeSelf() const;
+    inline Matrix<T> transposeTimesSelf() const;
+    inline Matrix<T> eigenvectors(T *eigenvalues) const;
     inline T det() const;
     Matrix<T> &operator/=(const Matrix<T> &other);
     inline Matrix<T> &pseudoInverse(const T &negligible = 0);
@@ -301,6 +303,30 @@ template <typename T> inline Matrix<T> Matrix<T>::timesTranspose(const Matrix<T>
     return Matrix<T>(_p->d->timesTranspose(*other._p->d)); // No pb if the same pointer.
 }
 
+template <typename T> inline Matrix<T> Matrix<T>::transposeTimes(const Matrix<T> &other) const
+{
+    ASSERT(_p && other._p);
+    return Matrix<T>(_p->d->transposeTimes(*other._p->d)); // No pb if the same pointer.
+}
+
+template <typename T> inline Matrix<T> Matrix<T>::timesTransposeSelf() const
+{
+    ASSERT(_p);
+    return Matrix<T>(_p->d->timesTransposeSelf());
+}
+
+template <typename T> inline Matrix<T> Matrix<T>::transposeTimesSelf() const
+{
+    ASSERT(_p);
+    return Matrix<T>(_p->d->transposeTimesSelf());
+}
+
+template <typename T> inline Matrix<T> Matrix<T>::eigenvectors(T *eigenvalues) const
+{
+    ASSERT(_p && eigenvalues);
+    return Matrix<T>(_p->d->getEigenvectors(eigenvalues));
+}
+
 template <typename T> inline T Matrix<T>::det() const
 {
     ASSERT(_p);
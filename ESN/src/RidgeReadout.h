@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2015, Rémi Bazin <bazin.remi@gmail.com>
+ * All rights reserved.
+ * See LICENSE for licensing details.
+ */
+
+#ifndef RIDGEREADOUT_H
+#define RIDGEREADOUT_H
+
+#include "Matrix.h"
+
+/* Number of samples gathered before being added to the correlation matrices */
+#define RIDGE_BLOCK 256
+
+template <typename T> class RidgeReadout
+{
+public:
+    /* Constructors & destructor */
+    RidgeReadout(int nStates, int nOutputs, int blockSize = RIDGE_BLOCK);
+    inline ~RidgeReadout();
+    /* Samples */
+    inline int countStates() const { return _nStates; }
+    inline int countOutputs() const { return _nOutputs; }
+    inline int countSamples() const { return _samples; }
+    void reset();
+    void addSample(const T *state, const T *target);
+    void addSamples(const Matrix<T> &states, const Matrix<T> &targets);
+    Matrix<T> statesCorrelation();
+    Matrix<T> crossCorrelation();
+    /* Solutions */
+    Matrix<T> solve(const T &lambda);
+    void solve(int n, const T *lambdas, Matrix<T> *readouts);
+private:
+    RidgeReadout(const RidgeReadout<T> &other);
+    RidgeReadout<T> &operator=(const RidgeReadout<T> &other);
+    void flush();
+    void accumulate(int count, const T *states, const T *targets);
+private:
+    int _nStates, _nOutputs, _blockSize;
+    int _samples, _pending;
+    /* X X^T (upper triangle only, _nStates x _nStates) and Y X^T (_nOutputs x _nStates) */
+    T *_xx, *_yx;
+    /* Pending samples, one row per sample */
+    T *_states, *_targets;
+};
+
+template <typename T> RidgeReadout<T>::RidgeReadout(int nStates, int nOutputs, int blockSize)
+    : _nStates(nStates), _nOutputs(nOutputs), _blockSize((blockSize > 0) ? blockSize : 1)
+{
+    ASSERT((nStates > 0) && (nOutputs > 0));
+    ASSERT_INT(((unsigned long long) nStates) * ((unsigned long long) nStates));
+    _xx = new T[nStates * nStates];
+    _yx = new T[nOutputs * nStates];
+    _states = new T[_blockSize * nStates];
+    _targets = new T[_blockSize * nOutputs];
+    reset();
+}
+
+template <typename T> inline RidgeReadout<T>::~RidgeReadout()
+{
+    delete[] _targets;
+    delete[] _states;
+    delete[] _yx;
+    delete[] _xx;
+}
+
+template <typename T> void RidgeReadout<T>::reset()
+{
+    memset((void*) _xx, 0, _nStates * _nStates * sizeof(T));
+    memset((void*) _yx, 0, _nOutputs * _nStates * sizeof(T));
+    _samples = 0;
+    _pending = 0;
+}
+
+template <typename T> void RidgeReadout<T>::addSample(const T *state, const T *target)
+{
+    ASSERT(state && target);
+    memcpy((void*) &_states[_pending * _nStates], (const void*) state, _nStates * sizeof(T));
+    memcpy((void*) &_targets[_pending * _nOutputs], (const void*) target, _nOutputs * sizeof(T));
+    ++_samples;
+    if (++_pending == _blockSize)
+        flush();
+}
+
+template <typename T> void RidgeReadout<T>::addSamples(const Matrix<T> &states, const Matrix<T> &targets)
+{
+    ASSERT(!states.isNull() && !targets.isNull());
+    ASSERT((states.countCols() == _nStates) && (targets.countCols() == _nOutputs));
+    ASSERT(states.countRows() == targets.countRows());
+    flush();
+    accumulate(states.countRows(), states.constData(), targets.constData());
+    _samples += states.countRows();
+}
+
+template <typename T> void RidgeReadout<T>::flush()
+{
+    if (!_pending)
+        return;
+    accumulate(_pending, _states, _targets);
+    _pending = 0;
+}
+
+template <typename T> void RidgeReadout<T>::accumulate(int count, const T *states, const T *targets)
+{
+    /* With S (count x _nStates) and Y (count x _nOutputs) holding the samples by rows,
+     * X X^T += S^T S and Y X^T += Y^T S, read in place by the tiled product */
+    StaticMatrix<T>::product(_nStates, _nStates, count, states, 1, _nStates, states, _nStates, 1,
+                             _xx, _nStates, true, true);
+    StaticMatrix<T>::product(_nOutputs, _nStates, count, targets, 1, _nOutputs, states, _nStates, 1,
+                             _yx, _nStates, false, true);
+}
+
+template <typename T> Matrix<T> RidgeReadout<T>::statesCorrelation()
+{
+    flush();
+    int n = _nStates, i, j;
+    T *data = new T[n * n];
+    for (i = 0; i < n; ++i)
+    {
+        for (j = 0; j < i; ++j)
+            data[i * n + j] = _xx[j * n + i];
+        for (; j < n; ++j)
+            data[i * n + j] = _xx[i * n + j];
+    }
+    return Matrix<T>(n, n, data);
+}
+
+template <typename T> Matrix<T> RidgeReadout<T>::crossCorrelation()
+{
+    flush();
+    size_t size = _nOutputs * _nStates;
+    T *data = new T[size];
+    memcpy((void*) data, (void*) _yx, size * sizeof(T));
+    return Matrix<T>(_nOutputs, _nStates, data);
+}
+
+template <typename T> Matrix<T> RidgeReadout<T>::solve(const T &lambda)
+{
+    /* W_out^T = (X X^T + lambda I)^-1 (Y X^T)^T */
+    Matrix<T> a = statesCorrelation(), result = crossCorrelation().transpose();
+    T *data = a.data();
+    int i, step = _nStates + 1;
+    for (i = 0; i < _nStates; ++i)
+        data[i * step] += lambda;
+    result /= a;
+    return result.transpose();
+}
+
+template <typename T> void RidgeReadout<T>::solve(int n, const T *lambdas, Matrix<T> *readouts)
+{
+    /* With X X^T = E^T D E (the rows of E being its eigenvectors), W_out = (Y X^T E^T) (D + lambda I)^-1 E,
+     * which only costs a product for each value of lambda */
+    ASSERT((n >= 0) && lambdas && readouts);
+    if (!n)
+        return;
+    T *values = new T[_nStates], *factors = new T[_nStates];
+    Matrix<T> vectors = statesCorrelation().eigenvectors(values);
+    Matrix<T> projected = crossCorrelation().timesTranspose(vectors), scaled;
+    const T *source;
+    T *data;
+    int k, i, j;
+    for (k = 0; k < n; ++k)
+    {
+        for (j = 0; j < _nStates; ++j)
+        {
+            factors[j] = values[j] + lambdas[k];
+            factors[j] = (factors[j] != 0) ? 1 / factors[j] : 0;
+        }
+        scaled = Matrix<T>(_nOutputs, _nStates);
+        source = projected.constData();
+        data = scaled.data();
+        for (i = 0; i < _nOutputs; ++i)
+        {
+            for (j = 0; j < _nStates; ++j)
+                data[i * _nStates + j] = source[i * _nStates + j] * factors[j];
+        }
+        readouts[k] = scaled * vectors;
+    }
+    delete[] factors;
+    delete[] values;
+}
+
+#endif // RIDGEREADOUT_H
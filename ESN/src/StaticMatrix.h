@@ -10,6 +10,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <limits.h>
+#include <math.h>
 
 #define MATRIX_MEM_CMP 0
 
@@ -27,8 +28,55 @@
 
 #define ASSERT_INT(x) ASSERT((x) <= INT_MAX)
 
+/* Blocking of the products: the result is computed by tiles of MATRIX_GEMM_MC rows and MATRIX_GEMM_NC columns,
+ * over slices of MATRIX_GEMM_KC terms whose operands are packed contiguously, and each tile by micro-tiles of
+ * MATRIX_GEMM_MR x MATRIX_GEMM_NR coefficients kept in registers */
+#define MATRIX_GEMM_MR 4
+#define MATRIX_GEMM_NR 8
+#ifndef MATRIX_GEMM_MC
+  #define MATRIX_GEMM_MC 128
+#endif
+#ifndef MATRIX_GEMM_KC
+  #define MATRIX_GEMM_KC 256
+#endif
+#ifndef MATRIX_GEMM_NC
+  #define MATRIX_GEMM_NC 512
+#endif
+/* Size of the square blocks copied by getTranspose */
+#define MATRIX_TRANSPOSE_BLOCK 32
+/* Number of rows factored together by the Cholesky decomposition before updating the rest of the matrix */
+#define MATRIX_CHOLESKY_BLOCK 64
+
+/* pseudoInverse works on the transpose of the matrices that have more than PINV_TRANSPOSE_DIFF columns
+ * more than rows */
+#ifndef PINV_TRANSPOSE_DIFF
+  #define PINV_TRANSPOSE_DIFF 5
+#endif
+/* Maximal number of sweeps of one-sided Jacobi rotations done by pseudoInverse on ill-conditioned matrices */
+#define PINV_JACOBI_SWEEPS 30
+/* Number of Householder reflectors applied together by the QR decomposition of pseudoInverse */
+#define PINV_QR_BLOCK 32
+
+#if defined(__AVX__)
+  #include <immintrin.h>
+#elif defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+
+/* Products may be distributed over the global ThreadPool of the MLP sources, by tiles */
+#ifdef MATRIX_USE_THREADPOOL
+  #include "threadpool.h"
+  #ifndef MATRIX_PARALLEL_THRESHOLD
+    #define MATRIX_PARALLEL_THRESHOLD 1000000 /* Minimal number of multiply-adds */
+  #endif
+#endif
+
+template <typename T> class LUDecomposition;
+
 template <typename T> class StaticMatrix
 {
+    template <typename U> friend class LUDecomposition;
+    template <typename U> friend class RidgeReadout;
 public:
     /* Constructors & destructor */
     StaticMatrix(const StaticMatrix<T> &other);
@@ -78,9 +126,45 @@ public: /* Use with caution: */
     static inline StaticMatrix<T> *prepareProduct(const StaticMatrix<T> &m1, const StaticMatrix<T> &m2);
     StaticMatrix<T> *getTranspose() const;
     StaticMatrix<T> *timesTranspose(const StaticMatrix<T> &other) const;
+    StaticMatrix<T> *transposeTimes(const StaticMatrix<T> &other) const;
+    StaticMatrix<T> *timesTransposeSelf() const;
+    StaticMatrix<T> *transposeTimesSelf() const;
+    StaticMatrix<T> *getEigenvectors(T *values) const;
     /* Cut and merge operations */
     static StaticMatrix<T> *mergeH(const StaticMatrix<T> &m1, const StaticMatrix<T> &m2);
     static StaticMatrix<T> *mergeV(const StaticMatrix<T> &m1, const StaticMatrix<T> &m2);
+private:
+    /* Product of two operands read with any strides: element (i, j) of a is a[i * aRow + j * aCol] */
+    struct ProductTask
+    {
+        int m, n, k;
+        const T *a, *b;
+        int aRow, aCol, bRow, bCol;
+        T *c;
+        int ldc;
+        bool upper, accumulate;
+        int tilesM, tiles, parts;
+    };
+    static void product(int m, int n, int k, const T *a, int aRow, int aCol, const T *b, int bRow, int bCol, T *c, int ldc,
+                        bool upper = false, bool accumulate = false);
+    static StaticMatrix<T> *symmetricProduct(int n, int k, const T *a, int aRow, int aCol);
+    /* Factorizations of symmetric matrices stored in n x n arrays */
+    static bool cholesky(int n, T *a, const T &tolerance);
+    static void upperInverse(int n, const T *u, T *x);
+    static void symmetricEigen(int n, T *a, T *values);
+    static void orthogonalPseudoInverse(int p, int k, const T *a, int aRow, int aCol, T *x, int xRow, int xCol, const T &negligible);
+    static void blockReflector(int nb, int len, const T *h, int ldh, const T *tau, T *v, T *t, T *g);
+    static void applyReflectors(int nb, int len, const T *v, const T *t, int rows, T *z, int ldz, T *w);
+    static inline T epsilon();
+    static inline T hypot(const T &a, const T &b);
+    static inline T dot(int n, const T *a, const T *b);
+    static void productTiles(const ProductTask &task, int index);
+    static void packA(int mc, int kc, const T *a, int aRow, int aCol, T *pack);
+    static void packB(int kc, int nc, const T *b, int bRow, int bCol, T *pack);
+    static inline void microKernel(int kc, const T *a, const T *b, T *c, int ldc, int mr, int nr, bool add);
+#ifdef MATRIX_USE_THREADPOOL
+    static void productTask(void *arg, int index);
+#endif
 private:
     int _m, _n; // _m rows, _n columns
     T *_data; // data[i * _n + j] for the i-th row, j-th column
@@ -292,30 +376,9 @@ template <typename T> StaticMatrix<T> &StaticMatrix<T>::operator*=(const StaticM
 {
     ASSERT(_data && other._data && (_n == other._m));
     ASSERT_INT(((unsigned long long) _m) * ((unsigned long long) other._n));
-    /* We assume that the naive algorithm is sufficient with the matrices that we use here. */
     ASSERT_INT((((unsigned long long) _n) + 1ULL) * ((unsigned long long) other._n));
-    int i = _m, j, k, index1, index2, index3;
-    T *data = new T[(index3 = _m * other._n)];
-    while (i)
-    {
-        --i;
-        index1 = i * _n;
-        j = other._n;
-        while (j)
-        {
-            --j;
-            --index3;
-            data[index3] = 0;
-            index2 = _n * other._n + j;
-            k = _n;
-            while (k)
-            {
-                --k;
-                index2 -= other._n;
-                data[index3] += _data[index1 + k] * other._data[index2];
-            }
-        }
-    }
+    T *data = new T[_m * other._n];
+    product(_m, other._n, _n, _data, _n, 1, other._data, other._n, 1, data, other._n);
     delete[] _data;
     _n = other._n;
     _data = data;
@@ -335,390 +398,75 @@ template <typename T> StaticMatrix<T> &StaticMatrix<T>::partialProduct(const Sta
     ASSERT(_data && m1._data && m2._data);
     ASSERT((_m == m1._m) && (m1._n == m2._m) && (m2._n == _n));
     ASSERT((i1 >= 0) && (i1 <= i2) && (i2 < _m) && (j1 >= 0) && (j1 <= j2) && (j2 < _n));
-    int i, j, k, index1, index2, index3;
-    for (i = i1; i <= i2; ++i)
-    {
-        index1 = i * m1._n;
-        index3 = i * _n + j1;
-        for (j = j1; j <= j2; ++j)
-        {
-            _data[index3] = 0;
-            index2 = m1._n * _n + j;
-            k = m1._n;
-            while (k)
-            {
-                --k;
-                index2 -= _n;
-                _data[index3] += m1._data[index1 + k] * m2._data[index2];
-            }
-            ++index3;
-        }
-    }
+    product(i2 - i1 + 1, j2 - j1 + 1, m1._n, &m1._data[i1 * m1._n], m1._n, 1, &m2._data[j1], _n, 1, &_data[i1 * _n + j1], _n);
     return *this;
 }
 
 template <typename T> T StaticMatrix<T>::det() const
 {
     ASSERT(_data && (_m == _n));
-    /* As with the multiplication, we will settle for the UL decomposition in O(n^3) */
-    size_t size = _m * _n, swapSize;
-    T *copy = new T[size];
-    T *tmp = new T[_n], maxAbs, tmpT;
-    memcpy((void*) copy, (void*) _data, size * sizeof(T));
-    bool neg = false;
-    int k = _n, lindex = size - 1, index, best, step = _n + 1;
-    while (--k)
-    {
-        maxAbs = ABS(copy[(index = lindex)]);
-        best = index;
-        while ((index -= _n) > 0)
-        {
-            T tmpAbs = ABS(copy[index]);
-            if (tmpAbs > maxAbs)
-            {
-                maxAbs = tmpAbs;
-                best = index;
-            }
-        }
-        if (maxAbs == 0)
-            return (T) 0;
-        if (best != lindex)
-        {
-            swapSize = (k + 1) * sizeof(T);
-            memcpy((void*) tmp, (void*) &copy[lindex - k], swapSize);
-            memcpy((void*) &copy[lindex - k], (void*) &copy[best - k], swapSize);
-            memcpy((void*) &copy[best - k], (void*) tmp, swapSize);
-            neg = !neg;
-        }
-        index = lindex;
-        maxAbs = copy[index];
-        while ((index -= _n) > 0)
-        {
-            tmpT = copy[index];
-            if (tmpT != 0)
-            {
-                for (best = k; best > 0; --best)
-                    copy[index - best] -= tmpT * copy[lindex - best] / maxAbs;
-            }
-        }
-        lindex -= step;
-    }
-    delete[] tmp;
-    tmpT = copy[0];
-    for (index = size - 1; index > 0; index -= step)
-        tmpT *= copy[index];
-    delete[] copy;
-    return (neg ? -tmpT : tmpT);
+    return LUDecomposition<T>(_n, _data).det();
 }
 
 template <typename T> StaticMatrix<T> &StaticMatrix<T>::operator/=(const StaticMatrix<T> &other)
 {
     ASSERT(_data && other._data);
-    ASSERT((_m == _n) && (_m == other._m) && (other._m == other._n));
-    size_t size = _m * _n, swapSize1, swapSize2 = _n * sizeof(T);
-    T *copy = new T[size];
-    T *tmp = new T[_n], maxAbs, tmpT;
-    memcpy((void*) copy, (void*) other._data, size * sizeof(T));
-    int k = _n, lindex = size - 1, index, best, step = _n + 1, i1, i2;
-    int lastLine = size - _n;
-    while (k)
-    {
-        --k;
-        maxAbs = ABS(copy[(index = lindex)]);
-        best = index;
-        while ((index -= _n) > 0)
-        {
-            T tmpAbs = ABS(copy[index]);
-            if (tmpAbs > maxAbs)
-            {
-                maxAbs = tmpAbs;
-                best = index;
-            }
-        }
-        ASSERT(maxAbs != 0);
-        i1 = lindex - k;
-        if (best != lindex)
-        {
-            swapSize1 = (k + 1) * sizeof(T);
-            i2 = best - k;
-            memcpy((void*) tmp, (void*) &copy[i1], swapSize1);
-            memcpy((void*) &copy[i1], (void*) &copy[i2], swapSize1);
-            memcpy((void*) &copy[i2], (void*) tmp, swapSize1);
-            memcpy((void*) tmp, (void*) &_data[i1], swapSize2);
-            memcpy((void*) &_data[i1], (void*) &_data[i2], swapSize2);
-            memcpy((void*) &_data[i2], (void*) tmp, swapSize2);
-        }
-        maxAbs = copy[lindex];
-        if (maxAbs != 1)
-        {
-            index = _n;
-            while (index > k)
-            {
-                --index;
-                _data[i1 + index] /= maxAbs;
-            }
-            while (index)
-            {
-                --index;
-                _data[i1 + index] /= maxAbs;
-                copy[i1 + index] /= maxAbs;
-            }
-        }
-        for (index = lastLine + k; index > 0; index -= _n)
-        {
-            if (index != lindex)
-            {
-                tmpT = copy[index];
-                if (tmpT != 0)
-                {
-                    for (i2 = k; i2 > 0; --i2)
-                    {
-                        copy[index - i2] -= tmpT * copy[lindex - i2];
-                        _data[index - i2] -= tmpT * _data[lindex - i2];
-                    }
-                    i2 = _n - k;
-                    while (i2)
-                    {
-                        --i2;
-                        _data[index + i2] -= tmpT * _data[lindex + i2];
-                    }
-                }
-            }
-        }
-        lindex -= step;
-    }
-    delete[] tmp;
-    delete[] copy;
+    ASSERT((_m == other._m) && (other._m == other._n));
+    LUDecomposition<T>(other._n, other._data).solve(_n, _data);
     return *this;
 }
 
-template <typename T> inline T sq<T>(T a) { return a * a; }
-
 template <typename T> StaticMatrix<T> &StaticMatrix<T>::pseudoInverse(const T &negligible)
 {
     ASSERT(_data);
     ASSERT(negligible >= 0);
-    T *V, *result;
-    { /* Initialize V to I_m, and allocate indexes  */
-        int step;
-        size_t size;
-        V = new T[(size = _m * _m)];
-        memset((void*) V, 0, size * sizeof(T));
-        step = _m + 1;
-        --size;
-        V[size] = 1;
-        while (size)
-            V[size -= step] = 1;
-    }
-    int *indexes = new int[_n], current_index = 0;
-    int x = 0, y = 0;
-    { /* Try to invert this matrix, thus modifying V */
-        T *swap1 = new T[_n], swap2 = new T[_m];
-        size_t swapsize1, swapsize2 = _m * sizeof(T);
-        int lindex = 0, index, size = _n * _m;
-        int itmp1, itmp2, itmp3, itmp4;
-        T maxAbs, temp;
-        while (true)
-        {
-            maxAbs = ABS(_data[(index = lindex)]);
-            itmp4  = index;
-            itmp3 = (itmp1 = y);
-            while ((index += _n) < size)
-            {
-                ++itmp1;
-                temp = ABS(_data[index]);
-                if (temp > maxAbs)
-                {
-                    maxAbs = temp;
-                    itmp4 = index;
-                    itmp3 = itmp1;
-                }
-            }
-            if (maxAbs <= negligible)
-            {
-                indexes[current_index++] = y;
-                if (++x >= _n)
-                    break;
-                ++lindex;
-                continue;
-            }
-            itmp1 = _m * y;
-            if (itmp4 != lindex)
-            {
-                swapsize1 = _n - x;
-                memcpy((void*) swap1, (void*) &_data[lindex], swapsize1);
-                memcpy((void*) &_data[lindex], (void*) &_data[itmp4], swapsize1);
-                memcpy((void*) &_data[itmp4], (void*) swap1, swapsize1);
-                itmp2 = _m * itmp3;
-                memcpy((void*) swap2, (void*) &V[itmp1], swapsize2);
-                memcpy((void*) &V[itmp1], (void*) &V[itmp2], swapsize2);
-                memcpy((void*) &V[itmp2], (void*) swap2, swapsize2);
-            }
-            maxAbs = _data[lindex];
-            if (maxAbs != 1)
-            {
-                itmp2 = lindex + _n - x;
-                while (--itmp2 > lindex)
-                    _data[itmp2] /= maxAbs;
-                itmp2 = itmp1 + _m;
-                do {
-                    V[itmp2] /= maxAbs;
-                } while ((--itmp2) >= itmp1);
-            }
-            for (itmp3 = size + x, itmp4 = _m * _m; (itmp3 -= _n, itmp4 -= _m) >= 0;)
-            {
-                if (itmp3 == lindex)
-                    continue;
-                temp = _data[itmp3];
-                if (temp == 0)
-                    continue;
-                for (itmp2 = _n - x; --itmp2 > 0;)
-                    _data[itmp3 + itmp2] -= temp * _data[lindex + itmp2];
-                for (itmp2 = _m; --itmp2 > 0;)
-                    V[itmp4 + itmp2] -= temp * V[itmp1 + itmp2];
-            }
-            if (((++y, ++x) >= _n) || (y >= _m))
-                break;
-            lindex += _n + 1;
-        }
-    }
-    /* The rank value is y == x - current_index */
-    /* Treat the null rank as a special case */
-    if (!y)
+    /* With A m x n and k = min(m, n), A+ = (A^T A)^-1 A^T or A^T (A A^T)^-1, the Gram matrix G (k x k)
+     * being inverted through its Cholesky decomposition G = U^T U. This is only done if U^-1 proves that
+     * all the singular values of A are greater than negligible, and that the condition number of G,
+     * the square of that of A, loses at most half of the digits: the eigenvalues of G are the squares
+     * of the singular values of A, with lambda_max <= trace(G) and lambda_min >= 1 / trace(G^-1),
+     * trace(G^-1) being the squared Frobenius norm of U^-1. Else, A+ is obtained from a QR decomposition
+     * of A, which keeps its condition number (see orthogonalPseudoInverse). */
+    bool flat = _n > _m + PINV_TRANSPOSE_DIFF;
+    int k = flat ? _m : _n, i;
+    StaticMatrix<T> *gram = flat ? timesTransposeSelf() : transposeTimesSelf(), *inverse = NULL;
+    T *g = gram->_data, trace = 0, bound = 0, eps = epsilon();
+    for (i = 0; i < k; ++i)
+        trace += g[i * k + i];
+    T *copy = new T[k * k];
+    memcpy((void*) copy, (void*) g, k * k * sizeof(T));
+    if (cholesky(k, copy, 0))
     {
-        delete[] indexes;
-        delete[] V;
-        memset((void*) _data, 0, _n * _m * sizeof(T));
-        int tmp = _n;
-        _n = _m;
-        _m = tmp;
-        return *this;
+        upperInverse(k, copy, g);
+        for (i = 0; i < k * k; ++i)
+            bound += g[i] * g[i];
+        /* G^-1 = U^-1 U^-T */
+        if ((bound * negligible * negligible < 1) && (trace * bound * eps <= sqrt(eps)))
+            inverse = symmetricProduct(k, k, g, k, 1);
     }
-    indexes[current_index] = -1;
-    size_t size = _n + _m - y;
+    delete[] copy;
+    delete gram;
+    T *data = new T[_n * _m];
+    if (!inverse)
     {
-        /* Initialize the result matrix to some intermediate value */
-        size_t sqsize = sq(size), cpysize = _m * sizeof(T);
-        result = new T[sqsize];
-        memset((void*) result, 0, sqsize * sizeof(T));
-        int i = 0, j = _m, k = 0, l = 0;
-        while (k < sqsize)
-        {
-            if (i >= _m)
-            {
-                result[k + j++] = 1;
-            } else if (indexes[l] == i)
-            {
-                result[k + j++] = 1;
-                ++l;
-            } else {
-                memcpy((void*) &result[k], (void*) &V[(i++) * _m], cpysize);
-            }
-            k += size;
-        }
-    }
-    indexes[current_index] = y;
-    /* Allocate and initialize the left-hand matrix */
-    T *Lm;
-    {
-        size_t sqsize = _n * _n;
-        Lm = new T[sqsize];
-        memset((void*) Lm, 0, sqsize * sizeof(T));
-        int step = _n + 1;
-        int c = _n * step;
-        while (c)
-            Lm[c -= step] = 1;
-        int min_q, max_q = 0, index, iadd, index2;
-        for (int k = 0; k < current_index; iadd += _n, ++k)
-        {
-            min_q = max_q;
-            max_q = indexes[k];
-            for (int p = current_index - 1; p >= k; --p)
-            {
-                index2 = indexes[p] + p;
-                index = min_q * _n + index2;
-                index2 = index2 * _n + k + min_q;
-                for (int q = min_q; q < max_q; index += _n, ++index2, ++q)
-                {
-                    T value = _data[index];
-                    Lm[index + iadd] = value;
-                    Lm[index2] = -value;
-                }
-            }
-        }
-        for (int k = _m - y - 1; k >= current_index; --k)
-        {
-            max_q = 0;
-            iadd = 0;
-            int sindex = (x + k - current_index) * _n;
-            for (int p = 0; p <= current_index; iadd += _n, ++p)
-            {
-                min_q = max_q;
-                max_q = indexes[p];
-                index = min_q * _n + x + k - current_index;
-                index2 = sindex + min_q + p;
-                for (int q = min_q; q < max_q; index += _n, ++index2, ++q)
-                {
-                    T value = _data[index];
-                    Lm[index + iadd] = value;
-                    Lm[index2] = value;
-                }
-            }
-        }
-    }
-    delete[] _data;
-    /* Allocate and initialize the right-hand matrix */
-    T *Rm;
+        /* A+ is written to data (n x m) directly, or as the transpose of the pseudoinverse of A^T */
+        if (_m >= _n)
+            orthogonalPseudoInverse(_m, _n, _data, _n, 1, data, _m, 1, negligible);
+        else
+            orthogonalPseudoInverse(_n, _m, _data, 1, _n, data, 1, _m, negligible);
+    } else if (flat)
     {
-        int sizeN = _m - y;
-        Rm = new T[size * sizeN];
-        int min_q, max_q = 0, index = 0, index2;
-        for (int k = 0; k <= current_index; ++k)
-        {
-            min_q = max_q;
-            max_q = indexes[k];
-            for (int q = min_q; q < max_q; index += sizeN, ++q)
-            {
-                index2 = (m - r + y) * _m + q;
-                for (int j = m - r; --j >= 0;)
-                    Rm[index + j] = V[index2 -= _m];
-            }
-            if (k < current_index)
-                memset((void*) &Rm[index], 0, sizeN * sizeof(T));
-        }
-        if (_n > x)
-        {
-            index2 = (_n - x) * sizeN;
-            memset((void*) &Rm[index], 0, index2 * sizeof(T));
-            index += index2;
-        }
-        for (int q = n; q < size; index += sizeN, ++q)
-        {
-            index2 = (m - r + y) * _m + y + q - _n;
-            for (int j = m - r; --j >= 0;)
-                Rm[index + j] = V[index2 -= _m];
-        }
+        product(_n, _m, _m, _data, 1, _n, inverse->_data, _m, 1, data, _m);
+        delete inverse;
+    } else {
+        product(_n, _m, _n, inverse->_data, _n, 1, _data, 1, _n, data, _m);
+        delete inverse;
     }
-    delete[] indexes;
-    delete[] V;
-    /* Invert Rm */
-    // TODO invert Lm (row operations), with result and Rm
-    delete[] Lm;
-    /* Invert Rm */
-    // TODO invert Rm (0 at the top, I_{_m-y} at the bottom, row op.), with result
-    delete[] Rm;
-    /* Extract the pseudo-inverse from the result matrix */
-    _data = new T[_n * _m];
-    {
-        int index = 0, index2 = 0;
-        size_t rsize = _m * sizeof(T);
-        for (int i = 0; i < _n; index += _m, index2 += size, ++i)
-            memcpy((void*) &_data[index], (const void*) &result[index2], rsize);
-        index = _n;
-        _n = _m;
-        _m = index;
-    }
-    delete[] result;
+    delete[] _data;
+    _data = data;
+    i = _n;
+    _n = _m;
+    _m = i;
     return *this;
 }
 
@@ -843,30 +591,9 @@ template <typename T> StaticMatrix<T> *StaticMatrix<T>::getProduct(const StaticM
 {
     ASSERT(_data && other._data && (_n == other._m));
     ASSERT_INT(((unsigned long long) _m) * ((unsigned long long) other._n));
-    /* We assume that the naive algorithm is sufficient with the matrices that we use here. */
     ASSERT_INT((((unsigned long long) _n) + 1ULL) * ((unsigned long long) other._n));
-    int i = _m, j, k, index1, index2, index3;
-    T *data = new T[(index3 = _m * other._n)];
-    while (i)
-    {
-        --i;
-        index1 = i * _n;
-        j = other._n;
-        while (j)
-        {
-            --j;
-            --index3;
-            data[index3] = 0;
-            index2 = _n * other._n + j;
-            k = _n;
-            while (k)
-            {
-                --k;
-                index2 -= other._n;
-                data[index3] += _data[index1 + k] * other._data[index2];
-            }
-        }
-    }
+    T *data = new T[_m * other._n];
+    product(_m, other._n, _n, _data, _n, 1, other._data, other._n, 1, data, other._n);
     return new StaticMatrix<T>(_m, other._n, data);
 }
 
@@ -881,19 +608,20 @@ template <typename T> inline StaticMatrix<T> *StaticMatrix<T>::prepareProduct(co
 template <typename T> StaticMatrix<T> *StaticMatrix<T>::getTranspose() const
 {
     ASSERT(_data);
-    int size = _m * _n;
-    ASSERT_INT(((unsigned long long) size) + ((unsigned long long) _n));
-    T *data = new T[size];
-    int i2 = size, i1s = _n, i1, i;
-    while (i2)
+    T *data = new T[_m * _n];
+    /* Square blocks, so that both the rows read and the rows written stay in the cache */
+    int i0, j0, i, j, iEnd, jEnd;
+    for (i0 = 0; i0 < _m; i0 += MATRIX_TRANSPOSE_BLOCK)
     {
-        i1 = size + (--i1s);
-        i = _m;
-        while (i)
+        iEnd = (_m - i0 < MATRIX_TRANSPOSE_BLOCK) ? _m : i0 + MATRIX_TRANSPOSE_BLOCK;
+        for (j0 = 0; j0 < _n; j0 += MATRIX_TRANSPOSE_BLOCK)
         {
-            --i;
-            i1 -= _n;
-            data[--i2] = _data[i1];
+            jEnd = (_n - j0 < MATRIX_TRANSPOSE_BLOCK) ? _n : j0 + MATRIX_TRANSPOSE_BLOCK;
+            for (j = j0; j < jEnd; ++j)
+            {
+                for (i = i0; i < iEnd; ++i)
+                    data[j * _m + i] = _data[i * _n + j];
+            }
         }
     }
     return new StaticMatrix<T>(_n, _m, data);
@@ -903,29 +631,50 @@ template <typename T> StaticMatrix<T> *StaticMatrix<T>::timesTranspose(const Sta
 {
     ASSERT(_data && other._data);
     ASSERT(_n == other._n);
-    int index, i1, si2, i2, k;
-    T *data = new T[(index = _m * other._m)];
-    i1 = _m * _n;
-    si2 = other._m * _n;
-    while (i1)
-    {
-        i1 -= _n;
-        i2 = si2;
-        while (i2)
-        {
-            i2 -= _n;
-            data[--index] = 0;
-            k = _n;
-            while (k)
-            {
-                --k;
-                data[index] += _data[i1 + k] * other._data[i2 + k];
-            }
-        }
-    }
+    ASSERT_INT(((unsigned long long) _m) * ((unsigned long long) other._m));
+    if (this == &other)
+        return timesTransposeSelf();
+    T *data = new T[_m * other._m];
+    product(_m, other._m, _n, _data, _n, 1, other._data, 1, other._n, data, other._m);
     return new StaticMatrix<T>(_m, other._m, data);
 }
 
+template <typename T> StaticMatrix<T> *StaticMatrix<T>::transposeTimes(const StaticMatrix<T> &other) const
+{
+    ASSERT(_data && other._data);
+    ASSERT(_m == other._m);
+    ASSERT_INT(((unsigned long long) _n) * ((unsigned long long) other._n));
+    if (this == &other)
+        return transposeTimesSelf();
+    T *data = new T[_n * other._n];
+    product(_n, other._n, _m, _data, 1, _n, other._data, other._n, 1, data, other._n);
+    return new StaticMatrix<T>(_n, other._n, data);
+}
+
+template <typename T> StaticMatrix<T> *StaticMatrix<T>::timesTransposeSelf() const
+{
+    ASSERT(_data);
+    ASSERT_INT(((unsigned long long) _m) * ((unsigned long long) _m));
+    return symmetricProduct(_m, _n, _data, _n, 1);
+}
+
+template <typename T> StaticMatrix<T> *StaticMatrix<T>::transposeTimesSelf() const
+{
+    ASSERT(_data);
+    ASSERT_INT(((unsigned long long) _n) * ((unsigned long long) _n));
+    return symmetricProduct(_n, _m, _data, 1, _n);
+}
+
+template <typename T> StaticMatrix<T> *StaticMatrix<T>::getEigenvectors(T *values) const
+{
+    ASSERT(_data && values && (_m == _n));
+    size_t size = _m * _n;
+    T *data = new T[size];
+    memcpy((void*) data, (void*) _data, size * sizeof(T));
+    symmetricEigen(_n, data, values);
+    return new StaticMatrix<T>(_n, _n, data);
+}
+
 template <typename T> StaticMatrix<T> *StaticMatrix<T>::mergeH(const StaticMatrix<T> &m1, const StaticMatrix<T> &m2)
 {
     ASSERT(m1._data && m2._data && (m1._m == m2._m));
@@ -958,4 +707,810 @@ template <typename T> StaticMatrix<T> *StaticMatrix<T>::mergeV(const StaticMatri
     return new StaticMatrix<T>(m3_m, m1._n, data);
 }
 
+template <typename T> void StaticMatrix<T>::product(int m, int n, int k, const T *a, int aRow, int aCol,
+                                                    const T *b, int bRow, int bCol, T *c, int ldc, bool upper, bool accumulate)
+{
+    /* If upper is true, the coefficients strictly below the diagonal may be left uncomputed,
+     * and if accumulate is true, the product is added to c */
+    ProductTask task;
+    task.m = m;
+    task.n = n;
+    task.k = k;
+    task.a = a;
+    task.b = b;
+    task.aRow = aRow;
+    task.aCol = aCol;
+    task.bRow = bRow;
+    task.bCol = bCol;
+    task.c = c;
+    task.ldc = ldc;
+    task.upper = upper;
+    task.accumulate = accumulate;
+    task.tilesM = (m + MATRIX_GEMM_MC - 1) / MATRIX_GEMM_MC;
+    task.tiles = task.tilesM * ((n + MATRIX_GEMM_NC - 1) / MATRIX_GEMM_NC);
+    task.parts = 1;
+#ifdef MATRIX_USE_THREADPOOL
+    if ((task.tiles > 1) &&
+        (((unsigned long long) m) * ((unsigned long long) n) * ((unsigned long long) k) >= MATRIX_PARALLEL_THRESHOLD))
+    {
+        ThreadPool *pool = ThreadPool::globalInstance();
+        task.parts = (pool->countThreads() < task.tiles) ? pool->countThreads() : task.tiles;
+        pool->run(task.parts, productTask, (void*) &task);
+        return;
+    }
+#endif
+    productTiles(task, 0);
+}
+
+template <typename T> void StaticMatrix<T>::productTiles(const ProductTask &task, int index)
+{
+    /* Each part computes the tiles index, index + parts... with its own packed operands */
+    int kcMax = (task.k < MATRIX_GEMM_KC) ? task.k : MATRIX_GEMM_KC;
+    int mcMax = (task.m < MATRIX_GEMM_MC) ? task.m : MATRIX_GEMM_MC;
+    int ncMax = (task.n < MATRIX_GEMM_NC) ? task.n : MATRIX_GEMM_NC;
+    mcMax = (mcMax + MATRIX_GEMM_MR - 1) / MATRIX_GEMM_MR * MATRIX_GEMM_MR;
+    ncMax = (ncMax + MATRIX_GEMM_NR - 1) / MATRIX_GEMM_NR * MATRIX_GEMM_NR;
+    T *packedA = new T[mcMax * kcMax], *packedB = new T[kcMax * ncMax];
+    int tile, i0, j0, p0, mc, nc, kc, ir, jr;
+    for (tile = index; tile < task.tiles; tile += task.parts)
+    {
+        i0 = (tile % task.tilesM) * MATRIX_GEMM_MC;
+        j0 = (tile / task.tilesM) * MATRIX_GEMM_NC;
+        mc = (task.m - i0 < MATRIX_GEMM_MC) ? task.m - i0 : MATRIX_GEMM_MC;
+        nc = (task.n - j0 < MATRIX_GEMM_NC) ? task.n - j0 : MATRIX_GEMM_NC;
+        if (task.upper && (j0 + nc <= i0))
+            continue;
+        for (p0 = 0; p0 < task.k; p0 += kc)
+        {
+            kc = (task.k - p0 < MATRIX_GEMM_KC) ? task.k - p0 : MATRIX_GEMM_KC;
+            packB(kc, nc, &task.b[p0 * task.bRow + j0 * task.bCol], task.bRow, task.bCol, packedB);
+            packA(mc, kc, &task.a[i0 * task.aRow + p0 * task.aCol], task.aRow, task.aCol, packedA);
+            for (jr = 0; jr < nc; jr += MATRIX_GEMM_NR)
+            {
+                for (ir = 0; ir < mc; ir += MATRIX_GEMM_MR)
+                {
+                    if (task.upper && (j0 + jr + MATRIX_GEMM_NR <= i0 + ir))
+                        break;
+                    microKernel(kc, &packedA[ir * kc], &packedB[jr * kc], &task.c[(i0 + ir) * task.ldc + j0 + jr], task.ldc,
+                                (mc - ir < MATRIX_GEMM_MR) ? mc - ir : MATRIX_GEMM_MR,
+                                (nc - jr < MATRIX_GEMM_NR) ? nc - jr : MATRIX_GEMM_NR, task.accumulate || (p0 > 0));
+                }
+            }
+        }
+    }
+    delete[] packedB;
+    delete[] packedA;
+}
+
+template <typename T> void StaticMatrix<T>::packA(int mc, int kc, const T *a, int aRow, int aCol, T *pack)
+{
+    /* Panels of MATRIX_GEMM_MR rows, stored column after column, the last one padded with zeros */
+    int ir, i, p, mr;
+    for (ir = 0; ir < mc; ir += MATRIX_GEMM_MR)
+    {
+        mr = (mc - ir < MATRIX_GEMM_MR) ? mc - ir : MATRIX_GEMM_MR;
+        for (p = 0; p < kc; ++p)
+        {
+            for (i = 0; i < mr; ++i)
+                pack[i] = a[(ir + i) * aRow + p * aCol];
+            for (; i < MATRIX_GEMM_MR; ++i)
+                pack[i] = 0;
+            pack += MATRIX_GEMM_MR;
+        }
+    }
+}
+
+template <typename T> void StaticMatrix<T>::packB(int kc, int nc, const T *b, int bRow, int bCol, T *pack)
+{
+    /* Panels of MATRIX_GEMM_NR columns, stored row after row, the last one padded with zeros */
+    int jr, j, p, nr;
+    for (jr = 0; jr < nc; jr += MATRIX_GEMM_NR)
+    {
+        nr = (nc - jr < MATRIX_GEMM_NR) ? nc - jr : MATRIX_GEMM_NR;
+        for (p = 0; p < kc; ++p)
+        {
+            for (j = 0; j < nr; ++j)
+                pack[j] = b[p * bRow + (jr + j) * bCol];
+            for (; j < MATRIX_GEMM_NR; ++j)
+                pack[j] = 0;
+            pack += MATRIX_GEMM_NR;
+        }
+    }
+}
+
+template <typename T> inline void StaticMatrix<T>::microKernel(int kc, const T *a, const T *b, T *c, int ldc, int mr, int nr, bool add)
+{
+    /* Fixed-size loops over the micro-tile, which the compiler keeps in vector registers */
+    T ab[MATRIX_GEMM_MR * MATRIX_GEMM_NR];
+    int i, j;
+    for (i = 0; i < MATRIX_GEMM_MR * MATRIX_GEMM_NR; ++i)
+        ab[i] = 0;
+    while (kc)
+    {
+        --kc;
+        for (i = 0; i < MATRIX_GEMM_MR; ++i)
+        {
+            for (j = 0; j < MATRIX_GEMM_NR; ++j)
+                ab[i * MATRIX_GEMM_NR + j] += a[i] * b[j];
+        }
+        a += MATRIX_GEMM_MR;
+        b += MATRIX_GEMM_NR;
+    }
+    for (i = 0; i < mr; ++i, c += ldc)
+    {
+        for (j = 0; j < nr; ++j)
+            c[j] = add ? c[j] + ab[i * MATRIX_GEMM_NR + j] : ab[i * MATRIX_GEMM_NR + j];
+    }
+}
+
+#ifdef __AVX__
+template <> inline void StaticMatrix<double>::microKernel(int kc, const double *a, const double *b, double *c, int ldc, int mr, int nr, bool add)
+{
+    /* 4 x 8 micro-tile in eight 256-bit registers */
+    __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd(), c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+    __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd(), c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+    __m256d b0, b1, ai;
+    while (kc)
+    {
+        --kc;
+        b0 = _mm256_loadu_pd(b);
+        b1 = _mm256_loadu_pd(b + 4);
+  #ifdef __FMA__
+        ai = _mm256_broadcast_sd(a);
+        c00 = _mm256_fmadd_pd(ai, b0, c00);
+        c01 = _mm256_fmadd_pd(ai, b1, c01);
+        ai = _mm256_broadcast_sd(a + 1);
+        c10 = _mm256_fmadd_pd(ai, b0, c10);
+        c11 = _mm256_fmadd_pd(ai, b1, c11);
+        ai = _mm256_broadcast_sd(a + 2);
+        c20 = _mm256_fmadd_pd(ai, b0, c20);
+        c21 = _mm256_fmadd_pd(ai, b1, c21);
+        ai = _mm256_broadcast_sd(a + 3);
+        c30 = _mm256_fmadd_pd(ai, b0, c30);
+        c31 = _mm256_fmadd_pd(ai, b1, c31);
+  #else
+        ai = _mm256_broadcast_sd(a);
+        c00 = _mm256_add_pd(c00, _mm256_mul_pd(ai, b0));
+        c01 = _mm256_add_pd(c01, _mm256_mul_pd(ai, b1));
+        ai = _mm256_broadcast_sd(a + 1);
+        c10 = _mm256_add_pd(c10, _mm256_mul_pd(ai, b0));
+        c11 = _mm256_add_pd(c11, _mm256_mul_pd(ai, b1));
+        ai = _mm256_broadcast_sd(a + 2);
+        c20 = _mm256_add_pd(c20, _mm256_mul_pd(ai, b0));
+        c21 = _mm256_add_pd(c21, _mm256_mul_pd(ai, b1));
+        ai = _mm256_broadcast_sd(a + 3);
+        c30 = _mm256_add_pd(c30, _mm256_mul_pd(ai, b0));
+        c31 = _mm256_add_pd(c31, _mm256_mul_pd(ai, b1));
+  #endif
+        a += 4;
+        b += 8;
+    }
+    if ((mr == 4) && (nr == 8))
+    {
+        if (add)
+        {
+            c00 = _mm256_add_pd(c00, _mm256_loadu_pd(c));
+            c01 = _mm256_add_pd(c01, _mm256_loadu_pd(c + 4));
+            c10 = _mm256_add_pd(c10, _mm256_loadu_pd(c + ldc));
+            c11 = _mm256_add_pd(c11, _mm256_loadu_pd(c + ldc + 4));
+            c20 = _mm256_add_pd(c20, _mm256_loadu_pd(c + 2 * ldc));
+            c21 = _mm256_add_pd(c21, _mm256_loadu_pd(c + 2 * ldc + 4));
+            c30 = _mm256_add_pd(c30, _mm256_loadu_pd(c + 3 * ldc));
+            c31 = _mm256_add_pd(c31, _mm256_loadu_pd(c + 3 * ldc + 4));
+        }
+        _mm256_storeu_pd(c, c00);
+        _mm256_storeu_pd(c + 4, c01);
+        _mm256_storeu_pd(c + ldc, c10);
+        _mm256_storeu_pd(c + ldc + 4, c11);
+        _mm256_storeu_pd(c + 2 * ldc, c20);
+        _mm256_storeu_pd(c + 2 * ldc + 4, c21);
+        _mm256_storeu_pd(c + 3 * ldc, c30);
+        _mm256_storeu_pd(c + 3 * ldc + 4, c31);
+        return;
+    }
+    /* Partial micro-tile on the borders of the result */
+    double ab[32];
+    _mm256_storeu_pd(ab, c00);
+    _mm256_storeu_pd(ab + 4, c01);
+    _mm256_storeu_pd(ab + 8, c10);
+    _mm256_storeu_pd(ab + 12, c11);
+    _mm256_storeu_pd(ab + 16, c20);
+    _mm256_storeu_pd(ab + 20, c21);
+    _mm256_storeu_pd(ab + 24, c30);
+    _mm256_storeu_pd(ab + 28, c31);
+    int i, j;
+    for (i = 0; i < mr; ++i, c += ldc)
+    {
+        for (j = 0; j < nr; ++j)
+            c[j] = add ? c[j] + ab[i * 8 + j] : ab[i * 8 + j];
+    }
+}
+#elif defined(__SSE2__)
+template <> inline void StaticMatrix<double>::microKernel(int kc, const double *a, const double *b, double *c, int ldc, int mr, int nr, bool add)
+{
+    /* The 4 x 8 micro-tile does not fit in the 128-bit registers, and is computed as two 4 x 4 halves */
+    double ab[32];
+    __m128d c00, c01, c10, c11, c20, c21, c30, c31, b0, b1, ai;
+    const double *pa, *pb;
+    int h, p, i, j;
+    for (h = 0; h < 8; h += 4)
+    {
+        c00 = c01 = c10 = c11 = c20 = c21 = c30 = c31 = _mm_setzero_pd();
+        for (p = kc, pa = a, pb = b + h; p; --p, pa += 4, pb += 8)
+        {
+            b0 = _mm_loadu_pd(pb);
+            b1 = _mm_loadu_pd(pb + 2);
+            ai = _mm_set1_pd(pa[0]);
+            c00 = _mm_add_pd(c00, _mm_mul_pd(ai, b0));
+            c01 = _mm_add_pd(c01, _mm_mul_pd(ai, b1));
+            ai = _mm_set1_pd(pa[1]);
+            c10 = _mm_add_pd(c10, _mm_mul_pd(ai, b0));
+            c11 = _mm_add_pd(c11, _mm_mul_pd(ai, b1));
+            ai = _mm_set1_pd(pa[2]);
+            c20 = _mm_add_pd(c20, _mm_mul_pd(ai, b0));
+            c21 = _mm_add_pd(c21, _mm_mul_pd(ai, b1));
+            ai = _mm_set1_pd(pa[3]);
+            c30 = _mm_add_pd(c30, _mm_mul_pd(ai, b0));
+            c31 = _mm_add_pd(c31, _mm_mul_pd(ai, b1));
+        }
+        _mm_storeu_pd(ab + h, c00);
+        _mm_storeu_pd(ab + h + 2, c01);
+        _mm_storeu_pd(ab + h + 8, c10);
+        _mm_storeu_pd(ab + h + 10, c11);
+        _mm_storeu_pd(ab + h + 16, c20);
+        _mm_storeu_pd(ab + h + 18, c21);
+        _mm_storeu_pd(ab + h + 24, c30);
+        _mm_storeu_pd(ab + h + 26, c31);
+    }
+    for (i = 0; i < mr; ++i, c += ldc)
+    {
+        for (j = 0; j < nr; ++j)
+            c[j] = add ? c[j] + ab[i * 8 + j] : ab[i * 8 + j];
+    }
+}
+#endif
+
+template <typename T> StaticMatrix<T> *StaticMatrix<T>::symmetricProduct(int n, int k, const T *a, int aRow, int aCol)
+{
+    /* Product of the n x k operand a with its transpose: only the upper triangle is computed, then mirrored */
+    T *data = new T[n * n];
+    product(n, n, k, a, aRow, aCol, a, aCol, aRow, data, n, true);
+    int i, j;
+    for (i = 1; i < n; ++i)
+    {
+        for (j = 0; j < i; ++j)
+            data[i * n + j] = data[j * n + i];
+    }
+    return new StaticMatrix<T>(n, n, data);
+}
+
+template <typename T> bool StaticMatrix<T>::cholesky(int n, T *a, const T &tolerance)
+{
+    /* Upper factor U such that a = U^T U, computed in place by blocks of MATRIX_CHOLESKY_BLOCK rows:
+     * the rows of a block are factored, then the trailing matrix is updated with the tiled product.
+     * Returns false as soon as a pivot is not greater than tolerance. */
+    T *neg = new T[MATRIX_CHOLESKY_BLOCK * n], *row, *prev, u;
+    int k0, nb, n2, i, j, p;
+    for (k0 = 0; k0 < n; k0 += nb)
+    {
+        nb = (n - k0 < MATRIX_CHOLESKY_BLOCK) ? n - k0 : MATRIX_CHOLESKY_BLOCK;
+        n2 = n - k0 - nb;
+        for (i = k0; i < k0 + nb; ++i)
+        {
+            row = &a[i * n];
+            for (p = k0; p < i; ++p)
+            {
+                prev = &a[p * n];
+                u = prev[i];
+                for (j = i; j < n; ++j)
+                    row[j] -= u * prev[j];
+            }
+            if (!(row[i] > tolerance))
+            {
+                delete[] neg;
+                return false;
+            }
+            row[i] = u = sqrt(row[i]);
+            u = 1 / u;
+            for (j = i + 1; j < n; ++j)
+                row[j] *= u;
+        }
+        if (n2)
+        {
+            /* Upper triangle of a22 -= U12^T U12, with -U12 copied as the left operand */
+            for (p = 0; p < nb; ++p)
+            {
+                row = &a[(k0 + p) * n + k0 + nb];
+                for (j = 0; j < n2; ++j)
+                    neg[p * n2 + j] = -row[j];
+            }
+            product(n2, n2, nb, neg, 1, n2, &a[k0 * n + k0 + nb], n, 1, &a[(k0 + nb) * (n + 1)], n, true, true);
+        }
+    }
+    delete[] neg;
+    for (i = 1; i < n; ++i)
+        memset((void*) &a[i * n], 0, i * sizeof(T));
+    return true;
+}
+
+template <typename T> void StaticMatrix<T>::upperInverse(int n, const T *u, T *x)
+{
+    /* x = u^-1, u being upper triangular and invertible, by back substitution on the rows of x */
+    T *row, d;
+    int i, j, p;
+    memset((void*) x, 0, n * n * sizeof(T));
+    for (i = n - 1; i >= 0; --i)
+    {
+        row = &x[i * n];
+        for (p = i + 1; p < n; ++p)
+        {
+            d = u[i * n + p];
+            if (d != 0)
+            {
+                for (j = p; j < n; ++j)
+                    row[j] -= d * x[p * n + j];
+            }
+        }
+        row[i] = d = 1 / u[i * n + i];
+        for (j = i + 1; j < n; ++j)
+            row[j] *= d;
+    }
+}
+
+template <typename T> void StaticMatrix<T>::symmetricEigen(int n, T *a, T *values)
+{
+    /* Householder tridiagonalization followed by the implicit QL algorithm (tred2 and tql2 from EISPACK).
+     * On return, values holds the eigenvalues in increasing order, and row j of a the eigenvector of
+     * values[j]. As a is symmetric, it is used as the transpose of the matrix V of the original
+     * algorithms, so that all the loops over V go along the rows. */
+    T *d = values, *e = new T[n], scale, f, g, h, hh;
+    int i, j, k, l, m;
+    #define V(r, c) a[(c) * n + (r)]
+    for (j = 0; j < n; ++j)
+        d[j] = V(n - 1, j);
+    for (i = n - 1; i > 0; --i)
+    {
+        scale = 0;
+        h = 0;
+        for (k = 0; k < i; ++k)
+            scale += ABS(d[k]);
+        if (scale == 0)
+        {
+            e[i] = d[i - 1];
+            for (j = 0; j < i; ++j)
+            {
+                d[j] = V(i - 1, j);
+                V(i, j) = 0;
+                V(j, i) = 0;
+            }
+        } else {
+            for (k = 0; k < i; ++k)
+            {
+                d[k] /= scale;
+                h += d[k] * d[k];
+            }
+            f = d[i - 1];
+            g = sqrt(h);
+            if (f > 0)
+                g = -g;
+            e[i] = scale * g;
+            h -= f * g;
+            d[i - 1] = f - g;
+            for (j = 0; j < i; ++j)
+                e[j] = 0;
+            for (j = 0; j < i; ++j)
+            {
+                f = d[j];
+                V(j, i) = f;
+                g = e[j] + V(j, j) * f;
+                for (k = j + 1; k < i; ++k)
+                {
+                    g += V(k, j) * d[k];
+                    e[k] += V(k, j) * f;
+                }
+                e[j] = g;
+            }
+            f = 0;
+            for (j = 0; j < i; ++j)
+            {
+                e[j] /= h;
+                f += e[j] * d[j];
+            }
+            hh = f / (h + h);
+            for (j = 0; j < i; ++j)
+                e[j] -= hh * d[j];
+            for (j = 0; j < i; ++j)
+            {
+                f = d[j];
+                g = e[j];
+                for (k = j; k < i; ++k)
+                    V(k, j) -= f * e[k] + g * d[k];
+                d[j] = V(i - 1, j);
+                V(i, j) = 0;
+            }
+        }
+        d[i] = h;
+    }
+    /* Accumulation of the transformations */
+    for (i = 0; i < n - 1; ++i)
+    {
+        V(n - 1, i) = V(i, i);
+        V(i, i) = 1;
+        h = d[i + 1];
+        if (h != 0)
+        {
+            for (k = 0; k <= i; ++k)
+                d[k] = V(k, i + 1) / h;
+            for (j = 0; j <= i; ++j)
+            {
+                g = 0;
+                for (k = 0; k <= i; ++k)
+                    g += V(k, i + 1) * V(k, j);
+                for (k = 0; k <= i; ++k)
+                    V(k, j) -= g * d[k];
+            }
+        }
+        for (k = 0; k <= i; ++k)
+            V(k, i + 1) = 0;
+    }
+    for (j = 0; j < n; ++j)
+    {
+        d[j] = V(n - 1, j);
+        V(n - 1, j) = 0;
+    }
+    V(n - 1, n - 1) = 1;
+    /* QL iterations on the tridiagonal matrix */
+    for (i = 1; i < n; ++i)
+        e[i - 1] = e[i];
+    e[n - 1] = 0;
+    T tst1 = 0, eps = epsilon(), p, r, c, c2, c3, s, s2, dl1, el1, tmp;
+    f = 0;
+    for (l = 0; l < n; ++l)
+    {
+        tmp = ABS(d[l]) + ABS(e[l]);
+        if (tmp > tst1)
+            tst1 = tmp;
+        for (m = l; m < n - 1; ++m)
+        {
+            if (ABS(e[m]) <= eps * tst1)
+                break;
+        }
+        if (m > l)
+        {
+            do {
+                g = d[l];
+                p = (d[l + 1] - g) / (2 * e[l]);
+                r = hypot(p, (T) 1);
+                if (p < 0)
+                    r = -r;
+                d[l] = e[l] / (p + r);
+                d[l + 1] = e[l] * (p + r);
+                dl1 = d[l + 1];
+                h = g - d[l];
+                for (i = l + 2; i < n; ++i)
+                    d[i] -= h;
+                f += h;
+                p = d[m];
+                c = c2 = c3 = 1;
+                el1 = e[l + 1];
+                s = s2 = 0;
+                for (i = m - 1; i >= l; --i)
+                {
+                    c3 = c2;
+                    c2 = c;
+                    s2 = s;
+                    g = c * e[i];
+                    h = c * p;
+                    r = hypot(p, e[i]);
+                    e[i + 1] = s * r;
+                    s = e[i] / r;
+                    c = p / r;
+                    p = c * d[i] - s * g;
+                    d[i + 1] = h + s * (c * g + s * d[i]);
+                    T *v0 = &V(0, i), *v1 = &V(0, i + 1);
+                    for (k = 0; k < n; ++k)
+                    {
+                        h = v1[k];
+                        v1[k] = s * v0[k] + c * h;
+                        v0[k] = c * v0[k] - s * h;
+                    }
+                }
+                p = -s * s2 * c3 * el1 * e[l] / dl1;
+                e[l] = s * p;
+                d[l] = c * p;
+            } while (ABS(e[l]) > eps * tst1);
+        }
+        d[l] += f;
+        e[l] = 0;
+    }
+    #undef V
+    delete[] e;
+    /* Sort the eigenvalues and their eigenvectors */
+    for (i = 0; i < n - 1; ++i)
+    {
+        k = i;
+        p = d[i];
+        for (j = i + 1; j < n; ++j)
+        {
+            if (d[j] < p)
+            {
+                k = j;
+                p = d[j];
+            }
+        }
+        if (k != i)
+        {
+            d[k] = d[i];
+            d[i] = p;
+            for (j = 0; j < n; ++j)
+            {
+                tmp = a[i * n + j];
+                a[i * n + j] = a[k * n + j];
+                a[k * n + j] = tmp;
+            }
+        }
+    }
+}
+
+template <typename T> void StaticMatrix<T>::orthogonalPseudoInverse(int p, int k, const T *a, int aRow, int aCol,
+                                                                    T *x, int xRow, int xCol, const T &negligible)
+{
+    /* Pseudoinverse of the p x k operand a (p >= k), written to x (k x p), both read with any strides:
+     * Householder QR decomposition a = Q R, then singular value decomposition R = W S V^T by one-sided Jacobi
+     * rotations on the columns of R, which are orthogonalized into those of W S while V accumulates the rotations.
+     * The rotations start from the eigenvectors of R^T R, which are only used to make the columns nearly orthogonal,
+     * so that one or two sweeps are usually enough, while the accuracy is still that of the rotations on R.
+     * Then a+ = V S+ W^T Q^T = V S+^2 V^T a^T, without the singular values that are not greater than negligible
+     * nor than the rounding errors (p * epsilon * the largest one). The columns of a, of R and of V are stored
+     * as the rows of h, c and v, so that all the loops go along the rows. */
+    T *h = new T[k * p], *tau = new T[k], *norms = new T[k], *c = new T[k * k], *v = new T[k * k], *w = new T[k * k], *hi, *hj;
+    T *panel = new T[PINV_QR_BLOCK * p], *factor = new T[PINV_QR_BLOCK * PINV_QR_BLOCK];
+    bool *moved = new bool[k];
+    T eps = epsilon(), tolerance = eps * sqrt((T) k), alpha, beta, gamma, zeta, t, cs, sn, tmp, max = 0;
+    int i, j, l, sweep, c0, c1;
+    bool rotated = true;
+    for (i = 0; i < k; ++i)
+    {
+        for (j = 0; j < p; ++j)
+            h[i * p + j] = a[j * aRow + i * aCol];
+    }
+    /* Reflector i is I - tau[i] u u^T, u being stored in row i of h from index i, and the diagonal of R in c.
+     * The reflectors are computed by panels of PINV_QR_BLOCK columns, then applied together to the next columns. */
+    for (c0 = 0; c0 < k; c0 = c1)
+    {
+        c1 = (k - c0 < PINV_QR_BLOCK) ? k : c0 + PINV_QR_BLOCK;
+        for (i = c0; i < c1; ++i)
+        {
+            hi = &h[i * p];
+            alpha = sqrt(dot(p - i, &hi[i], &hi[i]));
+            if (alpha == 0)
+            {
+                tau[i] = 0;
+                c[i * k + i] = 0;
+                continue;
+            }
+            if (hi[i] > 0)
+                alpha = -alpha;
+            hi[i] -= alpha;
+            tau[i] = -1 / (alpha * hi[i]);
+            c[i * k + i] = alpha;
+            for (j = i + 1; j < c1; ++j)
+            {
+                hj = &h[j * p];
+                tmp = tau[i] * dot(p - i, &hi[i], &hj[i]);
+                for (l = i; l < p; ++l)
+                    hj[l] -= tmp * hi[l];
+            }
+        }
+        if (c1 < k)
+        {
+            blockReflector(c1 - c0, p - c0, &h[c0 * (p + 1)], p, &tau[c0], panel, factor, w);
+            applyReflectors(c1 - c0, p - c0, panel, factor, k - c1, &h[c1 * p + c0], p, w);
+        }
+    }
+    /* R, with h[j * p + i] right of the diagonal */
+    for (i = 0; i < k; ++i)
+    {
+        for (j = 0; j < i; ++j)
+            w[i * k + j] = 0;
+        w[i * k + i] = c[i * k + i];
+        for (j = i + 1; j < k; ++j)
+            w[i * k + j] = h[j * p + i];
+    }
+    /* The rows of v are the eigenvectors of R^T R, and those of c the columns of R V */
+    StaticMatrix<T> *gram = symmetricProduct(k, k, w, 1, k);
+    memcpy((void*) v, (void*) gram->_data, k * k * sizeof(T));
+    delete gram;
+    symmetricEigen(k, v, norms);
+    product(k, k, k, v, k, 1, w, 1, k, c, k);
+    for (sweep = 0; rotated && (sweep < PINV_JACOBI_SWEEPS); ++sweep)
+    {
+        rotated = false;
+        /* The dot products of the columns are taken from the tiled product at the start of each sweep,
+         * and only recomputed for the columns that have been rotated since, as most pairs need no rotation.
+         * The squared norms are updated by the rotations. */
+        product(k, k, k, c, k, 1, c, 1, k, w, k, true);
+        for (i = 0; i < k; ++i)
+        {
+            norms[i] = w[i * k + i];
+            moved[i] = false;
+        }
+        for (i = 0; i < k - 1; ++i)
+        {
+            hi = &c[i * k];
+            for (j = i + 1; j < k; ++j)
+            {
+                hj = &c[j * k];
+                gamma = (moved[i] || moved[j]) ? dot(k, hi, hj) : w[i * k + j];
+                alpha = norms[i];
+                beta = norms[j];
+                /* Columns already orthogonal up to the rounding errors of their dot product */
+                if (ABS(gamma) <= tolerance * sqrt(alpha * beta))
+                    continue;
+                rotated = true;
+                moved[i] = true;
+                moved[j] = true;
+                /* Rotation that makes the two columns orthogonal */
+                zeta = (beta - alpha) / (2 * gamma);
+                t = ((zeta >= 0) ? 1 : -1) / (ABS(zeta) + hypot(zeta, (T) 1));
+                cs = 1 / sqrt(1 + t * t);
+                sn = cs * t;
+                norms[i] = alpha - t * gamma;
+                norms[j] = beta + t * gamma;
+                for (l = 0; l < k; ++l)
+                {
+                    tmp = hi[l];
+                    hi[l] = cs * tmp - sn * hj[l];
+                    hj[l] = sn * tmp + cs * hj[l];
+                }
+                for (l = 0; l < k; ++l)
+                {
+                    tmp = v[i * k + l];
+                    v[i * k + l] = cs * tmp - sn * v[j * k + l];
+                    v[j * k + l] = sn * tmp + cs * v[j * k + l];
+                }
+            }
+        }
+    }
+    /* Row i of c becomes v_i / s_i^2, or zero */
+    for (i = 0; i < k; ++i)
+    {
+        norms[i] = dot(k, &c[i * k], &c[i * k]);
+        if (norms[i] > max)
+            max = norms[i];
+    }
+    max = sqrt(max) * eps * p;
+    if (max < negligible)
+        max = negligible;
+    for (i = 0; i < k; ++i)
+    {
+        tmp = (sqrt(norms[i]) > max) ? 1 / norms[i] : 0;
+        for (l = 0; l < k; ++l)
+            c[i * k + l] = tmp * v[i * k + l];
+    }
+    /* As a v_i = s_i Q w_i, a+ = V S+ W^T Q^T = (V S+^2 V^T) a^T, which does not need Q */
+    product(k, k, k, c, 1, k, v, k, 1, w, k);
+    if (xCol == 1)
+    {
+        product(k, p, k, w, k, 1, a, aCol, aRow, x, xRow);
+    } else {
+        product(k, p, k, w, k, 1, a, aCol, aRow, h, p);
+        for (i = 0; i < k; ++i)
+        {
+            for (j = 0; j < p; ++j)
+                x[i * xRow + j * xCol] = h[i * p + j];
+        }
+    }
+    delete[] moved;
+    delete[] w;
+    delete[] factor;
+    delete[] panel;
+    delete[] norms;
+    delete[] v;
+    delete[] c;
+    delete[] tau;
+    delete[] h;
+}
+
+template <typename T> void StaticMatrix<T>::blockReflector(int nb, int len, const T *h, int ldh, const T *tau, T *v, T *t, T *g)
+{
+    /* Product H_0 H_1 ... H_nb-1 = I - V T V^T of the reflectors I - tau[i] u_i u_i^T whose vectors start at h[i * ldh + i]:
+     * the rows of v (nb x len) are the u_i, with zeros before their first index, and t is the upper triangular T (nb x nb),
+     * whose column i is -tau[i] T (V^T u_i) above the diagonal, from the products g = V V^T */
+    int i, j, l;
+    T sum;
+    for (i = 0; i < nb; ++i)
+    {
+        memset((void*) &v[i * len], 0, i * sizeof(T));
+        memcpy((void*) &v[i * len + i], (const void*) &h[i * ldh + i], (len - i) * sizeof(T));
+    }
+    product(nb, nb, len, v, len, 1, v, 1, len, g, nb);
+    for (i = 0; i < nb; ++i)
+    {
+        for (j = 0; j < i; ++j)
+        {
+            sum = 0;
+            for (l = j; l < i; ++l)
+                sum += t[j * nb + l] * g[l * nb + i];
+            t[j * nb + i] = -tau[i] * sum;
+        }
+        t[i * nb + i] = tau[i];
+        for (j = i + 1; j < nb; ++j)
+            t[j * nb + i] = 0;
+    }
+}
+
+template <typename T> void StaticMatrix<T>::applyReflectors(int nb, int len, const T *v, const T *t, int rows, T *z, int ldz, T *w)
+{
+    /* Replaces each of the rows of z (rows x len) by its product with (I - V T V^T)^T, v and t being given
+     * by blockReflector: z -= ((z V) T) V^T, both products going through the tiled product,
+     * with w (rows x nb) holding z V, then minus its product with T */
+    T *wr, sum;
+    int r, i, j;
+    product(rows, nb, len, z, ldz, 1, v, 1, len, w, nb);
+    for (r = 0; r < rows; ++r)
+    {
+        wr = &w[r * nb];
+        for (i = nb - 1; i >= 0; --i)
+        {
+            sum = 0;
+            for (j = 0; j <= i; ++j)
+                sum += wr[j] * t[j * nb + i];
+            wr[i] = -sum;
+        }
+    }
+    product(rows, len, nb, w, nb, 1, v, len, 1, z, ldz, false, true);
+}
+
+template <typename T> inline T StaticMatrix<T>::epsilon()
+{
+    /* Smallest power of 2 that still changes 1 when added to it */
+    volatile T e = 1, sum;
+    while ((sum = 1 + e / 2) != 1)
+        e /= 2;
+    return e;
+}
+
+template <typename T> inline T StaticMatrix<T>::hypot(const T &a, const T &b)
+{
+    /* sqrt(a^2 + b^2) without overflow nor underflow */
+    T absA = ABS(a), absB = ABS(b), r;
+    if (absA > absB)
+    {
+        r = absB / absA;
+        return absA * sqrt(1 + r * r);
+    }
+    if (absB == 0)
+        return 0;
+    r = absA / absB;
+    return absB * sqrt(1 + r * r);
+}
+
+template <typename T> inline T StaticMatrix<T>::dot(int n, const T *a, const T *b)
+{
+    /* Four partial sums, so that the additions do not wait for each other and can be vectorized */
+    T s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    int i;
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < n; ++i)
+        s0 += a[i] * b[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+#ifdef MATRIX_USE_THREADPOOL
+template <typename T> void StaticMatrix<T>::productTask(void *arg, int index)
+{
+    productTiles(*reinterpret_cast<ProductTask*>(arg), index);
+}
+#endif
+
+/* Used by det() and operator/=() */
+#include "LUDecomposition.h"
+
 #endif // STATICMATRIX_H
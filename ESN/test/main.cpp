@@ -1,6 +1,7 @@
 #include <QtCore>
 
 #include "src/Matrix.h"
+#include "src/RidgeReadout.h"
 
 #define DISP(m) printf(#m ":\n"); m.print(stdout, toString);
 
@@ -16,6 +17,192 @@ const char *toString(double v)
     return qPrintable(str);
 }
 
+/* Random m x k matrix with orthonormal columns, by Gram-Schmidt done twice */
+void orthonormal(Matrix<double> &q)
+{
+    int m = q.countRows(), k = q.countCols();
+    for (int j = 0; j < k; ++j)
+    {
+        for (int i = 0; i < m; ++i)
+            q(i, j) = getEl();
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            for (int l = 0; l < j; ++l)
+            {
+                double d = 0;
+                for (int i = 0; i < m; ++i)
+                    d += q(i, l) * q(i, j);
+                for (int i = 0; i < m; ++i)
+                    q(i, j) -= d * q(i, l);
+            }
+        }
+        double n = 0;
+        for (int i = 0; i < m; ++i)
+            n += q(i, j) * q(i, j);
+        n = sqrt(n);
+        for (int i = 0; i < m; ++i)
+            q(i, j) /= n;
+    }
+}
+
+/* Pseudoinverse of A = U S V^T (m x n), compared with V S+ U^T: returns the largest error relative to
+ * the largest element of the expected result */
+double pseudoInverseError(int m, int n, const double *s, double negligible)
+{
+    int k = qMin(m, n);
+    Matrix<double> u(m, k), v(n, k), a(m, n), expected(n, m);
+    orthonormal(u);
+    orthonormal(v);
+    double max = 0, error = 0;
+    for (int i = 0; i < m; ++i)
+    {
+        for (int j = 0; j < n; ++j)
+        {
+            for (int l = 0; l < k; ++l)
+                a(i, j) += u(i, l) * s[l] * v(j, l);
+        }
+    }
+    for (int i = 0; i < n; ++i)
+    {
+        for (int j = 0; j < m; ++j)
+        {
+            for (int l = 0; l < k; ++l)
+            {
+                if (s[l] > negligible)
+                    expected(i, j) += v(i, l) / s[l] * u(j, l);
+            }
+            max = qMax(max, qAbs(expected(i, j)));
+        }
+    }
+    a.pseudoInverse(negligible);
+    for (int i = 0; i < n; ++i)
+    {
+        for (int j = 0; j < m; ++j)
+            error = qMax(error, qAbs(a(i, j) - expected(i, j)));
+    }
+    return error / max;
+}
+
+void testPseudoInverse()
+{
+    double s[50];
+    for (int i = 0; i < 50; ++i)
+        s[i] = 1 - i * 0.018;
+    printf("Pseudoinverse, well conditioned: %g\n", pseudoInverseError(80, 50, s, 0));
+    s[49] = 5e-3;
+    printf("Pseudoinverse, singular value below negligible: %g\n", pseudoInverseError(80, 50, s, 1e-2));
+    printf("Pseudoinverse, same, transposed: %g\n", pseudoInverseError(50, 80, s, 1e-2));
+    s[49] = 0;
+    printf("Pseudoinverse, rank deficient: %g\n", pseudoInverseError(80, 50, s, 1e-9));
+    s[49] = 1e-7;
+    printf("Pseudoinverse, condition number 1e7 (expected about 1e-9): %g\n", pseudoInverseError(80, 50, s, 0));
+    printf("Pseudoinverse, same, almost square: %g\n", pseudoInverseError(50, 53, s, 0));
+}
+
+/* Largest residual of A X = B, relative to the largest element of B */
+double solveResidual(const Matrix<double> &a, const Matrix<double> &x, const Matrix<double> &b)
+{
+    Matrix<double> r = a * x - b;
+    double error = 0, max = 0;
+    for (int i = 0; i < b.countRows(); ++i)
+    {
+        for (int j = 0; j < b.countCols(); ++j)
+        {
+            error = qMax(error, qAbs(r(i, j)));
+            max = qMax(max, qAbs(b(i, j)));
+        }
+    }
+    return error / max;
+}
+
+void testLUDecomposition()
+{
+    /* The first pivot is zero: det = -8 */
+    double small[9] = { 0, 2, 1, 1, 1, 0, 2, 0, 3 };
+    LUDecomposition<double> pivoted(3, small);
+    printf("LU, determinant with pivoting (expected -8): %g\n", pivoted.det());
+    /* Neither a multiple of LU_BLOCK nor smaller than it, and diagonally dominant */
+    int n = 2 * LU_BLOCK + 22;
+    Matrix<double> a(n, n), b1(n, MATRIX_GEMM_NR - 1), b2(n, 2 * MATRIX_GEMM_NR), identity(n, n);
+    for (int i = 0; i < n; ++i)
+    {
+        for (int j = 0; j < n; ++j)
+            a(i, j) = getEl() + ((i == j) ? n / 4 : 0);
+        for (int j = 0; j < b1.countCols(); ++j)
+            b1(i, j) = getEl();
+        for (int j = 0; j < b2.countCols(); ++j)
+            b2(i, j) = getEl();
+    }
+    LUDecomposition<double> lu(a);
+    Matrix<double> x1 = b1, x2 = b2;
+    lu.solve(x1);
+    lu.solve(x2);
+    printf("LU, residual with %d right-hand sides: %g\n", b1.countCols(), solveResidual(a, x1, b1));
+    printf("LU, residual with %d right-hand sides: %g\n", b2.countCols(), solveResidual(a, x2, b2));
+    identity.addIdentity();
+    printf("LU, residual of the inverse: %g\n", solveResidual(lu.inverse(), a, identity));
+}
+
+/* Largest difference between a and b, relative to the largest element of b */
+double relativeDiff(const Matrix<double> &a, const Matrix<double> &b)
+{
+    double error = 0, max = 0;
+    for (int i = 0; i < b.countRows(); ++i)
+    {
+        for (int j = 0; j < b.countCols(); ++j)
+        {
+            error = qMax(error, qAbs(a(i, j) - b(i, j)));
+            max = qMax(max, qAbs(b(i, j)));
+        }
+    }
+    return error / max;
+}
+
+void testRidgeReadout()
+{
+    int nStates = 12, nOutputs = 3, size = 150;
+    Matrix<double> states(size, nStates), targets(size, nOutputs), xx(nStates, nStates), yx(nOutputs, nStates);
+    for (int s = 0; s < size; ++s)
+    {
+        for (int i = 0; i < nStates; ++i)
+            states(s, i) = getEl();
+        for (int i = 0; i < nOutputs; ++i)
+            targets(s, i) = getEl();
+    }
+    /* X X^T and Y X^T computed directly */
+    for (int i = 0; i < nStates; ++i)
+    {
+        for (int s = 0; s < size; ++s)
+        {
+            for (int j = 0; j < nStates; ++j)
+                xx(i, j) += states(s, i) * states(s, j);
+            for (int j = 0; j < nOutputs; ++j)
+                yx(j, i) += targets(s, j) * states(s, i);
+        }
+    }
+    /* The samples given one by one are added by blocks of 16, the last one being incomplete */
+    RidgeReadout<double> one(nStates, nOutputs, 16), all(nStates, nOutputs);
+    for (int s = 0; s < size; ++s)
+        one.addSample(&states.constData()[s * nStates], &targets.constData()[s * nOutputs]);
+    all.addSamples(states, targets);
+    printf("Ridge, addSample against addSamples: %g %g\n", relativeDiff(one.statesCorrelation(), all.statesCorrelation()),
+           relativeDiff(one.crossCorrelation(), all.crossCorrelation()));
+    printf("Ridge, correlations against direct ones: %g %g\n", relativeDiff(all.statesCorrelation(), xx),
+           relativeDiff(all.crossCorrelation(), yx));
+    /* W_out (X X^T + lambda I) = Y X^T */
+    double lambdas[3] = { 1e-3, 0.5, 20 };
+    Matrix<double> readouts[3], regularized;
+    for (int i = 0; i < nStates; ++i)
+        xx(i, i) += lambdas[1];
+    regularized = one.solve(lambdas[1]) * xx;
+    printf("Ridge, residual of solve: %g\n", relativeDiff(regularized, yx));
+    all.solve(3, lambdas, readouts);
+    double error = 0;
+    for (int k = 0; k < 3; ++k)
+        error = qMax(error, relativeDiff(readouts[k], all.solve(lambdas[k])));
+    printf("Ridge, several values of lambda against solve: %g\n", error);
+}
+
 int main(int argc, char *argv[])
 {
     QCoreApplication a(argc, argv);
@@ -34,5 +221,8 @@ int main(int argc, char *argv[])
     m3 = m1.timesTranspose(m2);
     m3 /= m1;
     DISP(m3)
+    testPseudoInverse();
+    testLUDecomposition();
+    testRidgeReadout();
     return 0;
 }
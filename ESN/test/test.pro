@@ -18,5 +18,7 @@ TEMPLATE = app
 SOURCES += main.cpp
 
 HEADERS += \
+    src/LUDecomposition.h \
     src/Matrix.h \
+    src/RidgeReadout.h \
     src/StaticMatrix.h
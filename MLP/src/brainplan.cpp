@@ -0,0 +1,1074 @@
+/*
+ * Copyright (c) 2015, Rémi Bazin <bazin.remi@gmail.com>
+ * All rights reserved.
+ * See LICENSE for licensing details.
+ */
+
+/*!
+    \class BrainPlan
+    \inmodule NetNeurons
+    \ingroup NetNeurons
+
+    \brief BrainPlan is a flat representation of a network of neurons, used by a compiled BrainInterface.
+
+    The neurons that the outputs depend on are sorted in topological order, and their connections
+    are stored in contiguous arrays, grouped by destination (as a compressed sparse row matrix),
+    as well as by source. The network is then evaluated and trained by plain loops over these arrays,
+    without any recursion nor pointer to follow per connection.
+
+    The neurons are grouped by level: the inputs are at level 0, and each other neuron is one level
+    above the highest of its sources. The neurons of a level do not depend on each other, so the
+    large levels are split among the threads of the global ThreadPool once setThreads() was called.
+
+    Up to \c BRAINPLAN_PENDING_SAMPLES samples are computed together: each neuron goes through all
+    of them before the next one, so that its weights are read from memory once for all the samples.
+
+    The weights and the training state of the connections are held by the plan until
+    decompile() writes them back to the neurons.
+
+    A plan can also be built directly from a network given in compressed sparse row form, without creating
+    any Neuron, which is much lighter for large sparse networks; it is then used on its own, with run(),
+    train() and learn(). The rows that do not fill groups of \c KERNEL_ROWS neurons, as in sparse networks,
+    are computed by kernel_dot_samples(), which goes through a row once for all the samples of a batch.
+
+    \sa BrainInterface::compile()
+*/
+
+#include "brainplan.h"
+#include "frozenbrain.h"
+#include "kernels.h"
+#include "optimizer.h"
+#ifdef __unix__
+ #include "threadpool.h"
+#endif
+
+#include <stdio.h>
+
+/* C++ Double expansion trick */
+#define BRAINPLAN_S(x) #x
+#define BRAINPLAN_S_(x) BRAINPLAN_S(x)
+
+#define ERROR(str) fprintf(stderr, __FILE__ " (" BRAINPLAN_S_(__LINE__) "): " str)
+
+/* Values of Neuron::planIndex outside of compile() and while a neuron is being visited */
+#define BRAINPLAN_UNVISITED -1
+#define BRAINPLAN_VISITING -2
+
+BrainPlan::BrainPlan(int nInputs, int nOutputs, int nNodes, int nEdges)
+    : nInputs(nInputs), nOutputs(nOutputs), nNodes(nNodes), nEdges(nEdges), nLevels(0), neurons(NULL), edgeOrigin(NULL)
+{
+#ifdef __unix__
+    t_count = 1;
+    t_start = t_end = t_samples = 0;
+#endif
+    levelStart = new int[nNodes + 2];
+    activ = new NEURON_FUN[nNodes];
+    deriv = new NEURON_FUN[nNodes];
+    pendingCapacity = BRAINPLAN_PENDING_SAMPLES;
+    pending = 0;
+    value = values = new double[nNodes * pendingCapacity];
+    delta = deltas = new double[nNodes * pendingCapacity];
+    isOutput = new bool[nNodes];
+    outputIndex = new int[nOutputs];
+    rowStart = new int[nNodes + 1];
+    source = new int[nEdges];
+    weight = new double[nEdges];
+    grad = new double[nEdges];
+    state1 = new double[nEdges];
+    state2 = new double[nEdges];
+    outStart = new int[nNodes + 1];
+    outEdge = new int[nEdges];
+    outTarget = new int[nEdges];
+    rowGroup = new bool[nNodes];
+    outGroup = new bool[nNodes];
+}
+
+/*!
+    Destructs the plan, without writing its weights back to the neurons.
+
+    \sa decompile()
+*/
+BrainPlan::~BrainPlan()
+{
+    delete[] outGroup;
+    delete[] rowGroup;
+    delete[] outTarget;
+    delete[] outEdge;
+    delete[] outStart;
+    delete[] state2;
+    delete[] state1;
+    delete[] grad;
+    delete[] weight;
+    delete[] source;
+    delete[] rowStart;
+    delete[] outputIndex;
+    delete[] isOutput;
+    delete[] deltas;
+    delete[] values;
+    delete[] deriv;
+    delete[] activ;
+    if (edgeOrigin)
+        delete[] edgeOrigin;
+    if (neurons)
+        delete[] neurons;
+    delete[] levelStart;
+}
+
+/*!
+    Builds the plan of the network whose input neurons are \a inputNeurons
+    and output neurons are \a outputNeurons.
+
+    Only the neurons the outputs depend on are part of the plan, and the connections towards
+    the input neurons are ignored, as the values of the inputs are always given.
+
+    Returns the plan, or \c NULL if the network contains a loop or an input neuron twice.
+
+    \note Complexity is O(number of neurons + number of connections), without recursion.
+*/
+BrainPlan *BrainPlan::compile(const QList<Neuron*> &inputNeurons, const QList<Neuron*> &outputNeurons)
+{
+    QList<Neuron*> order, stack;
+    QList<int> next;
+    bool success = true;
+    Neuron *neuron, *src;
+    for (int i = 0; success && (i < inputNeurons.length()); ++i)
+    {
+        neuron = inputNeurons.at(i);
+        if (neuron->planIndex != BRAINPLAN_UNVISITED)
+        {
+            ERROR("In BrainPlan::compile, an input neuron is given twice.");
+            success = false;
+            break;
+        }
+        neuron->planIndex = order.length();
+        order.append(neuron);
+    }
+    /* Depth-first search from the outputs, with an explicit stack; the neurons are appended
+     * to order once all their sources are, which gives a topological order. The connections
+     * are followed in the order of the sums, so that the sources of a layer get consecutive
+     * indices in that order: next counts the connections left */
+    for (int i = 0; success && (i < outputNeurons.length()); ++i)
+    {
+        neuron = outputNeurons.at(i);
+        if (neuron->planIndex != BRAINPLAN_UNVISITED)
+            continue;
+        neuron->planIndex = BRAINPLAN_VISITING;
+        stack.append(neuron);
+        next.append(neuron->backwardConnections.length());
+        while (!stack.isEmpty())
+        {
+            neuron = stack.last();
+            int &j = next[next.length() - 1];
+            if (j == 0)
+            {
+                neuron->planIndex = order.length();
+                order.append(neuron);
+                stack.removeLast();
+                next.removeLast();
+                continue;
+            }
+            src = neuron->backwardConnections.at(--j).source;
+            if (src->planIndex == BRAINPLAN_VISITING)
+            {
+                ERROR("In BrainPlan::compile, the network contains a loop.");
+                success = false;
+                break;
+            }
+            if (src->planIndex == BRAINPLAN_UNVISITED)
+            {
+                src->planIndex = BRAINPLAN_VISITING;
+                stack.append(src);
+                next.append(src->backwardConnections.length());
+            }
+        }
+    }
+    if (!success)
+    {
+        for (int i = order.length() - 1; i >= 0; --i)
+            order.at(i)->planIndex = BRAINPLAN_UNVISITED;
+        for (int i = stack.length() - 1; i >= 0; --i)
+            stack.at(i)->planIndex = BRAINPLAN_UNVISITED;
+        return NULL;
+    }
+    int nInputs = inputNeurons.length(), nNodes = order.length(), nEdges = 0;
+    for (int n = nInputs; n < nNodes; ++n)
+        nEdges += order.at(n)->backwardConnections.length();
+    BrainPlan *plan = new BrainPlan(nInputs, outputNeurons.length(), nNodes, nEdges);
+    plan->neurons = new Neuron*[nNodes];
+    int k = 0;
+    for (int n = 0; n < nNodes; ++n)
+    {
+        neuron = order.at(n);
+        plan->neurons[n] = neuron;
+        plan->activ[n] = neuron->activ;
+#if NEURON_ENABLE_LEARNING
+        plan->deriv[n] = neuron->deriv;
+#else
+        plan->deriv[n] = NULL;
+#endif
+        plan->value[n] = neuron->a;
+        plan->rowStart[n] = k;
+        if (n < nInputs)
+            continue;
+        for (int i = neuron->backwardConnections.length() - 1; i >= 0; --i, ++k)
+        {
+            const Neuron::Connection &c = neuron->backwardConnections.at(i);
+            plan->source[k] = c.source->planIndex;
+            plan->weight[k] = c.weight;
+#if NEURON_ENABLE_LEARNING
+            plan->grad[k] = c.e;
+            plan->state1[k] = c.learning_rate;
+            plan->state2[k] = c.former_e;
+#else
+            plan->grad[k] = 0;
+            plan->state1[k] = NEURON_DEFAULT_LEARNING_RATE;
+            plan->state2[k] = 0;
+#endif
+        }
+    }
+    plan->rowStart[nNodes] = k;
+    for (int i = 0; i < plan->nOutputs; ++i)
+        plan->outputIndex[i] = outputNeurons.at(i)->planIndex;
+    for (int n = 0; n < nNodes; ++n)
+        order.at(n)->planIndex = BRAINPLAN_UNVISITED;
+    plan->sortLevels();
+    plan->finish();
+    return plan;
+}
+
+/*!
+    Builds the plan of a network given in compressed sparse row form, without any Neuron.
+
+    The network has \a nNeurons neurons, the first \a nInputs of which are its inputs.
+    The connections towards the neuron \c n are those of indices \a rowStart [\c n] to
+    \a rowStart [\c n + 1] - 1, from the neurons \a sources [\c k] with the weights \a weights [\c k],
+    and are summed in that order. The rows of the input neurons are ignored.
+    \a outputs gives the indices of the \a nOutputs output neurons.
+
+    \a activ and \a deriv give the activation function of each neuron and its derivative,
+    as for the constructor of Neuron; if they are \c NULL, all the neurons are linear.
+
+    Only the neurons the outputs depend on are part of the plan. Unlike a network of Neuron objects,
+    a plan built this way only takes a few arrays, with a size proportional to the number of connections:
+    this is the representation to use for large sparse networks. The weights are read and written
+    back with getWeights() and setWeights(), in the order of \a weights.
+
+    Returns the plan, or \c NULL if the arrays are not valid or the network contains a loop.
+
+    \note Complexity is O(\a nNeurons + number of connections), without recursion.
+*/
+BrainPlan *BrainPlan::compile(int nInputs, int nNeurons, const int *rowStart, const int *sources, const double *weights,
+                              int nOutputs, const int *outputs, const NEURON_FUN *activ, const NEURON_FUN *deriv)
+{
+    if ((nInputs < 0) || (nNeurons < nInputs) || (nOutputs < 0) || (rowStart[0] != 0))
+    {
+        ERROR("In BrainPlan::compile, invalid sizes.");
+        return NULL;
+    }
+    for (int n = 0; n < nNeurons; ++n)
+    {
+        if (rowStart[n + 1] < rowStart[n])
+        {
+            ERROR("In BrainPlan::compile, the rows are not sorted.");
+            return NULL;
+        }
+    }
+    for (int k = rowStart[nInputs]; k < rowStart[nNeurons]; ++k)
+    {
+        if ((sources[k] < 0) || (sources[k] >= nNeurons))
+        {
+            ERROR("In BrainPlan::compile, invalid source neuron.");
+            return NULL;
+        }
+    }
+    for (int i = 0; i < nOutputs; ++i)
+    {
+        if ((outputs[i] < 0) || (outputs[i] >= nNeurons))
+        {
+            ERROR("In BrainPlan::compile, invalid output neuron.");
+            return NULL;
+        }
+    }
+    /* Same search as for the neurons, on the rows: index holds the position of each neuron
+     * in order, and next the connection to follow */
+    int *index = new int[nNeurons], *order = new int[nNeurons];
+    int *stack = new int[nNeurons], *next = new int[nNeurons];
+    int nNodes = nInputs, nEdges = 0, depth, n, src;
+    bool success = true;
+    for (n = 0; n < nNeurons; ++n)
+        index[n] = (n < nInputs) ? n : BRAINPLAN_UNVISITED;
+    for (n = 0; n < nInputs; ++n)
+        order[n] = n;
+    for (int i = 0; success && (i < nOutputs); ++i)
+    {
+        if (index[outputs[i]] != BRAINPLAN_UNVISITED)
+            continue;
+        index[outputs[i]] = BRAINPLAN_VISITING;
+        stack[0] = outputs[i];
+        next[0] = rowStart[outputs[i]];
+        depth = 1;
+        while (depth > 0)
+        {
+            n = stack[depth - 1];
+            if (next[depth - 1] == rowStart[n + 1])
+            {
+                index[n] = nNodes;
+                order[nNodes++] = n;
+                nEdges += rowStart[n + 1] - rowStart[n];
+                --depth;
+                continue;
+            }
+            src = sources[next[depth - 1]++];
+            if (index[src] == BRAINPLAN_VISITING)
+            {
+                ERROR("In BrainPlan::compile, the network contains a loop.");
+                success = false;
+                break;
+            }
+            if (index[src] == BRAINPLAN_UNVISITED)
+            {
+                index[src] = BRAINPLAN_VISITING;
+                stack[depth] = src;
+                next[depth++] = rowStart[src];
+            }
+        }
+    }
+    delete[] next;
+    delete[] stack;
+    if (!success)
+    {
+        delete[] order;
+        delete[] index;
+        return NULL;
+    }
+    BrainPlan *plan = new BrainPlan(nInputs, nOutputs, nNodes, nEdges);
+    plan->edgeOrigin = new int[nEdges];
+    int k = 0;
+    for (n = 0; n < nNodes; ++n)
+    {
+        src = order[n];
+        plan->activ[n] = (activ && deriv && activ[src] && deriv[src]) ? activ[src] : NULL;
+        plan->deriv[n] = plan->activ[n] ? deriv[src] : NULL;
+        plan->value[n] = 0;
+        plan->rowStart[n] = k;
+        if (n < nInputs)
+            continue;
+        for (int e = rowStart[src]; e < rowStart[src + 1]; ++e, ++k)
+        {
+            plan->source[k] = index[sources[e]];
+            plan->weight[k] = weights[e];
+            plan->grad[k] = 0;
+            plan->state1[k] = NEURON_DEFAULT_LEARNING_RATE;
+            plan->state2[k] = 0;
+            plan->edgeOrigin[k] = e;
+        }
+    }
+    plan->rowStart[nNodes] = k;
+    for (int i = 0; i < nOutputs; ++i)
+        plan->outputIndex[i] = index[outputs[i]];
+    delete[] order;
+    delete[] index;
+    plan->sortLevels();
+    plan->finish();
+    return plan;
+}
+
+/* Sorts the neurons, given in topological order, by level (by a stable counting sort),
+ * the level of a neuron being one more than the highest level of its sources */
+void BrainPlan::sortLevels()
+{
+    int *level = new int[nNodes], *index = new int[nNodes];
+    int n, k, e, l;
+    nLevels = nInputs ? 1 : 0;
+    for (n = 0; n < nNodes; ++n)
+    {
+        level[n] = 0;
+        if (n < nInputs)
+            continue;
+        for (e = rowStart[n]; e < rowStart[n + 1]; ++e)
+            if (level[source[e]] > level[n])
+                level[n] = level[source[e]];
+        if (++level[n] >= nLevels)
+            nLevels = level[n] + 1;
+    }
+    for (l = 0; l <= nLevels; ++l)
+        levelStart[l] = 0;
+    for (n = 0; n < nNodes; ++n)
+        ++levelStart[level[n] + 1];
+    for (l = 0; l < nLevels; ++l)
+        levelStart[l + 1] += levelStart[l];
+    int *fill = new int[nLevels + 1];
+    for (l = 0; l < nLevels; ++l)
+        fill[l] = levelStart[l];
+    for (n = 0; n < nNodes; ++n)
+        index[n] = fill[level[n]]++;
+    delete[] fill;
+    delete[] level;
+    /* Moves the neurons and their rows to their new index */
+    NEURON_FUN *oldActiv = new NEURON_FUN[nNodes], *oldDeriv = new NEURON_FUN[nNodes];
+    double *oldValue = new double[nNodes];
+    int *oldRowStart = new int[nNodes + 1];
+    for (n = 0; n < nNodes; ++n)
+    {
+        oldActiv[n] = activ[n];
+        oldDeriv[n] = deriv[n];
+        oldValue[n] = value[n];
+        oldRowStart[n] = rowStart[n];
+    }
+    oldRowStart[nNodes] = rowStart[nNodes];
+    for (n = 0; n < nNodes; ++n)
+    {
+        activ[index[n]] = oldActiv[n];
+        deriv[index[n]] = oldDeriv[n];
+        value[index[n]] = oldValue[n];
+        rowStart[index[n] + 1] = oldRowStart[n + 1] - oldRowStart[n];
+    }
+    rowStart[0] = 0;
+    for (n = 0; n < nNodes; ++n)
+        rowStart[n + 1] += rowStart[n];
+    delete[] oldValue;
+    delete[] oldDeriv;
+    delete[] oldActiv;
+    int *oldSource = new int[nEdges];
+    double *oldWeight = new double[nEdges], *oldGrad = new double[nEdges];
+    double *oldState1 = new double[nEdges], *oldState2 = new double[nEdges];
+    for (e = 0; e < nEdges; ++e)
+    {
+        oldSource[e] = source[e];
+        oldWeight[e] = weight[e];
+        oldGrad[e] = grad[e];
+        oldState1[e] = state1[e];
+        oldState2[e] = state2[e];
+    }
+    int *oldOrigin = NULL;
+    if (edgeOrigin)
+    {
+        oldOrigin = new int[nEdges];
+        for (e = 0; e < nEdges; ++e)
+            oldOrigin[e] = edgeOrigin[e];
+    }
+    for (n = 0; n < nNodes; ++n)
+    {
+        k = rowStart[index[n]];
+        for (e = oldRowStart[n]; e < oldRowStart[n + 1]; ++e, ++k)
+        {
+            source[k] = index[oldSource[e]];
+            weight[k] = oldWeight[e];
+            grad[k] = oldGrad[e];
+            state1[k] = oldState1[e];
+            state2[k] = oldState2[e];
+            if (oldOrigin)
+                edgeOrigin[k] = oldOrigin[e];
+        }
+    }
+    if (oldOrigin)
+        delete[] oldOrigin;
+    delete[] oldState2;
+    delete[] oldState1;
+    delete[] oldGrad;
+    delete[] oldWeight;
+    delete[] oldSource;
+    delete[] oldRowStart;
+    if (neurons)
+    {
+        Neuron **oldNeurons = new Neuron*[nNodes];
+        for (n = 0; n < nNodes; ++n)
+            oldNeurons[n] = neurons[n];
+        for (n = 0; n < nNodes; ++n)
+            neurons[index[n]] = oldNeurons[n];
+        delete[] oldNeurons;
+    }
+    for (int i = 0; i < nOutputs; ++i)
+        outputIndex[i] = index[outputIndex[i]];
+    delete[] index;
+}
+
+/* Builds the edges grouped by source and the groups of the kernels, once the neurons are sorted */
+void BrainPlan::finish()
+{
+    for (int n = 0; n < nNodes; ++n)
+    {
+        delta[n] = 0;
+        isOutput[n] = false;
+    }
+    for (int i = 0; i < nOutputs; ++i)
+        isOutput[outputIndex[i]] = true;
+    for (int n = 0; n <= nNodes; ++n)
+        outStart[n] = 0;
+    for (int e = 0; e < nEdges; ++e)
+        ++outStart[source[e] + 1];
+    for (int n = 0; n < nNodes; ++n)
+        outStart[n + 1] += outStart[n];
+    orderContributions();
+    findGroups(rowStart, source, NULL, rowGroup);
+    findGroups(outStart, outTarget, outEdge, outGroup);
+}
+
+/* Fills outEdge and outTarget so that the edges leaving each neuron are in the order in which Neuron::train and
+ * Neuron::learnMistakes add their contributions to the sum of the neuron, which makes train() give
+ * the same gradients as the recursive path. The recursion is simulated with an explicit stack:
+ * the outputs are trained from the last one, each neuron going through its connections in order,
+ * and a neuron goes through its own connections as soon as all its consumers have reached it,
+ * or when it is trained if it is an output; it is only gone through once. */
+void BrainPlan::orderContributions()
+{
+    int *fill = new int[nNodes], *left = new int[nNodes];
+    int *stackNode = new int[nNodes], *stackEdge = new int[nNodes];
+    bool *pushed = new bool[nNodes];
+    int depth = 0, n, src;
+    for (n = 0; n < nNodes; ++n)
+    {
+        fill[n] = outStart[n];
+        left[n] = outStart[n + 1] - outStart[n];
+        pushed[n] = false;
+    }
+    for (int i = nOutputs - 1; i >= 0; --i)
+    {
+        n = outputIndex[i];
+        if (pushed[n])
+            continue;
+        pushed[n] = true;
+        stackNode[0] = n;
+        stackEdge[0] = rowStart[n];
+        depth = 1;
+        while (depth > 0)
+        {
+            n = stackNode[depth - 1];
+            int &e = stackEdge[depth - 1];
+            if (e == rowStart[n + 1])
+            {
+                --depth;
+                continue;
+            }
+            src = source[e];
+            outTarget[fill[src]] = n;
+            outEdge[fill[src]++] = e++;
+            /* The inputs have no connection */
+            if ((--left[src] == 0) && (src >= nInputs) && !pushed[src])
+            {
+                pushed[src] = true;
+                stackNode[depth] = src;
+                stackEdge[depth] = rowStart[src];
+                ++depth;
+            }
+        }
+    }
+    delete[] pushed;
+    delete[] stackEdge;
+    delete[] stackNode;
+    delete[] left;
+    delete[] fill;
+}
+
+/* Marks in group the first neuron of each run of KERNEL_ROWS neurons of a level whose edges
+ * (given by start and index) lead to the same neurons, in the same order; if edge is not NULL,
+ * the edges of the neurons must also be next to each other in each row (edge[j] + r for the neuron r) */
+void BrainPlan::findGroups(const int *start, const int *index, const int *edge, bool *group) const
+{
+    for (int n = 0; n < nNodes; ++n)
+        group[n] = false;
+    for (int l = 1; l < nLevels; ++l)
+    {
+        int n = levelStart[l], len, r;
+        while (n + KERNEL_ROWS <= levelStart[l + 1])
+        {
+            len = start[n + 1] - start[n];
+            for (r = 1; r < KERNEL_ROWS; ++r)
+            {
+                if (start[n + r + 1] - start[n + r] != len)
+                    break;
+                int k = 0;
+                while ((k < len) && (index[start[n + r] + k] == index[start[n] + k])
+                       && (!edge || (edge[start[n + r] + k] == edge[start[n] + k] + r)))
+                    ++k;
+                if (k < len)
+                    break;
+            }
+            if (r < KERNEL_ROWS)
+            {
+                ++n;
+                continue;
+            }
+            group[n] = true;
+            n += KERNEL_ROWS;
+        }
+    }
+}
+
+/*!
+    Writes the weights and the training state of the connections back to the neurons.
+    Does nothing if the plan was given in compressed sparse row form.
+
+    \warning The connections of the neurons must not have changed since compile().
+
+    \sa getWeights()
+*/
+void BrainPlan::decompile()
+{
+    if (!neurons)
+        return;
+#if NEURON_ENABLE_LEARNING
+    flushGradient();
+#endif
+    for (int n = nInputs; n < nNodes; ++n)
+    {
+        QList<Neuron::Connection> &connections = neurons[n]->backwardConnections;
+        if (connections.length() != rowStart[n + 1] - rowStart[n])
+        {
+            ERROR("In BrainPlan::decompile, the connections of a neuron have changed.");
+            continue;
+        }
+        int k = rowStart[n];
+        for (int i = connections.length() - 1; i >= 0; --i, ++k)
+        {
+            Neuron::Connection &c = connections[i];
+            c.weight = weight[k];
+#if NEURON_ENABLE_LEARNING
+            c.e = grad[k];
+            c.learning_rate = state1[k];
+            c.former_e = state2[k];
+#endif
+        }
+    }
+}
+
+/*!
+    Writes the weights of the connections to \a weights, in the order in which they were given to
+    compile() in compressed sparse row form; the connections that are not part of the plan are left unchanged.
+
+    Returns \c false if the plan was compiled from neurons.
+
+    \sa setWeights()
+*/
+bool BrainPlan::getWeights(double *weights) const
+{
+    if (!edgeOrigin)
+    {
+        ERROR("In BrainPlan::getWeights, the plan was compiled from neurons.");
+        return false;
+    }
+    for (int e = 0; e < nEdges; ++e)
+        weights[edgeOrigin[e]] = weight[e];
+    return true;
+}
+
+/*!
+    Replaces the weights of the connections by those of \a weights, given in the order in which they were
+    given to compile() in compressed sparse row form.
+
+    Returns \c false if the plan was compiled from neurons.
+
+    \sa getWeights()
+*/
+bool BrainPlan::setWeights(const double *weights)
+{
+    if (!edgeOrigin)
+    {
+        ERROR("In BrainPlan::setWeights, the plan was compiled from neurons.");
+        return false;
+    }
+    for (int e = 0; e < nEdges; ++e)
+        weight[e] = weights[edgeOrigin[e]];
+    return true;
+}
+
+/*!
+    Returns an inference-only copy of the plan, which holds its current weights
+    but none of the training state.
+
+    \sa BrainInterface::freeze()
+*/
+FrozenBrain *BrainPlan::freeze() const
+{
+    FrozenBrain *brain = new FrozenBrain(nInputs, nOutputs, nNodes, nEdges, nLevels);
+    for (int l = 0; l <= nLevels; ++l)
+        brain->levelStart[l] = levelStart[l];
+    for (int n = 0; n < nNodes; ++n)
+    {
+        brain->activ[n] = activ[n];
+        brain->rowStart[n] = rowStart[n];
+        brain->rowGroup[n] = rowGroup[n];
+    }
+    brain->rowStart[nNodes] = rowStart[nNodes];
+    for (int i = 0; i < nOutputs; ++i)
+        brain->outputIndex[i] = outputIndex[i];
+    for (int e = 0; e < nEdges; ++e)
+    {
+        brain->source[e] = source[e];
+        brain->weight[e] = weight[e];
+    }
+    return brain;
+}
+
+/*!
+    \fn int BrainPlan::countInputs() const
+
+    Returns the number of inputs of the network.
+*/
+
+/*!
+    \fn int BrainPlan::countOutputs() const
+
+    Returns the number of outputs of the network.
+*/
+
+/*!
+    \fn int BrainPlan::countNodes() const
+
+    Returns the number of neurons in the plan.
+*/
+
+/*!
+    \fn int BrainPlan::countEdges() const
+
+    Returns the number of connections in the plan.
+*/
+
+/*!
+    \fn int BrainPlan::countLevels() const
+
+    Returns the number of levels of the plan, the inputs being at level 0.
+*/
+
+/*!
+    Splits the levels that have at least \c BRAINPLAN_PARALLEL_THRESHOLD connections in \a n_threads
+    parts, which run() and train() compute on the global ThreadPool.
+    If \a n_threads is 1, the plan is computed by the calling thread only.
+
+    The results do not depend on the number of threads: each neuron is computed by a single thread,
+    in the same order.
+
+    \note This function only works on UNIX (else, it does nothing).
+*/
+void BrainPlan::setThreads(int n_threads)
+{
+#ifdef __unix__
+    t_count = (n_threads > 1) ? n_threads : 1;
+#else
+    (void) n_threads;
+#endif
+}
+
+/*!
+    Runs the network on the \a n samples of \a inputs, given one after the other (\l countInputs()
+    values each), and writes the \l countOutputs() values of the outputs of each sample to \a outputs.
+
+    The results are the same as those of \a n calls with one sample. The samples that train() keeps
+    are first added to the gradient, so that the samples are run by batches of \c BRAINPLAN_PENDING_SAMPLES.
+*/
+void BrainPlan::run(int n, const double *inputs, double *outputs)
+{
+    int count, s, i;
+#if NEURON_ENABLE_LEARNING
+    flushGradient();
+#endif
+    while (n > 0)
+    {
+        count = freeSlots(n);
+        forward(count, inputs);
+        for (s = 0; s < count; ++s)
+            for (i = 0; i < nOutputs; ++i)
+                outputs[s * nOutputs + i] = value[s * nNodes + outputIndex[i]];
+        inputs += count * nInputs;
+        outputs += count * nOutputs;
+        n -= count;
+    }
+}
+
+/* Number of samples, out of n, that fit in the slots after the pending ones */
+int BrainPlan::freeSlots(int n) const
+{
+    return (n < pendingCapacity - pending) ? n : pendingCapacity - pending;
+}
+
+/* Computes the values of count samples, in the slots from value */
+void BrainPlan::forward(int count, const double *inputs)
+{
+    for (int s = 0; s < count; ++s)
+        for (int n = 0; n < nInputs; ++n)
+            value[s * nNodes + n] = inputs[s * nInputs + n];
+    for (int l = 1; l < nLevels; ++l)
+    {
+#ifdef __unix__
+        if (parallelLevel(l, count))
+        {
+            runParts(levelStart[l], levelStart[l + 1], count, forwardTask);
+            continue;
+        }
+#endif
+        forwardRange(levelStart[l], levelStart[l + 1], count);
+    }
+}
+
+void BrainPlan::forwardRange(int start, int end, int count)
+{
+    double *v, sums[KERNEL_ROWS], acc[BRAINPLAN_PENDING_SAMPLES];
+    int n = start, s, r;
+    while (n < end)
+    {
+        if (rowGroup[n] && (n + KERNEL_ROWS <= end))
+        {
+            for (s = 0, v = value; s < count; ++s, v += nNodes)
+            {
+                for (r = 0; r < KERNEL_ROWS; ++r)
+                    sums[r] = 0;
+                kernel_dot_rows(rowStart[n + 1] - rowStart[n], weight, &rowStart[n], v, &source[rowStart[n]], sums);
+                for (r = 0; r < KERNEL_ROWS; ++r)
+                    v[n + r] = activ[n + r] ? activ[n + r](sums[r]) : sums[r];
+            }
+            n += KERNEL_ROWS;
+            continue;
+        }
+        for (s = 0; s < count; ++s)
+            acc[s] = 0;
+        kernel_dot_samples(rowStart[n + 1] - rowStart[n], &weight[rowStart[n]], NULL, value, nNodes,
+                           &source[rowStart[n]], count, acc);
+        for (s = 0, v = value; s < count; ++s, v += nNodes)
+            v[n] = activ[n] ? activ[n](acc[s]) : acc[s];
+        ++n;
+    }
+}
+
+#if NEURON_ENABLE_LEARNING
+
+/*!
+    Runs the network on the \a n samples of \a inputs, and adds the gradient of the squared error
+    between its outputs and the expected \a outputs to the gradient of the connections.
+    The samples are given one after the other, as for run().
+
+    Returns \a error plus the squared errors.
+
+    The gradients are exactly those of the recursive path of BrainInterface, as the sums are
+    computed in the same order, but without recursion: the deltas of the neurons are stored
+    in a dense array and computed level by level, from the outputs.
+
+    The values and deltas of the last \c BRAINPLAN_PENDING_SAMPLES samples are kept, and added
+    to the gradient at once, so that the gradient of each connection is loaded once for all of them;
+    each connection still receives the samples one after the other.
+
+    \note The delta of an output neuron that also feeds other neurons is the sum of that of its own error
+    and of those of its consumers. The recursive path adds these two parts to the gradient of its connections
+    one after the other, so the gradients then only match up to rounding; it also goes twice through the
+    sources of that output, which only gives the right gradient if they feed no other neuron.
+
+    \sa learn()
+*/
+double BrainPlan::train(int n, const double *inputs, const double *outputs, double error)
+{
+    double diff, *v, *d;
+    int count, s, i, k;
+    while (n > 0)
+    {
+        count = freeSlots(n);
+        forward(count, inputs);
+        for (s = 0, v = value, d = delta; s < count; ++s, v += nNodes, d += nNodes)
+        {
+            for (i = nOutputs - 1; i >= 0; --i)
+            {
+                k = outputIndex[i];
+                diff = v[k] - outputs[s * nOutputs + i];
+                error += diff * diff;
+                d[k] = diff * (deriv[k] ? deriv[k](v[k]) : 1.);
+            }
+        }
+        backward(count);
+        inputs += count * nInputs;
+        outputs += count * nOutputs;
+        n -= count;
+        pending += count;
+        if (pending == pendingCapacity)
+        {
+            flushGradient();
+        } else {
+            value += count * nNodes;
+            delta += count * nNodes;
+        }
+    }
+    return error;
+}
+
+/* Computes the deltas of count samples, in the slots from delta,
+ * in reverse level order: the consumers of a neuron are at higher levels */
+void BrainPlan::backward(int count)
+{
+    for (int l = nLevels - 1; l >= 1; --l)
+    {
+#ifdef __unix__
+        if (parallelLevel(l, count))
+        {
+            runParts(levelStart[l], levelStart[l + 1], count, backwardTask);
+            continue;
+        }
+#endif
+        backwardRange(levelStart[l], levelStart[l + 1], count);
+    }
+}
+
+void BrainPlan::backwardRange(int start, int end, int count)
+{
+    double *v, *d, sums[KERNEL_ROWS], acc[BRAINPLAN_PENDING_SAMPLES];
+    int n = start, s, r;
+    while (n < end)
+    {
+        if (outGroup[n] && (n + KERNEL_ROWS <= end))
+        {
+            for (s = 0, v = value, d = delta; s < count; ++s, v += nNodes, d += nNodes)
+            {
+                for (r = 0; r < KERNEL_ROWS; ++r)
+                    sums[r] = 0;
+                kernel_dot_cols(outStart[n + 1] - outStart[n], weight, &outEdge[outStart[n]], d, &outTarget[outStart[n]], sums);
+                for (r = 0; r < KERNEL_ROWS; ++r)
+                {
+                    /* The delta of the error of an output was set by train() */
+                    if (!isOutput[n + r])
+                        d[n + r] = sums[r] * (deriv[n + r] ? deriv[n + r](v[n + r]) : 1.);
+                    else if (outStart[n + r + 1] > outStart[n + r])
+                        d[n + r] += sums[r] * (deriv[n + r] ? deriv[n + r](v[n + r]) : 1.);
+                }
+            }
+            n += KERNEL_ROWS;
+            continue;
+        }
+        if (!isOutput[n])
+        {
+            for (s = 0; s < count; ++s)
+                acc[s] = 0;
+            kernel_dot_samples(outStart[n + 1] - outStart[n], weight, &outEdge[outStart[n]], delta, nNodes,
+                               &outTarget[outStart[n]], count, acc);
+            for (s = 0, v = value, d = delta; s < count; ++s, v += nNodes, d += nNodes)
+                d[n] = acc[s] * (deriv[n] ? deriv[n](v[n]) : 1.);
+        } else if (outStart[n + 1] > outStart[n])
+        {
+            for (s = 0; s < count; ++s)
+                acc[s] = 0;
+            kernel_dot_samples(outStart[n + 1] - outStart[n], weight, &outEdge[outStart[n]], delta, nNodes,
+                               &outTarget[outStart[n]], count, acc);
+            for (s = 0, v = value, d = delta; s < count; ++s, v += nNodes, d += nNodes)
+                d[n] += acc[s] * (deriv[n] ? deriv[n](v[n]) : 1.);
+        }
+        ++n;
+    }
+}
+
+/* Adds the samples kept by train() to the gradient */
+void BrainPlan::flushGradient()
+{
+    if (!pending)
+        return;
+#ifdef __unix__
+    if ((t_count > 1) && ((long long) nEdges * pending >= BRAINPLAN_PARALLEL_THRESHOLD))
+        runParts(nInputs, nNodes, pending, gradientTask);
+    else
+#endif
+        gradientRange(nInputs, nNodes);
+    pending = 0;
+    value = values;
+    delta = deltas;
+}
+
+void BrainPlan::gradientRange(int start, int end)
+{
+    double g;
+    int n = start;
+    while (n < end)
+    {
+        if (rowGroup[n] && (n + KERNEL_ROWS <= end))
+        {
+            kernel_ger_rows(rowStart[n + 1] - rowStart[n], grad, &rowStart[n], pending, nNodes,
+                            values, &source[rowStart[n]], &deltas[n]);
+            n += KERNEL_ROWS;
+            continue;
+        }
+        for (int e = rowStart[n]; e < rowStart[n + 1]; ++e)
+        {
+            g = grad[e];
+            for (int s = 0; s < pending; ++s)
+                g += values[s * nNodes + source[e]] * deltas[s * nNodes + n];
+            grad[e] = g;
+        }
+        ++n;
+    }
+}
+
+/*!
+    Updates the weights from the gradient accumulated by train(), with \a optimizer,
+    or the built-in Super-SAB rule of Neuron if it is \c NULL.
+
+    If \a reset is \c true, the states of the connections are first initialized for the optimizer.
+*/
+void BrainPlan::learn(const Optimizer *optimizer, bool reset)
+{
+    flushGradient();
+    if (reset)
+    {
+        double init1 = optimizer ? optimizer->initialState(0) : NEURON_DEFAULT_LEARNING_RATE;
+        double init2 = optimizer ? optimizer->initialState(1) : 0.;
+        for (int e = 0; e < nEdges; ++e)
+        {
+            state1[e] = init1;
+            state2[e] = init2;
+        }
+    }
+    if (optimizer)
+        optimizer->update(nEdges, weight, grad, state1, state2);
+    else
+        kernel_supersab(nEdges, NEURON_INCREASE_LEARNING, NEURON_DECREASE_LEARNING, weight, grad, state1, state2);
+}
+
+#endif
+
+#ifdef __unix__
+
+/* Whether the given level is large enough to be split among the threads for count samples */
+bool BrainPlan::parallelLevel(int level, int count) const
+{
+    int start = levelStart[level], end = levelStart[level + 1];
+    return (t_count > 1) && (end - start > 1)
+            && ((long long) (rowStart[end] - rowStart[start] + outStart[end] - outStart[start]) * count
+                >= BRAINPLAN_PARALLEL_THRESHOLD);
+}
+
+/* Computes the neurons of [start, end) for count samples, with one task per part */
+void BrainPlan::runParts(int start, int end, int count, void (*task)(void*, int))
+{
+    t_start = start;
+    t_end = end;
+    t_samples = count;
+    ThreadPool::globalInstance()->run(t_count, task, (void*) this);
+}
+
+/* Range of neurons of the part id */
+void BrainPlan::partRange(int id, int &start, int &end) const
+{
+    long long size = t_end - t_start;
+    start = t_start + (int) (size * id / t_count);
+    end = t_start + (int) (size * (id + 1) / t_count);
+}
+
+void BrainPlan::forwardTask(void *obj, int id)
+{
+    BrainPlan *my_this = (BrainPlan*) obj;
+    int start, end;
+    my_this->partRange(id, start, end);
+    my_this->forwardRange(start, end, my_this->t_samples);
+}
+
+#if NEURON_ENABLE_LEARNING
+void BrainPlan::backwardTask(void *obj, int id)
+{
+    BrainPlan *my_this = (BrainPlan*) obj;
+    int start, end;
+    my_this->partRange(id, start, end);
+    my_this->backwardRange(start, end, my_this->t_samples);
+}
+
+void BrainPlan::gradientTask(void *obj, int id)
+{
+    BrainPlan *my_this = (BrainPlan*) obj;
+    int start, end;
+    my_this->partRange(id, start, end);
+    my_this->gradientRange(start, end);
+}
+#endif
+
+#endif
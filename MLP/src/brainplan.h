@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2015, Rémi Bazin <bazin.remi@gmail.com>
+ * All rights reserved.
+ * See LICENSE for licensing details.
+ */
+
+#ifndef BRAINPLAN_H
+#define BRAINPLAN_H
+
+#include "neuron.h"
+
+/* Minimal number of connections in a level for it to be split among several threads */
+#define BRAINPLAN_PARALLEL_THRESHOLD 4096
+/* Number of samples computed together by run() and train(), whose values and deltas are kept by train()
+ * before being added to the gradient */
+#define BRAINPLAN_PENDING_SAMPLES 32
+
+class Optimizer;
+class FrozenBrain;
+
+class BrainPlan
+{
+public:
+    static BrainPlan *compile(const QList<Neuron*> &inputNeurons, const QList<Neuron*> &outputNeurons);
+    static BrainPlan *compile(int nInputs, int nNeurons, const int *rowStart, const int *sources, const double *weights,
+                              int nOutputs, const int *outputs, const NEURON_FUN *activ = NULL, const NEURON_FUN *deriv = NULL);
+    ~BrainPlan();
+    void decompile();
+    bool getWeights(double *weights) const;
+    bool setWeights(const double *weights);
+    FrozenBrain *freeze() const;
+    inline int countInputs() const { return nInputs; }
+    inline int countOutputs() const { return nOutputs; }
+    inline int countNodes() const { return nNodes; }
+    inline int countEdges() const { return nEdges; }
+    inline int countLevels() const { return nLevels; }
+    void setThreads(int n_threads);
+    void run(int n, const double *inputs, double *outputs);
+#if NEURON_ENABLE_LEARNING
+    double train(int n, const double *inputs, const double *outputs, double error = 0);
+    void learn(const Optimizer *optimizer, bool reset);
+#endif
+private:
+    BrainPlan(int nInputs, int nOutputs, int nNodes, int nEdges);
+    BrainPlan(const BrainPlan &other);
+    BrainPlan &operator=(const BrainPlan &other);
+    void sortLevels();
+    void finish();
+    void orderContributions();
+    void findGroups(const int *start, const int *index, const int *edge, bool *group) const;
+    int freeSlots(int n) const;
+    void forward(int count, const double *inputs);
+    void forwardRange(int start, int end, int count);
+#if NEURON_ENABLE_LEARNING
+    void backward(int count);
+    void backwardRange(int start, int end, int count);
+    void flushGradient();
+    void gradientRange(int start, int end);
+#endif
+#ifdef __unix__
+    bool parallelLevel(int level, int count) const;
+    void runParts(int start, int end, int count, void (*task)(void*, int));
+    void partRange(int id, int &start, int &end) const;
+    static void forwardTask(void *obj, int id);
+#if NEURON_ENABLE_LEARNING
+    static void backwardTask(void *obj, int id);
+    static void gradientTask(void *obj, int id);
+#endif
+#endif
+private:
+    int nInputs, nOutputs, nNodes, nEdges, nLevels;
+    /* Nodes sorted by level, the level of a neuron being one more than the highest level of its
+     * sources; the input neurons come first, at level 0, and level l is [levelStart[l], levelStart[l + 1]) */
+    int *levelStart;
+    /* Neurons the plan was compiled from, or NULL if it was given in compressed sparse row form,
+     * in which case edgeOrigin gives the index of each edge in that form */
+    Neuron **neurons;
+    int *edgeOrigin;
+    NEURON_FUN *activ, *deriv;
+    /* Values and deltas of the pending samples, one row of nNodes per sample, and those of the first sample
+     * being computed */
+    double *values, *deltas;
+    double *value, *delta;
+    int pending, pendingCapacity;
+    bool *isOutput;
+    int *outputIndex;
+    /* Edges grouped by destination: those of node n are in [rowStart[n], rowStart[n + 1]),
+     * in the order in which Neuron::getValue sums them */
+    int *rowStart, *source;
+    double *weight;
+    /* Gradient and optimizer states of each edge */
+    double *grad, *state1, *state2;
+    /* Edges grouped by source: those leaving node n are outEdge[outStart[n]..outStart[n + 1]),
+     * in the order in which Neuron::learnMistakes adds their contributions, and their targets */
+    int *outStart, *outEdge, *outTarget;
+    /* Whether the KERNEL_ROWS neurons from n have the same sources (rowGroup) or the same targets,
+     * with consecutive edges in their rows (outGroup), in which case their sums are computed
+     * together by the kernels */
+    bool *rowGroup, *outGroup;
+#ifdef __unix__
+    /* Number of parts the large levels are split into, and neurons and number of samples being computed */
+    int t_count, t_start, t_end, t_samples;
+#endif
+};
+
+#endif // BRAINPLAN_H
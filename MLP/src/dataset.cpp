@@ -0,0 +1,721 @@
+/*
+ * Copyright (c) 2015, Rémi Bazin <bazin.remi@gmail.com>
+ * All rights reserved.
+ * See LICENSE for licensing details.
+ */
+
+/*!
+    \class BasicDataset
+    \inmodule NetNeurons
+    \ingroup NetNeurons
+
+    \brief BasicDataset streams training samples from a file that does not need to fit in memory.
+
+    The samples are read by chunks of a fixed number of rows. While a chunk is used for
+    the training, a background thread decodes the next ones into a bounded queue, so that
+    reading and parsing the file overlap with the computations.
+
+    Two file formats are supported:
+
+    \list
+    \li a binary format, written by save() and convert(), made of a header followed by the samples,
+    each one being stored as its inputs then its outputs, in \c float or \c double.
+    On UNIX, such a file can also be mapped in memory with \c DATASET_FORMAT_MAPPED:
+    the samples are then used in place, without being read nor copied, and the next epochs
+    are served from the page cache;
+    \li CSV files, with one sample per line holding its inputs then its outputs, separated by
+    commas, semicolons or blanks. Empty lines and lines starting with \c # are ignored,
+    as well as a first line that does not contain numbers (column names).
+    \endlist
+
+    \c T is the type of the values handed to the perceptron. Two versions are available:
+    Dataset, for Perceptron, and DatasetF, for PerceptronF.
+
+    \code
+    Dataset data(4, 2);
+    if (data.open("features.csv"))
+    {
+        for (int epoch = 0; epoch < 100; ++epoch)
+            perceptron->trainEpoch(data, 64);
+    }
+    \endcode
+
+    \sa BasicPerceptron::trainEpoch()
+*/
+
+/*!
+    \typedef Dataset
+    \relates BasicDataset
+
+    Dataset of double-precision samples, to be used with Perceptron.
+*/
+
+/*!
+    \typedef DatasetF
+    \relates BasicDataset
+
+    Dataset of single-precision samples, to be used with PerceptronF.
+*/
+
+#include "dataset.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef __unix__
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+#endif
+
+/* C++ Double expansion trick */
+#define DATASET_S(x) #x
+#define DATASET_S_(x) DATASET_S(x)
+
+#define ERROR(str) fprintf(stderr, __FILE__ " (" DATASET_S_(__LINE__) "): " str)
+
+/* Header of the binary files, followed by the samples */
+#define DATASET_FILE_MAGIC "NNDATSET"
+#define DATASET_BYTE_ORDER 0x01020304
+#define DATASET_LINE_SIZE 1024
+
+struct DatasetFileHeader
+{
+    char magic[8];
+    int version, byteOrder, scalarSize, nInputs, nOutputs, reserved;
+    long long size;
+    char padding[64 - 8 - 6 * sizeof(int) - sizeof(long long)];
+};
+
+static void fillHeader(DatasetFileHeader &header, int scalarSize, int nInputs, int nOutputs, long long size)
+{
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DATASET_FILE_MAGIC, sizeof(header.magic));
+    header.version = DATASET_FILE_VERSION;
+    header.byteOrder = DATASET_BYTE_ORDER;
+    header.scalarSize = scalarSize;
+    header.nInputs = nInputs;
+    header.nOutputs = nOutputs;
+    header.size = size;
+}
+
+/*!
+    Constructs a dataset of samples having \a nInputs inputs and \a nOutputs outputs.
+
+    The file is read by chunks of \a chunkSize samples, and at most \a prefetch chunks
+    are decoded ahead of the one being used.
+
+    \note The memory used is O((\a prefetch + 1) * \a chunkSize * (\a nInputs + \a nOutputs)),
+    whatever the size of the file.
+*/
+template <typename T>
+BasicDataset<T>::BasicDataset(int nInputs, int nOutputs, int chunkSize, int prefetch)
+    : nInputs(nInputs), nOutputs(nOutputs), chunkSize(chunkSize), nSlots(prefetch + 1), slots(NULL), current(-1),
+      chunkRows(NULL), file(NULL), raw(NULL), mapping(NULL), line(NULL), lineCapacity(0)
+{
+#ifdef __unix__
+    t_running = false;
+#endif
+    if ((nInputs <= 0) || (nOutputs <= 0) || (chunkSize <= 0) || (prefetch < 0))
+    {
+        ERROR("In Dataset::Dataset, the sizes should be strictly greater than 0.");
+        return;
+    }
+#ifndef __unix__
+    /* Without a reader thread, the chunks are decoded on demand */
+    nSlots = 1;
+#endif
+    int width = nInputs + nOutputs;
+    slots = new Chunk[nSlots];
+    for (int s = 0; s < nSlots; ++s)
+    {
+        slots[s].data = new T[chunkSize * width];
+        slots[s].in = new T*[chunkSize];
+        slots[s].out = new T*[chunkSize];
+        slots[s].size = 0;
+        setRows(slots[s], slots[s].data);
+    }
+#ifdef __unix__
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&filled, NULL);
+    pthread_cond_init(&freed, NULL);
+#endif
+}
+
+/*!
+    Destructs the dataset, after having closed its file.
+*/
+template <typename T>
+BasicDataset<T>::~BasicDataset()
+{
+    if (!slots)
+        return;
+    close();
+#ifdef __unix__
+    pthread_cond_destroy(&freed);
+    pthread_cond_destroy(&filled);
+    pthread_mutex_destroy(&mutex);
+#endif
+    for (int s = 0; s < nSlots; ++s)
+    {
+        delete[] slots[s].data;
+        delete[] slots[s].in;
+        delete[] slots[s].out;
+    }
+    delete[] slots;
+}
+
+/*!
+    \fn template <typename T> bool BasicDataset<T>::hasError() const
+
+    Returns \c true if the constructor failed because one of its arguments was not positive,
+    \c false otherwise.
+*/
+
+/*!
+    Opens the file \a fileName, whose \a format is either \c DATASET_FORMAT_BINARY,
+    \c DATASET_FORMAT_CSV, \c DATASET_FORMAT_MAPPED or \c DATASET_FORMAT_AUTO. In the latter case,
+    the files starting with the header of the binary format are read as such, and the other ones as CSV.
+
+    \c DATASET_FORMAT_MAPPED maps a binary file whose values have the type \c T in memory (UNIX only).
+    Its samples are then read-only.
+
+    Returns \c true on success, \c false otherwise.
+
+    \sa close(), next()
+*/
+template <typename T>
+bool BasicDataset<T>::open(const char *fileName, int format)
+{
+    if (!slots)
+    {
+        ERROR("In Dataset::open, the dataset has errors.");
+        return false;
+    }
+    close();
+    file = fopen(fileName, "rb");
+    if (!file)
+    {
+        ERROR("In Dataset::open, unable to open the file.");
+        return false;
+    }
+    if (format == DATASET_FORMAT_AUTO)
+    {
+        char magic[8];
+        bool binary = (fread(magic, sizeof(magic), 1, file) == 1) && (!memcmp(magic, DATASET_FILE_MAGIC, sizeof(magic)));
+        format = binary ? DATASET_FORMAT_BINARY : DATASET_FORMAT_CSV;
+    }
+    this->format = format;
+    if ((!readHeader()) || ((format == DATASET_FORMAT_MAPPED) && (!mapFile())))
+    {
+        fclose(file);
+        file = NULL;
+        return false;
+    }
+    if ((format == DATASET_FORMAT_BINARY) && (fileScalarSize != (int) sizeof(T)))
+    {
+        if (raw)
+            delete[] raw;
+        raw = new char[(size_t) chunkSize * (nInputs + nOutputs) * fileScalarSize];
+    }
+    if ((format == DATASET_FORMAT_CSV) && (!line))
+    {
+        lineCapacity = DATASET_LINE_SIZE;
+        line = new char[lineCapacity];
+    }
+    return true;
+}
+
+/*!
+    Closes the file, and stops the reader thread.
+*/
+template <typename T>
+void BasicDataset<T>::close()
+{
+    stopReader();
+#ifdef __unix__
+    if (mapping)
+    {
+        munmap(mapping, mappingSize);
+        mapping = NULL;
+        setRows(slots[0], slots[0].data);
+    }
+#endif
+    if (file)
+    {
+        fclose(file);
+        file = NULL;
+    }
+    if (raw)
+    {
+        delete[] raw;
+        raw = NULL;
+    }
+    if (line)
+    {
+        delete[] line;
+        line = NULL;
+    }
+    current = -1;
+}
+
+/*!
+    Goes back to the first sample of the file, for a new epoch.
+
+    Returns \c true on success, \c false otherwise.
+*/
+template <typename T>
+bool BasicDataset<T>::rewind()
+{
+    if (!file)
+    {
+        ERROR("In Dataset::rewind, no file is open.");
+        return false;
+    }
+    stopReader();
+    current = -1;
+    if (!readHeader())
+        return false;
+    if (mapping)
+        cursor = reinterpret_cast<const T*>(mapping + sizeof(DatasetFileHeader));
+    return true;
+}
+
+/*!
+    Moves to the next chunk of samples, and returns its number of samples.
+
+    Returns 0 at the end of the file, and -1 if an error occurred.
+
+    The samples of the chunk are then available through rows(), inputs() and outputs(),
+    until the next call to this function.
+
+    \sa rewind()
+*/
+template <typename T>
+int BasicDataset<T>::next()
+{
+    if (!file)
+    {
+        ERROR("In Dataset::next, no file is open.");
+        return -1;
+    }
+    if (mapping)
+    {
+        /* The chunk points into the mapped file */
+        int n = (left < chunkSize) ? (int) left : chunkSize;
+        current = 0;
+        chunkRows = cursor;
+        setRows(slots[0], cursor);
+        cursor += (size_t) n * (nInputs + nOutputs);
+        left -= n;
+        return n;
+    }
+#ifdef __unix__
+    if (!t_running)
+        startReader();
+    int result;
+    pthread_mutex_lock(&mutex);
+    if (current >= 0)
+    {
+        /* Gives the previous chunk back to the reader */
+        head = (head + 1) % nSlots;
+        --count;
+        current = -1;
+        pthread_cond_signal(&freed);
+    }
+    while ((!count) && (!finished))
+        pthread_cond_wait(&filled, &mutex);
+    if (count)
+    {
+        current = head;
+        chunkRows = slots[current].data;
+        result = slots[current].size;
+    } else {
+        result = status;
+    }
+    pthread_mutex_unlock(&mutex);
+    return result;
+#else
+    current = 0;
+    chunkRows = slots[0].data;
+    int result = readChunk(slots[0]);
+    if (result <= 0)
+        current = -1;
+    return result;
+#endif
+}
+
+/*!
+    \fn template <typename T> const T *BasicDataset<T>::rows() const
+
+    Returns the samples of the current chunk, stored one after the other, each one being
+    made of its inputs followed by its outputs.
+
+    \sa next(), BasicPerceptron::train(int, const T *)
+*/
+
+/*!
+    \fn template <typename T> bool BasicDataset<T>::isMapped() const
+
+    Returns \c true if the file was opened with \c DATASET_FORMAT_MAPPED, \c false otherwise.
+*/
+
+/*!
+    \fn template <typename T> T **BasicDataset<T>::inputs() const
+
+    Returns the inputs of the samples of the current chunk.
+
+    \sa next(), outputs()
+*/
+
+/*!
+    \fn template <typename T> T **BasicDataset<T>::outputs() const
+
+    Returns the expected outputs of the samples of the current chunk.
+
+    \sa next(), inputs()
+*/
+
+/*!
+    Writes the \a size samples \a inputs and \a outputs to the file \a fileName,
+    in the binary format that open() reads.
+
+    Returns \c true on success, \c false otherwise.
+
+    \note The format depends on the type \c T and on the byte order of the machine,
+    and is identified by \c DATASET_FILE_VERSION.
+*/
+template <typename T>
+bool BasicDataset<T>::save(const char *fileName, int size, T **inputs, T **outputs) const
+{
+    if (size < 0)
+    {
+        ERROR("In Dataset::save, the size should be positive.");
+        return false;
+    }
+    DatasetFileHeader header;
+    fillHeader(header, sizeof(T), nInputs, nOutputs, size);
+    FILE *out = fopen(fileName, "wb");
+    if (!out)
+    {
+        ERROR("In Dataset::save, unable to open the file.");
+        return false;
+    }
+    bool success = (fwrite(&header, sizeof(header), 1, out) == 1);
+    for (int i = 0; success && (i < size); ++i)
+    {
+        success = (fwrite(inputs[i], sizeof(T), nInputs, out) == (size_t) nInputs)
+                && (fwrite(outputs[i], sizeof(T), nOutputs, out) == (size_t) nOutputs);
+    }
+    if (fclose(out) || (!success))
+    {
+        ERROR("In Dataset::save, unable to write the file.");
+        return false;
+    }
+    return true;
+}
+
+/*!
+    Writes all the samples of the open file to the file \a fileName, in the binary format.
+
+    This is typically used once on a CSV file, so that the next trainings read the binary file,
+    or map it with \c DATASET_FORMAT_MAPPED, instead of parsing the text again.
+    The dataset is then at the end of its file.
+
+    Returns \c true on success, \c false otherwise.
+*/
+template <typename T>
+bool BasicDataset<T>::convert(const char *fileName)
+{
+    if (!rewind())
+        return false;
+    FILE *out = fopen(fileName, "wb");
+    if (!out)
+    {
+        ERROR("In Dataset::convert, unable to open the file.");
+        return false;
+    }
+    DatasetFileHeader header;
+    fillHeader(header, sizeof(T), nInputs, nOutputs, 0);
+    bool success = (fwrite(&header, sizeof(header), 1, out) == 1);
+    int n;
+    while (success && ((n = next()) > 0))
+    {
+        success = (fwrite(rows(), sizeof(T) * (nInputs + nOutputs), n, out) == (size_t) n);
+        header.size += n;
+    }
+    /* The number of samples is only known at the end */
+    success = success && (n == 0) && (!fseek(out, 0, SEEK_SET)) && (fwrite(&header, sizeof(header), 1, out) == 1);
+    if (fclose(out) || (!success))
+    {
+        ERROR("In Dataset::convert, unable to write the file.");
+        return false;
+    }
+    return true;
+}
+
+/* Makes the rows of chunk point to the samples stored at data */
+template <typename T>
+void BasicDataset<T>::setRows(Chunk &chunk, const T *data)
+{
+    T *ptr = const_cast<T*>(data);
+    int width = nInputs + nOutputs;
+    for (int i = 0; i < chunkSize; ++i)
+    {
+        chunk.in[i] = &ptr[i * width];
+        chunk.out[i] = &ptr[i * width + nInputs];
+    }
+}
+
+/* Maps the binary file in memory, once its header has been checked */
+template <typename T>
+bool BasicDataset<T>::mapFile()
+{
+#ifdef __unix__
+    struct stat info;
+    if (fileScalarSize != (int) sizeof(T))
+    {
+        ERROR("In Dataset::open, the values of a mapped file must have the type of the dataset.");
+        return false;
+    }
+    if (fstat(fileno(file), &info) || ((size_t) info.st_size < sizeof(DatasetFileHeader)
+            + (size_t) left * (nInputs + nOutputs) * sizeof(T)))
+    {
+        ERROR("In Dataset::open, the file is truncated.");
+        return false;
+    }
+    mappingSize = info.st_size;
+    void *ptr = mmap(NULL, mappingSize, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    if (ptr == MAP_FAILED)
+    {
+        ERROR("In Dataset::open, unable to map the file.");
+        return false;
+    }
+    mapping = reinterpret_cast<char*>(ptr);
+    cursor = reinterpret_cast<const T*>(mapping + sizeof(DatasetFileHeader));
+    return true;
+#else
+    ERROR("In Dataset::open, mapped files are only supported on unix OS.");
+    return false;
+#endif
+}
+
+/* Places the file at its first sample, checking the header of the binary files */
+template <typename T>
+bool BasicDataset<T>::readHeader()
+{
+    if (fseek(file, 0, SEEK_SET))
+    {
+        ERROR("In Dataset::rewind, unable to seek in the file.");
+        return false;
+    }
+    if (format == DATASET_FORMAT_CSV)
+    {
+        firstLine = true;
+        return true;
+    }
+    DatasetFileHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1)
+    {
+        ERROR("In Dataset::open, unable to read the header.");
+        return false;
+    }
+    if (memcmp(header.magic, DATASET_FILE_MAGIC, sizeof(header.magic)) || (header.version != DATASET_FILE_VERSION)
+            || (header.byteOrder != DATASET_BYTE_ORDER))
+    {
+        ERROR("In Dataset::open, the file is not a dataset of this version, or has another byte order.");
+        return false;
+    }
+    if (((header.scalarSize != sizeof(float)) && (header.scalarSize != sizeof(double)))
+            || (header.nInputs != nInputs) || (header.nOutputs != nOutputs) || (header.size < 0))
+    {
+        ERROR("In Dataset::open, the file does not match the dataset.");
+        return false;
+    }
+    fileScalarSize = header.scalarSize;
+    left = header.size;
+    return true;
+}
+
+/* Decodes the next samples into chunk, and returns their number, 0 at the end of the file, -1 on error */
+template <typename T>
+int BasicDataset<T>::readChunk(Chunk &chunk)
+{
+    int result = (format == DATASET_FORMAT_CSV) ? readCSV(chunk) : readBinary(chunk);
+    chunk.size = (result > 0) ? result : 0;
+    return result;
+}
+
+template <typename T>
+int BasicDataset<T>::readBinary(Chunk &chunk)
+{
+    int n = (left < chunkSize) ? (int) left : chunkSize;
+    if (!n)
+        return 0;
+    size_t count = (size_t) n * (nInputs + nOutputs);
+    if (fileScalarSize == (int) sizeof(T))
+    {
+        if (fread(chunk.data, sizeof(T), count, file) != count)
+        {
+            ERROR("In Dataset::next, the file is truncated.");
+            return -1;
+        }
+    } else {
+        if (fread(raw, fileScalarSize, count, file) != count)
+        {
+            ERROR("In Dataset::next, the file is truncated.");
+            return -1;
+        }
+        if (fileScalarSize == sizeof(float))
+        {
+            const float *src = reinterpret_cast<const float*>(raw);
+            for (size_t i = 0; i < count; ++i)
+                chunk.data[i] = src[i];
+        } else {
+            const double *src = reinterpret_cast<const double*>(raw);
+            for (size_t i = 0; i < count; ++i)
+                chunk.data[i] = src[i];
+        }
+    }
+    left -= n;
+    return n;
+}
+
+template <typename T>
+int BasicDataset<T>::readCSV(Chunk &chunk)
+{
+    int n = 0, width = nInputs + nOutputs;
+    char *str;
+    while ((n < chunkSize) && readLine())
+    {
+        str = line;
+        while ((*str == ' ') || (*str == '\t'))
+            ++str;
+        if ((*str == '\0') || (*str == '\n') || (*str == '\r') || (*str == '#'))
+            continue;
+        if (parseLine(str, &chunk.data[n * width]))
+        {
+            ++n;
+        } else if (!firstLine)
+        {
+            ERROR("In Dataset::next, unable to parse a line of the CSV file.");
+            return -1;
+        }
+        firstLine = false;
+    }
+    if (ferror(file))
+    {
+        ERROR("In Dataset::next, unable to read the file.");
+        return -1;
+    }
+    return n;
+}
+
+/* Reads a whole line into line, growing it if needed */
+template <typename T>
+bool BasicDataset<T>::readLine()
+{
+    size_t length = 0;
+    while (fgets(&line[length], (int) (lineCapacity - length), file))
+    {
+        length += strlen(&line[length]);
+        if ((length > 0) && (line[length - 1] == '\n'))
+            return true;
+        if (length + 1 < lineCapacity)
+            return true;
+        char *larger = new char[lineCapacity * 2];
+        memcpy(larger, line, length + 1);
+        delete[] line;
+        line = larger;
+        lineCapacity *= 2;
+    }
+    return length > 0;
+}
+
+/* Reads the inputs then the outputs of a sample; returns false if the line does not hold exactly one sample */
+template <typename T>
+bool BasicDataset<T>::parseLine(char *str, T *row) const
+{
+    char *end;
+    for (int i = 0; i < nInputs + nOutputs; ++i)
+    {
+        while ((*str == ' ') || (*str == '\t'))
+            ++str;
+        if ((i > 0) && ((*str == ',') || (*str == ';')))
+            ++str;
+        row[i] = (T) strtod(str, &end);
+        if (end == str)
+            return false;
+        str = end;
+    }
+    while ((*str == ' ') || (*str == '\t') || (*str == ',') || (*str == ';') || (*str == '\r') || (*str == '\n'))
+        ++str;
+    return *str == '\0';
+}
+
+/* Starts the thread that decodes the chunks ahead of the consumer */
+template <typename T>
+void BasicDataset<T>::startReader()
+{
+#ifdef __unix__
+    head = 0;
+    count = 0;
+    status = 0;
+    finished = false;
+    t_exit = false;
+    pthread_create(&thread, NULL, thread_run, (void*) this);
+    t_running = true;
+#endif
+}
+
+template <typename T>
+void BasicDataset<T>::stopReader()
+{
+#ifdef __unix__
+    if (!t_running)
+        return;
+    pthread_mutex_lock(&mutex);
+    t_exit = true;
+    pthread_cond_broadcast(&freed);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(thread, NULL);
+    t_running = false;
+#endif
+}
+
+#ifdef __unix__
+
+template <typename T>
+void *BasicDataset<T>::thread_run(void *obj)
+{
+    BasicDataset *self = reinterpret_cast<BasicDataset*>(obj);
+    int slot, result;
+    pthread_mutex_lock(&self->mutex);
+    while (true)
+    {
+        while ((self->count == self->nSlots) && (!self->t_exit))
+            pthread_cond_wait(&self->freed, &self->mutex);
+        if (self->t_exit)
+            break;
+        /* The chunks after the filled ones are not used by the consumer */
+        slot = (self->head + self->count) % self->nSlots;
+        pthread_mutex_unlock(&self->mutex);
+        result = self->readChunk(self->slots[slot]);
+        pthread_mutex_lock(&self->mutex);
+        if (result <= 0)
+        {
+            self->status = result;
+            self->finished = true;
+            pthread_cond_signal(&self->filled);
+            break;
+        }
+        ++self->count;
+        pthread_cond_signal(&self->filled);
+    }
+    pthread_mutex_unlock(&self->mutex);
+    return NULL;
+}
+
+#endif
+
+template class BasicDataset<double>;
+template class BasicDataset<float>;
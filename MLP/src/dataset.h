@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2015, Rémi Bazin <bazin.remi@gmail.com>
+ * All rights reserved.
+ * See LICENSE for licensing details.
+ */
+
+#ifndef DATASET_H
+#define DATASET_H
+
+/* Number of samples decoded at once, and number of chunks decoded ahead of the training */
+#define DATASET_DEFAULT_CHUNK 4096
+#define DATASET_DEFAULT_PREFETCH 2
+
+/* Formats of the files read by open() */
+#define DATASET_FORMAT_AUTO 0
+#define DATASET_FORMAT_BINARY 1
+#define DATASET_FORMAT_CSV 2
+#define DATASET_FORMAT_MAPPED 3
+
+/* Version of the binary format written by save() */
+#define DATASET_FILE_VERSION 1
+
+#ifdef __unix__
+ #include <pthread.h>
+#endif
+#include <stdio.h>
+#include <stddef.h>
+
+/* T is the type of the values handed to the perceptron */
+template <typename T>
+class BasicDataset
+{
+private:
+    struct Chunk
+    {
+        T *data;
+        T **in, **out;
+        int size;
+    };
+public:
+    BasicDataset(int nInputs, int nOutputs, int chunkSize = DATASET_DEFAULT_CHUNK, int prefetch = DATASET_DEFAULT_PREFETCH);
+    ~BasicDataset();
+    inline bool hasError() const { return !slots; }
+    inline int getInputs() const { return nInputs; }
+    inline int getOutputs() const { return nOutputs; }
+    inline int getChunkSize() const { return chunkSize; }
+    bool open(const char *fileName, int format = DATASET_FORMAT_AUTO);
+    void close();
+    inline bool isMapped() const { return mapping != NULL; }
+    bool rewind();
+    int next();
+    inline const T *rows() const { return chunkRows; }
+    inline T **inputs() const { return slots[current].in; }
+    inline T **outputs() const { return slots[current].out; }
+    bool save(const char *fileName, int size, T **inputs, T **outputs) const;
+    bool convert(const char *fileName);
+private:
+    BasicDataset(const BasicDataset &other);
+    BasicDataset &operator=(const BasicDataset &other);
+    void setRows(Chunk &chunk, const T *data);
+    bool readHeader();
+    bool mapFile();
+    int readChunk(Chunk &chunk);
+    int readBinary(Chunk &chunk);
+    int readCSV(Chunk &chunk);
+    bool readLine();
+    bool parseLine(char *str, T *row) const;
+    void startReader();
+    void stopReader();
+#ifdef __unix__
+    static void *thread_run(void *obj);
+#endif
+private:
+    int nInputs, nOutputs, chunkSize, nSlots;
+    /* Ring of chunks: the consumer holds the one at current, the reader fills the ones after it */
+    Chunk *slots;
+    int current;
+    /* Samples of the current chunk, stored one after the other */
+    const T *chunkRows;
+    FILE *file;
+    int format;
+    /* Binary files: size of the stored values, conversion buffer, and number of samples left */
+    int fileScalarSize;
+    char *raw;
+    long long left;
+    /* Mapped files: whole file, and next sample to hand out */
+    char *mapping;
+    size_t mappingSize;
+    const T *cursor;
+    /* CSV files: line buffer, and whether the first line may be a header */
+    char *line;
+    size_t lineCapacity;
+    bool firstLine;
+    /* Shared with the reader thread: first filled chunk, number of filled chunks,
+     * and result of the reader once it stopped (0 at the end of the file, -1 on error) */
+    int head, count, status;
+    bool finished;
+#ifdef __unix__
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t filled, freed;
+    bool t_running, t_exit;
+#endif
+};
+
+typedef BasicDataset<double> Dataset;
+typedef BasicDataset<float> DatasetF;
+
+#endif // DATASET_H
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2015, Rémi Bazin <bazin.remi@gmail.com>
+ * All rights reserved.
+ * See LICENSE for licensing details.
+ */
+
+/*!
+    \class FrozenBrain
+    \inmodule NetNeurons
+    \ingroup NetNeurons
+
+    \brief FrozenBrain is an inference-only copy of a network of neurons, made by BrainInterface::freeze().
+
+    It only holds what running the network needs: the neurons sorted by level, their activation
+    functions, and the sources and weights of their connections (12 bytes per connection), without
+    any training state, whatever the value of \c NEURON_ENABLE_LEARNING. The outputs are exactly those
+    of BrainInterface::run() at the time the brain was frozen.
+
+    A frozen brain never changes after its creation, and its intermediate values are stored in a
+    FrozenBrainWorkspace given by the caller: several threads may run the same frozen brain at the
+    same time, each one of them using its own workspace.
+
+    \sa BrainInterface::freeze()
+*/
+
+#include "frozenbrain.h"
+#include "kernels.h"
+
+#include <stdio.h>
+
+/* C++ Double expansion trick */
+#define FROZENBRAIN_S(x) #x
+#define FROZENBRAIN_S_(x) FROZENBRAIN_S(x)
+
+#define ERROR(str) fprintf(stderr, __FILE__ " (" FROZENBRAIN_S_(__LINE__) "): " str)
+
+FrozenBrain::FrozenBrain(int nInputs, int nOutputs, int nNodes, int nEdges, int nLevels)
+    : nInputs(nInputs), nOutputs(nOutputs), nNodes(nNodes), nEdges(nEdges), nLevels(nLevels)
+{
+    levelStart = new int[nLevels + 1];
+    activ = new NEURON_FUN[nNodes];
+    outputIndex = new int[nOutputs];
+    rowStart = new int[nNodes + 1];
+    source = new int[nEdges];
+    weight = new double[nEdges];
+    rowGroup = new bool[nNodes];
+}
+
+/*!
+    Destructs the frozen brain.
+*/
+FrozenBrain::~FrozenBrain()
+{
+    delete[] rowGroup;
+    delete[] weight;
+    delete[] source;
+    delete[] rowStart;
+    delete[] outputIndex;
+    delete[] activ;
+    delete[] levelStart;
+}
+
+/*!
+    \fn int FrozenBrain::countInputs() const
+
+    Returns the number of inputs of the network.
+*/
+
+/*!
+    \fn int FrozenBrain::countOutputs() const
+
+    Returns the number of outputs of the network.
+*/
+
+/*!
+    \fn int FrozenBrain::countNodes() const
+
+    Returns the number of neurons of the network, inputs included.
+*/
+
+/*!
+    \fn int FrozenBrain::countEdges() const
+
+    Returns the number of connections of the network.
+*/
+
+/*!
+    Runs the network on the \l countInputs() values of \a inputs, and writes
+    the \l countOutputs() values of the outputs to \a outputs.
+
+    The intermediate values are stored in \a workspace, so that this function does not allocate
+    any memory and can be called from several threads at once, each one with its own workspace.
+*/
+void FrozenBrain::run(const double *inputs, double *outputs, Workspace &workspace) const
+{
+    runBatch(1, inputs, outputs, workspace);
+}
+
+/*!
+    Runs the network on \a n samples at once.
+
+    \a inputs contains the \a n input vectors one after the other (\l countInputs() values each),
+    and the \a n output vectors are written the same way to \a outputs (\l countOutputs() values each).
+    The samples are computed by blocks of the size \a workspace was created with,
+    each neuron going through all the samples of a block before the next one.
+
+    As run(), this function does not allocate any memory and is reentrant.
+*/
+void FrozenBrain::runBatch(int n, const double *inputs, double *outputs, Workspace &workspace) const
+{
+    if (workspace.nNodes != nNodes)
+    {
+        ERROR("In FrozenBrain::runBatch, the workspace does not match the brain.");
+        return;
+    }
+    double *values = workspace.data, *acc = &workspace.data[workspace.blockSize * nNodes];
+    int count, s, i;
+    while (n > 0)
+    {
+        count = (n < workspace.blockSize) ? n : workspace.blockSize;
+        for (s = 0; s < count; ++s)
+            for (i = 0; i < nInputs; ++i)
+                values[s * nNodes + i] = inputs[s * nInputs + i];
+        forward(count, values, acc);
+        for (s = 0; s < count; ++s)
+            for (i = 0; i < nOutputs; ++i)
+                outputs[s * nOutputs + i] = values[s * nNodes + outputIndex[i]];
+        inputs += count * nInputs;
+        outputs += count * nOutputs;
+        n -= count;
+    }
+}
+
+/* Same computation as BrainPlan::forwardRange, on all the levels */
+void FrozenBrain::forward(int count, double *values, double *acc) const
+{
+    double *v, sums[KERNEL_ROWS];
+    int n = nInputs, s, r;
+    while (n < nNodes)
+    {
+        if (rowGroup[n])
+        {
+            for (s = 0, v = values; s < count; ++s, v += nNodes)
+            {
+                for (r = 0; r < KERNEL_ROWS; ++r)
+                    sums[r] = 0;
+                kernel_dot_rows(rowStart[n + 1] - rowStart[n], weight, &rowStart[n], v, &source[rowStart[n]], sums);
+                for (r = 0; r < KERNEL_ROWS; ++r)
+                    v[n + r] = activ[n + r] ? activ[n + r](sums[r]) : sums[r];
+            }
+            n += KERNEL_ROWS;
+            continue;
+        }
+        for (s = 0; s < count; ++s)
+            acc[s] = 0;
+        kernel_dot_samples(rowStart[n + 1] - rowStart[n], &weight[rowStart[n]], NULL, values, nNodes,
+                           &source[rowStart[n]], count, acc);
+        for (s = 0, v = values; s < count; ++s, v += nNodes)
+            v[n] = activ[n] ? activ[n](acc[s]) : acc[s];
+        ++n;
+    }
+}
+
+/*!
+    \class FrozenBrainWorkspace
+    \inmodule NetNeurons
+    \ingroup NetNeurons
+
+    \brief FrozenBrainWorkspace holds the intermediate values needed to run a FrozenBrain.
+
+    Each thread running a frozen brain needs its own workspace.
+
+    \sa FrozenBrain
+*/
+
+/*!
+    Constructs a workspace for frozen brains that have as many neurons as \a brain.
+
+    The workspace lets FrozenBrain::runBatch() process blocks of \a blockSize samples at once
+    (FrozenBrain::run() only needs a block size of 1).
+
+    \note Memory usage is O(\a blockSize * number of neurons).
+*/
+FrozenBrainWorkspace::FrozenBrainWorkspace(const FrozenBrain &brain, int blockSize)
+    : nNodes(brain.nNodes), blockSize((blockSize > 0) ? blockSize : 1)
+{
+    data = new double[this->blockSize * (nNodes + 1)];
+}
+
+/*!
+    Destructs the workspace.
+*/
+FrozenBrainWorkspace::~FrozenBrainWorkspace()
+{
+    delete[] data;
+}
+
+/*!
+    \fn int FrozenBrainWorkspace::getBlockSize() const
+
+    Returns the number of samples that this workspace lets FrozenBrain::runBatch() process at once.
+*/
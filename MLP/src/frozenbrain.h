@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2015, Rémi Bazin <bazin.remi@gmail.com>
+ * All rights reserved.
+ * See LICENSE for licensing details.
+ */
+
+#ifndef FROZENBRAIN_H
+#define FROZENBRAIN_H
+
+#include "neuron.h"
+
+/* Number of samples computed together by FrozenBrain::runBatch with a default workspace */
+#define FROZENBRAIN_BATCH_BLOCK 32
+
+class BrainPlan;
+class FrozenBrainWorkspace;
+
+class FrozenBrain
+{
+    friend class BrainPlan;
+    friend class FrozenBrainWorkspace;
+public:
+    typedef FrozenBrainWorkspace Workspace;
+    ~FrozenBrain();
+    inline int countInputs() const { return nInputs; }
+    inline int countOutputs() const { return nOutputs; }
+    inline int countNodes() const { return nNodes; }
+    inline int countEdges() const { return nEdges; }
+    void run(const double *inputs, double *outputs, Workspace &workspace) const;
+    void runBatch(int n, const double *inputs, double *outputs, Workspace &workspace) const;
+private:
+    FrozenBrain(int nInputs, int nOutputs, int nNodes, int nEdges, int nLevels);
+    FrozenBrain(const FrozenBrain &other);
+    FrozenBrain &operator=(const FrozenBrain &other);
+    void forward(int count, double *values, double *acc) const;
+private:
+    int nInputs, nOutputs, nNodes, nEdges, nLevels;
+    /* Same layout as in BrainPlan: nodes sorted by level, and edges grouped by destination */
+    int *levelStart;
+    NEURON_FUN *activ;
+    int *outputIndex;
+    int *rowStart, *source;
+    double *weight;
+    bool *rowGroup;
+};
+
+class FrozenBrainWorkspace
+{
+    friend class FrozenBrain;
+public:
+    FrozenBrainWorkspace(const FrozenBrain &brain, int blockSize = FROZENBRAIN_BATCH_BLOCK);
+    ~FrozenBrainWorkspace();
+    inline int getBlockSize() const { return blockSize; }
+private:
+    FrozenBrainWorkspace(const FrozenBrainWorkspace &other);
+    FrozenBrainWorkspace &operator=(const FrozenBrainWorkspace &other);
+private:
+    int nNodes, blockSize;
+    /* Values of the blockSize samples, one row of nNodes per sample, then the sums of a row */
+    double *data;
+};
+
+#endif // FROZENBRAIN_H
@@ -0,0 +1,1759 @@
+/*
+ * Copyright (c) 2015, Rémi Bazin <bazin.remi@gmail.com>
+ * All rights reserved.
+ * See LICENSE for licensing details.
+ */
+
+#include "kernels.h"
+
+#include <math.h>
+
+/* Number of single-precision values converted at once by the single-precision tanh kernels */
+#define KERNEL_FLOAT_CHUNK 256
+
+/* The vectorized versions need GCC-style target attributes and a x86 CPU */
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+ #define KERNEL_X86 1
+ #include <immintrin.h>
+ /* GCC contracts the multiplications and additions of intrinsics into FMA; Clang does not */
+ #ifdef __clang__
+  #define KERNEL_NO_CONTRACT
+ #else
+  #define KERNEL_NO_CONTRACT __attribute__((optimize("fp-contract=off")))
+ #endif
+#else
+ #define KERNEL_X86 0
+#endif
+
+/* Scalar versions */
+
+static void axpy_scalar(int n, double a, const double *x, double *y)
+{
+    for (int i = 0; i < n; ++i)
+        y[i] += a * x[i];
+}
+
+static double dot_scalar(int n, const double *x, const double *y)
+{
+    double result = 0;
+    for (int i = 0; i < n; ++i)
+        result += x[i] * y[i];
+    return result;
+}
+
+static void ger_scalar(int m, int n, const double *x, const double *y, double *A)
+{
+    for (int i = 0; i < m; ++i, A += n)
+        axpy_scalar(n, x[i], y, A);
+}
+
+static void dot_rows_scalar(int n, const double *w, const int *start, const double *x, const int *index, double *sums)
+{
+    double xk;
+    for (int k = 0; k < n; ++k)
+    {
+        xk = x[index[k]];
+        for (int r = 0; r < KERNEL_ROWS; ++r)
+            sums[r] += w[start[r] + k] * xk;
+    }
+}
+
+static void dot_cols_scalar(int n, const double *w, const int *offset, const double *x, const int *index, double *sums)
+{
+    double xk;
+    for (int k = 0; k < n; ++k)
+    {
+        xk = x[index[k]];
+        for (int r = 0; r < KERNEL_ROWS; ++r)
+            sums[r] += w[offset[k] + r] * xk;
+    }
+}
+
+static void dot_samples_scalar(int n, const double *w, const int *offset, const double *x, int stride, const int *index,
+                               int count, double *sums)
+{
+    const double *xs = x;
+    double acc;
+    for (int s = 0; s < count; ++s, xs += stride)
+    {
+        acc = sums[s];
+        for (int k = 0; k < n; ++k)
+            acc += (offset ? w[offset[k]] : w[k]) * xs[index[k]];
+        sums[s] = acc;
+    }
+}
+
+static void ger_rows_scalar(int n, double *y, const int *start, int count, int stride,
+                            const double *x, const int *index, const double *a)
+{
+    double v;
+    for (int r = 0; r < KERNEL_ROWS; ++r)
+    {
+        double *row = &y[start[r]];
+        for (int k = 0; k < n; ++k)
+        {
+            v = row[k];
+            for (int s = 0; s < count; ++s)
+                v += x[s * stride + index[k]] * a[s * stride + r];
+            row[k] = v;
+        }
+    }
+}
+
+static void axpyf_scalar(int n, float a, const float *x, float *y)
+{
+    for (int i = 0; i < n; ++i)
+        y[i] += a * x[i];
+}
+
+static float dotf_scalar(int n, const float *x, const float *y)
+{
+    float result = 0;
+    for (int i = 0; i < n; ++i)
+        result += x[i] * y[i];
+    return result;
+}
+
+static void axpym_scalar(int n, double a, const float *x, double *y)
+{
+    for (int i = 0; i < n; ++i)
+        y[i] += a * x[i];
+}
+
+static void germ_scalar(int m, int n, const float *x, const float *y, double *A)
+{
+    for (int i = 0; i < m; ++i, A += n)
+        axpym_scalar(n, x[i], y, A);
+}
+
+static void supersab_scalar(int n, double increase, double decrease, double *w, double *g, double *rates, double *former)
+{
+    double p, r;
+    for (int i = 0; i < n; ++i)
+    {
+        p = g[i] * former[i];
+        r = rates[i];
+        if (p > 0)
+            r *= increase;
+        else if (p < 0)
+            r *= decrease;
+        rates[i] = r;
+        w[i] -= r * g[i];
+        former[i] = g[i];
+        g[i] = 0;
+    }
+}
+
+static void supersabm_scalar(int n, double increase, double decrease, float *w, double *g, float *rates, float *former)
+{
+    float gf, p, r;
+    for (int i = 0; i < n; ++i)
+    {
+        gf = (float) g[i];
+        p = gf * former[i];
+        r = rates[i];
+        if (p > 0)
+            r = (float) (r * increase);
+        else if (p < 0)
+            r = (float) (r * decrease);
+        rates[i] = r;
+        w[i] -= r * gf;
+        former[i] = gf;
+        g[i] = 0;
+    }
+}
+
+static void adam_scalar(int n, double rate, double beta1, double beta2, double epsilon, double *w, double *g, double *m, double *v)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        m[i] = beta1 * m[i] + (1. - beta1) * g[i];
+        v[i] = beta2 * v[i] + (1. - beta2) * g[i] * g[i];
+        w[i] -= rate * m[i] / (sqrt(v[i]) + epsilon);
+        g[i] = 0;
+    }
+}
+
+static void rmsprop_scalar(int n, double rate, double decay, double epsilon, double *w, double *g, double *v)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        v[i] = decay * v[i] + (1. - decay) * g[i] * g[i];
+        w[i] -= rate * g[i] / (sqrt(v[i]) + epsilon);
+        g[i] = 0;
+    }
+}
+
+static void nesterov_scalar(int n, double rate, double momentum, double *w, double *g, double *v)
+{
+    double former;
+    for (int i = 0; i < n; ++i)
+    {
+        former = v[i];
+        v[i] = momentum * former - rate * g[i];
+        w[i] += (1. + momentum) * v[i] - momentum * former;
+        g[i] = 0;
+    }
+}
+
+static void rprop_scalar(int n, double increase, double decrease, double minStep, double maxStep,
+                         double *w, double *g, double *step, double *former)
+{
+    double p, d, gi;
+    for (int i = 0; i < n; ++i)
+    {
+        gi = g[i];
+        p = gi * former[i];
+        d = step[i];
+        if (p > 0)
+        {
+            d *= increase;
+            if (d > maxStep)
+                d = maxStep;
+        } else if (p < 0)
+        {
+            d *= decrease;
+            if (d < minStep)
+                d = minStep;
+            gi = 0;
+        }
+        step[i] = d;
+        if (gi > 0)
+            w[i] -= d;
+        else if (gi < 0)
+            w[i] += d;
+        former[i] = gi;
+        g[i] = 0;
+    }
+}
+
+/* Constants of kernel_tanh_fast: below TANH_SMALL, an odd series is used; above,
+ * tanh(|x|) = (1 - e) / (1 + e) with e = exp(-2|x|), exp being a reduced Taylor polynomial. */
+#define TANH_SMALL 0.0625
+#define TANH_CLAMP 20.
+#define TANH_LOG2E 1.4426950408889634
+#define TANH_LN2_HI 6.93147180369123816490e-01
+#define TANH_LN2_LO 1.90821492927058770002e-10
+#define TANH_EXP_DEGREE 12
+
+static const double tanh_series[5] = {
+    -1. / 3., 2. / 15., -17. / 315., 62. / 2835., -1382. / 155925.
+};
+
+static const double tanh_exp[TANH_EXP_DEGREE + 1] = {
+    1., 1., 1. / 2., 1. / 6., 1. / 24., 1. / 120., 1. / 720., 1. / 5040., 1. / 40320.,
+    1. / 362880., 1. / 3628800., 1. / 39916800., 1. / 479001600.
+};
+
+static inline double tanh_fast_single(double x)
+{
+    double a = fabs(x), p;
+    if (a < TANH_SMALL)
+    {
+        double x2 = x * x;
+        p = tanh_series[4];
+        for (int c = 3; c >= 0; --c)
+            p = p * x2 + tanh_series[c];
+        return x + x * x2 * p;
+    }
+    if (a > TANH_CLAMP)
+        a = TANH_CLAMP;
+    double y = -2. * a;
+    double k = floor(y * TANH_LOG2E + 0.5);
+    double r = (y - k * TANH_LN2_HI) - k * TANH_LN2_LO;
+    p = tanh_exp[TANH_EXP_DEGREE];
+    for (int c = TANH_EXP_DEGREE - 1; c >= 0; --c)
+        p = p * r + tanh_exp[c];
+    union { double d; long long i; } scale;
+    scale.i = ((long long) ((int) k + 1023)) << 52;
+    p *= scale.d;
+    p = (1. - p) / (1. + p);
+    return (x < 0) ? -p : p;
+}
+
+static void tanh_fast_scalar(int n, double *x)
+{
+    for (int i = 0; i < n; ++i)
+        x[i] = tanh_fast_single(x[i]);
+}
+
+#if KERNEL_X86
+
+/* AVX2 versions */
+
+__attribute__((target("avx2,fma")))
+static inline void axpy_avx2_inline(int n, double a, const double *x, double *y)
+{
+    __m256d va = _mm256_set1_pd(a);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256d y0 = _mm256_fmadd_pd(va, _mm256_loadu_pd(&x[i]), _mm256_loadu_pd(&y[i]));
+        __m256d y1 = _mm256_fmadd_pd(va, _mm256_loadu_pd(&x[i + 4]), _mm256_loadu_pd(&y[i + 4]));
+        _mm256_storeu_pd(&y[i], y0);
+        _mm256_storeu_pd(&y[i + 4], y1);
+    }
+    if (i + 4 <= n)
+    {
+        _mm256_storeu_pd(&y[i], _mm256_fmadd_pd(va, _mm256_loadu_pd(&x[i]), _mm256_loadu_pd(&y[i])));
+        i += 4;
+    }
+    for (; i < n; ++i)
+        y[i] += a * x[i];
+}
+
+__attribute__((target("avx2,fma")))
+static void axpy_avx2(int n, double a, const double *x, double *y)
+{
+    axpy_avx2_inline(n, a, x, y);
+}
+
+__attribute__((target("avx2,fma")))
+static double dot_avx2(int n, const double *x, const double *y)
+{
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        s0 = _mm256_fmadd_pd(_mm256_loadu_pd(&x[i]), _mm256_loadu_pd(&y[i]), s0);
+        s1 = _mm256_fmadd_pd(_mm256_loadu_pd(&x[i + 4]), _mm256_loadu_pd(&y[i + 4]), s1);
+    }
+    if (i + 4 <= n)
+    {
+        s0 = _mm256_fmadd_pd(_mm256_loadu_pd(&x[i]), _mm256_loadu_pd(&y[i]), s0);
+        i += 4;
+    }
+    s0 = _mm256_add_pd(s0, s1);
+    __m128d h = _mm_add_pd(_mm256_castpd256_pd128(s0), _mm256_extractf128_pd(s0, 1));
+    double result = _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+    for (; i < n; ++i)
+        result += x[i] * y[i];
+    return result;
+}
+
+__attribute__((target("avx2,fma")))
+static void ger_avx2(int m, int n, const double *x, const double *y, double *A)
+{
+    for (int i = 0; i < m; ++i, A += n)
+        axpy_avx2_inline(n, x[i], y, A);
+}
+
+/* Transposes the 4x4 block whose rows are r0..r3, so that c0..c3 hold the values 0..3 of the rows */
+#define KERNEL_TRANSPOSE4(r0, r1, r2, r3, c0, c1, c2, c3) \
+    do { \
+        __m256d t0 = _mm256_unpacklo_pd(r0, r1), t1 = _mm256_unpackhi_pd(r0, r1); \
+        __m256d t2 = _mm256_unpacklo_pd(r2, r3), t3 = _mm256_unpackhi_pd(r2, r3); \
+        c0 = _mm256_permute2f128_pd(t0, t2, 0x20); \
+        c1 = _mm256_permute2f128_pd(t1, t3, 0x20); \
+        c2 = _mm256_permute2f128_pd(t0, t2, 0x31); \
+        c3 = _mm256_permute2f128_pd(t1, t3, 0x31); \
+    } while (0)
+
+/* Each lane is the sum of a row: the additions of a row keep their order, without FMA */
+__attribute__((target("avx2,fma"))) KERNEL_NO_CONTRACT
+static void dot_rows_avx2(int n, const double *w, const int *start, const double *x, const int *index, double *sums)
+{
+    const double *w0 = &w[start[0]], *w1 = &w[start[1]], *w2 = &w[start[2]], *w3 = &w[start[3]];
+    const double *w4 = &w[start[4]], *w5 = &w[start[5]], *w6 = &w[start[6]], *w7 = &w[start[7]];
+    __m256d s0 = _mm256_loadu_pd(sums), s1 = _mm256_loadu_pd(&sums[4]);
+    __m256d c0, c1, c2, c3, d0, d1, d2, d3, xk;
+    int k = 0;
+    for (; k + 4 <= n; k += 4)
+    {
+        KERNEL_TRANSPOSE4(_mm256_loadu_pd(&w0[k]), _mm256_loadu_pd(&w1[k]),
+                          _mm256_loadu_pd(&w2[k]), _mm256_loadu_pd(&w3[k]), c0, c1, c2, c3);
+        KERNEL_TRANSPOSE4(_mm256_loadu_pd(&w4[k]), _mm256_loadu_pd(&w5[k]),
+                          _mm256_loadu_pd(&w6[k]), _mm256_loadu_pd(&w7[k]), d0, d1, d2, d3);
+        xk = _mm256_broadcast_sd(&x[index[k]]);
+        s0 = _mm256_add_pd(s0, _mm256_mul_pd(c0, xk));
+        s1 = _mm256_add_pd(s1, _mm256_mul_pd(d0, xk));
+        xk = _mm256_broadcast_sd(&x[index[k + 1]]);
+        s0 = _mm256_add_pd(s0, _mm256_mul_pd(c1, xk));
+        s1 = _mm256_add_pd(s1, _mm256_mul_pd(d1, xk));
+        xk = _mm256_broadcast_sd(&x[index[k + 2]]);
+        s0 = _mm256_add_pd(s0, _mm256_mul_pd(c2, xk));
+        s1 = _mm256_add_pd(s1, _mm256_mul_pd(d2, xk));
+        xk = _mm256_broadcast_sd(&x[index[k + 3]]);
+        s0 = _mm256_add_pd(s0, _mm256_mul_pd(c3, xk));
+        s1 = _mm256_add_pd(s1, _mm256_mul_pd(d3, xk));
+    }
+    _mm256_storeu_pd(sums, s0);
+    _mm256_storeu_pd(&sums[4], s1);
+    for (; k < n; ++k)
+        for (int r = 0; r < KERNEL_ROWS; ++r)
+            sums[r] += w[start[r] + k] * x[index[k]];
+}
+
+__attribute__((target("avx2,fma"))) KERNEL_NO_CONTRACT
+static void dot_cols_avx2(int n, const double *w, const int *offset, const double *x, const int *index, double *sums)
+{
+    __m256d s0 = _mm256_loadu_pd(sums), s1 = _mm256_loadu_pd(&sums[4]), xk;
+    const double *wk;
+    for (int k = 0; k < n; ++k)
+    {
+        wk = &w[offset[k]];
+        xk = _mm256_broadcast_sd(&x[index[k]]);
+        s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(wk), xk));
+        s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_loadu_pd(&wk[4]), xk));
+    }
+    _mm256_storeu_pd(sums, s0);
+    _mm256_storeu_pd(&sums[4], s1);
+}
+
+/* Each vector holds four samples, whose values are gathered from x */
+__attribute__((target("avx2,fma"))) KERNEL_NO_CONTRACT
+static void dot_samples_avx2(int n, const double *w, const int *offset, const double *x, int stride, const int *index,
+                             int count, double *sums)
+{
+    __m128i lanes = _mm_setr_epi32(0, stride, 2 * stride, 3 * stride), vi;
+    /* The masked gathers have a defined source, unlike _mm256_i32gather_pd with GCC 12 (-Wmaybe-uninitialized) */
+    const __m256d zero = _mm256_setzero_pd(), all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    __m256d acc0, acc1, wk;
+    const double *x0, *x1;
+    int s = 0, k;
+    for (; s + 8 <= count; s += 8)
+    {
+        x0 = &x[s * stride];
+        x1 = &x[(s + 4) * stride];
+        acc0 = _mm256_loadu_pd(&sums[s]);
+        acc1 = _mm256_loadu_pd(&sums[s + 4]);
+        for (k = 0; k < n; ++k)
+        {
+            wk = _mm256_set1_pd(offset ? w[offset[k]] : w[k]);
+            vi = _mm_add_epi32(lanes, _mm_set1_epi32(index[k]));
+            acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(wk, _mm256_mask_i32gather_pd(zero, x0, vi, all, 8)));
+            acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(wk, _mm256_mask_i32gather_pd(zero, x1, vi, all, 8)));
+        }
+        _mm256_storeu_pd(&sums[s], acc0);
+        _mm256_storeu_pd(&sums[s + 4], acc1);
+    }
+    for (; s + 4 <= count; s += 4)
+    {
+        x0 = &x[s * stride];
+        acc0 = _mm256_loadu_pd(&sums[s]);
+        for (k = 0; k < n; ++k)
+        {
+            wk = _mm256_set1_pd(offset ? w[offset[k]] : w[k]);
+            vi = _mm_add_epi32(lanes, _mm_set1_epi32(index[k]));
+            acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(wk, _mm256_mask_i32gather_pd(zero, x0, vi, all, 8)));
+        }
+        _mm256_storeu_pd(&sums[s], acc0);
+    }
+    if (s < count)
+        dot_samples_scalar(n, w, offset, &x[s * stride], stride, index, count - s, &sums[s]);
+}
+
+/* The block of four values of each row stays in a register while the samples are added */
+__attribute__((target("avx2,fma"))) KERNEL_NO_CONTRACT
+static void ger_rows_avx2(int n, double *y, const int *start, int count, int stride,
+                          const double *x, const int *index, const double *a)
+{
+    double *y0 = &y[start[0]], *y1 = &y[start[1]], *y2 = &y[start[2]], *y3 = &y[start[3]];
+    double *y4 = &y[start[4]], *y5 = &y[start[5]], *y6 = &y[start[6]], *y7 = &y[start[7]];
+    __m256d acc0, acc1, acc2, acc3, acc4, acc5, acc6, acc7, xk;
+    const double *xs, *as;
+    int k = 0, i0, i1, i2, i3;
+    for (; k + 4 <= n; k += 4)
+    {
+        acc0 = _mm256_loadu_pd(&y0[k]);
+        acc1 = _mm256_loadu_pd(&y1[k]);
+        acc2 = _mm256_loadu_pd(&y2[k]);
+        acc3 = _mm256_loadu_pd(&y3[k]);
+        acc4 = _mm256_loadu_pd(&y4[k]);
+        acc5 = _mm256_loadu_pd(&y5[k]);
+        acc6 = _mm256_loadu_pd(&y6[k]);
+        acc7 = _mm256_loadu_pd(&y7[k]);
+        i0 = index[k];
+        i1 = index[k + 1];
+        i2 = index[k + 2];
+        i3 = index[k + 3];
+        xs = x;
+        as = a;
+        for (int s = 0; s < count; ++s, xs += stride, as += stride)
+        {
+            xk = _mm256_set_pd(xs[i3], xs[i2], xs[i1], xs[i0]);
+            acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(xk, _mm256_broadcast_sd(&as[0])));
+            acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(xk, _mm256_broadcast_sd(&as[1])));
+            acc2 = _mm256_add_pd(acc2, _mm256_mul_pd(xk, _mm256_broadcast_sd(&as[2])));
+            acc3 = _mm256_add_pd(acc3, _mm256_mul_pd(xk, _mm256_broadcast_sd(&as[3])));
+            acc4 = _mm256_add_pd(acc4, _mm256_mul_pd(xk, _mm256_broadcast_sd(&as[4])));
+            acc5 = _mm256_add_pd(acc5, _mm256_mul_pd(xk, _mm256_broadcast_sd(&as[5])));
+            acc6 = _mm256_add_pd(acc6, _mm256_mul_pd(xk, _mm256_broadcast_sd(&as[6])));
+            acc7 = _mm256_add_pd(acc7, _mm256_mul_pd(xk, _mm256_broadcast_sd(&as[7])));
+        }
+        _mm256_storeu_pd(&y0[k], acc0);
+        _mm256_storeu_pd(&y1[k], acc1);
+        _mm256_storeu_pd(&y2[k], acc2);
+        _mm256_storeu_pd(&y3[k], acc3);
+        _mm256_storeu_pd(&y4[k], acc4);
+        _mm256_storeu_pd(&y5[k], acc5);
+        _mm256_storeu_pd(&y6[k], acc6);
+        _mm256_storeu_pd(&y7[k], acc7);
+    }
+    double v;
+    for (; k < n; ++k)
+    {
+        for (int r = 0; r < KERNEL_ROWS; ++r)
+        {
+            v = y[start[r] + k];
+            for (int s = 0; s < count; ++s)
+                v += x[s * stride + index[k]] * a[s * stride + r];
+            y[start[r] + k] = v;
+        }
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void axpyf_avx2(int n, float a, const float *x, float *y)
+{
+    __m256 va = _mm256_set1_ps(a);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256 y0 = _mm256_fmadd_ps(va, _mm256_loadu_ps(&x[i]), _mm256_loadu_ps(&y[i]));
+        __m256 y1 = _mm256_fmadd_ps(va, _mm256_loadu_ps(&x[i + 8]), _mm256_loadu_ps(&y[i + 8]));
+        _mm256_storeu_ps(&y[i], y0);
+        _mm256_storeu_ps(&y[i + 8], y1);
+    }
+    if (i + 8 <= n)
+    {
+        _mm256_storeu_ps(&y[i], _mm256_fmadd_ps(va, _mm256_loadu_ps(&x[i]), _mm256_loadu_ps(&y[i])));
+        i += 8;
+    }
+    for (; i < n; ++i)
+        y[i] += a * x[i];
+}
+
+__attribute__((target("avx2,fma")))
+static float dotf_avx2(int n, const float *x, const float *y)
+{
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(&x[i]), _mm256_loadu_ps(&y[i]), s0);
+        s1 = _mm256_fmadd_ps(_mm256_loadu_ps(&x[i + 8]), _mm256_loadu_ps(&y[i + 8]), s1);
+    }
+    if (i + 8 <= n)
+    {
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(&x[i]), _mm256_loadu_ps(&y[i]), s0);
+        i += 8;
+    }
+    s0 = _mm256_add_ps(s0, s1);
+    __m128 h = _mm_add_ps(_mm256_castps256_ps128(s0), _mm256_extractf128_ps(s0, 1));
+    h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+    float result = _mm_cvtss_f32(_mm_add_ss(h, _mm_shuffle_ps(h, h, 1)));
+    for (; i < n; ++i)
+        result += x[i] * y[i];
+    return result;
+}
+
+__attribute__((target("avx2,fma")))
+static inline void axpym_avx2_inline(int n, double a, const float *x, double *y)
+{
+    __m256d va = _mm256_set1_pd(a);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256d y0 = _mm256_fmadd_pd(va, _mm256_cvtps_pd(_mm_loadu_ps(&x[i])), _mm256_loadu_pd(&y[i]));
+        __m256d y1 = _mm256_fmadd_pd(va, _mm256_cvtps_pd(_mm_loadu_ps(&x[i + 4])), _mm256_loadu_pd(&y[i + 4]));
+        _mm256_storeu_pd(&y[i], y0);
+        _mm256_storeu_pd(&y[i + 4], y1);
+    }
+    if (i + 4 <= n)
+    {
+        _mm256_storeu_pd(&y[i], _mm256_fmadd_pd(va, _mm256_cvtps_pd(_mm_loadu_ps(&x[i])), _mm256_loadu_pd(&y[i])));
+        i += 4;
+    }
+    for (; i < n; ++i)
+        y[i] += a * x[i];
+}
+
+__attribute__((target("avx2,fma")))
+static void axpym_avx2(int n, double a, const float *x, double *y)
+{
+    axpym_avx2_inline(n, a, x, y);
+}
+
+__attribute__((target("avx2,fma")))
+static void germ_avx2(int m, int n, const float *x, const float *y, double *A)
+{
+    for (int i = 0; i < m; ++i, A += n)
+        axpym_avx2_inline(n, x[i], y, A);
+}
+
+/* The Super-SAB kernels select the factor of the learning rates with masks instead of branches.
+ * The products and differences must not be fused, so that the results match the scalar versions. */
+
+__attribute__((target("avx2,fma"))) KERNEL_NO_CONTRACT
+static void supersab_avx2(int n, double increase, double decrease, double *w, double *g, double *rates, double *former)
+{
+    const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.);
+    const __m256d inc = _mm256_set1_pd(increase), dec = _mm256_set1_pd(decrease);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256d gv = _mm256_loadu_pd(&g[i]);
+        __m256d p = _mm256_mul_pd(gv, _mm256_loadu_pd(&former[i]));
+        __m256d factor = _mm256_blendv_pd(one, dec, _mm256_cmp_pd(p, zero, _CMP_LT_OQ));
+        factor = _mm256_blendv_pd(factor, inc, _mm256_cmp_pd(p, zero, _CMP_GT_OQ));
+        __m256d r = _mm256_mul_pd(_mm256_loadu_pd(&rates[i]), factor);
+        _mm256_storeu_pd(&rates[i], r);
+        _mm256_storeu_pd(&w[i], _mm256_sub_pd(_mm256_loadu_pd(&w[i]), _mm256_mul_pd(r, gv)));
+        _mm256_storeu_pd(&former[i], gv);
+        _mm256_storeu_pd(&g[i], zero);
+    }
+    supersab_scalar(n - i, increase, decrease, &w[i], &g[i], &rates[i], &former[i]);
+}
+
+__attribute__((target("avx2,fma"))) KERNEL_NO_CONTRACT
+static void supersabm_avx2(int n, double increase, double decrease, float *w, double *g, float *rates, float *former)
+{
+    const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.);
+    const __m256d inc = _mm256_set1_pd(increase), dec = _mm256_set1_pd(decrease);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 gf = _mm256_cvtpd_ps(_mm256_loadu_pd(&g[i]));
+        /* The product of two floats is exact in double, so the comparisons can be done in double */
+        __m256d p = _mm256_cvtps_pd(_mm_mul_ps(gf, _mm_loadu_ps(&former[i])));
+        __m256d factor = _mm256_blendv_pd(one, dec, _mm256_cmp_pd(p, zero, _CMP_LT_OQ));
+        factor = _mm256_blendv_pd(factor, inc, _mm256_cmp_pd(p, zero, _CMP_GT_OQ));
+        __m128 r = _mm256_cvtpd_ps(_mm256_mul_pd(_mm256_cvtps_pd(_mm_loadu_ps(&rates[i])), factor));
+        _mm_storeu_ps(&rates[i], r);
+        _mm_storeu_ps(&w[i], _mm_sub_ps(_mm_loadu_ps(&w[i]), _mm_mul_ps(r, gf)));
+        _mm_storeu_ps(&former[i], gf);
+        _mm256_storeu_pd(&g[i], zero);
+    }
+    supersabm_scalar(n - i, increase, decrease, &w[i], &g[i], &rates[i], &former[i]);
+}
+
+__attribute__((target("avx2,fma")))
+static void adam_avx2(int n, double rate, double beta1, double beta2, double epsilon, double *w, double *g, double *m, double *v)
+{
+    const __m256d b1 = _mm256_set1_pd(beta1), c1 = _mm256_set1_pd(1. - beta1);
+    const __m256d b2 = _mm256_set1_pd(beta2), c2 = _mm256_set1_pd(1. - beta2);
+    const __m256d r = _mm256_set1_pd(rate), eps = _mm256_set1_pd(epsilon);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256d gv = _mm256_loadu_pd(&g[i]);
+        __m256d mv = _mm256_fmadd_pd(b1, _mm256_loadu_pd(&m[i]), _mm256_mul_pd(c1, gv));
+        __m256d vv = _mm256_fmadd_pd(b2, _mm256_loadu_pd(&v[i]), _mm256_mul_pd(c2, _mm256_mul_pd(gv, gv)));
+        __m256d d = _mm256_div_pd(_mm256_mul_pd(r, mv), _mm256_add_pd(_mm256_sqrt_pd(vv), eps));
+        _mm256_storeu_pd(&w[i], _mm256_sub_pd(_mm256_loadu_pd(&w[i]), d));
+        _mm256_storeu_pd(&m[i], mv);
+        _mm256_storeu_pd(&v[i], vv);
+        _mm256_storeu_pd(&g[i], _mm256_setzero_pd());
+    }
+    adam_scalar(n - i, rate, beta1, beta2, epsilon, &w[i], &g[i], &m[i], &v[i]);
+}
+
+__attribute__((target("avx2,fma")))
+static void rmsprop_avx2(int n, double rate, double decay, double epsilon, double *w, double *g, double *v)
+{
+    const __m256d b = _mm256_set1_pd(decay), c = _mm256_set1_pd(1. - decay);
+    const __m256d r = _mm256_set1_pd(rate), eps = _mm256_set1_pd(epsilon);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256d gv = _mm256_loadu_pd(&g[i]);
+        __m256d vv = _mm256_fmadd_pd(b, _mm256_loadu_pd(&v[i]), _mm256_mul_pd(c, _mm256_mul_pd(gv, gv)));
+        __m256d d = _mm256_div_pd(_mm256_mul_pd(r, gv), _mm256_add_pd(_mm256_sqrt_pd(vv), eps));
+        _mm256_storeu_pd(&w[i], _mm256_sub_pd(_mm256_loadu_pd(&w[i]), d));
+        _mm256_storeu_pd(&v[i], vv);
+        _mm256_storeu_pd(&g[i], _mm256_setzero_pd());
+    }
+    rmsprop_scalar(n - i, rate, decay, epsilon, &w[i], &g[i], &v[i]);
+}
+
+__attribute__((target("avx2,fma")))
+static void nesterov_avx2(int n, double rate, double momentum, double *w, double *g, double *v)
+{
+    const __m256d r = _mm256_set1_pd(rate), mu = _mm256_set1_pd(momentum), mu1 = _mm256_set1_pd(1. + momentum);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256d former = _mm256_loadu_pd(&v[i]);
+        __m256d vv = _mm256_fmsub_pd(mu, former, _mm256_mul_pd(r, _mm256_loadu_pd(&g[i])));
+        __m256d d = _mm256_fmsub_pd(mu1, vv, _mm256_mul_pd(mu, former));
+        _mm256_storeu_pd(&w[i], _mm256_add_pd(_mm256_loadu_pd(&w[i]), d));
+        _mm256_storeu_pd(&v[i], vv);
+        _mm256_storeu_pd(&g[i], _mm256_setzero_pd());
+    }
+    nesterov_scalar(n - i, rate, momentum, &w[i], &g[i], &v[i]);
+}
+
+__attribute__((target("avx2,fma")))
+static void rprop_avx2(int n, double increase, double decrease, double minStep, double maxStep,
+                       double *w, double *g, double *step, double *former)
+{
+    const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.);
+    const __m256d inc = _mm256_set1_pd(increase), dec = _mm256_set1_pd(decrease);
+    const __m256d lo = _mm256_set1_pd(minStep), hi = _mm256_set1_pd(maxStep);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256d gv = _mm256_loadu_pd(&g[i]);
+        __m256d p = _mm256_mul_pd(gv, _mm256_loadu_pd(&former[i]));
+        __m256d gt = _mm256_cmp_pd(p, zero, _CMP_GT_OQ), lt = _mm256_cmp_pd(p, zero, _CMP_LT_OQ);
+        __m256d d = _mm256_loadu_pd(&step[i]);
+        d = _mm256_blendv_pd(d, _mm256_min_pd(_mm256_mul_pd(d, inc), hi), gt);
+        d = _mm256_blendv_pd(d, _mm256_max_pd(_mm256_mul_pd(d, dec), lo), lt);
+        /* The gradient is forgotten when its sign changed */
+        gv = _mm256_andnot_pd(lt, gv);
+        __m256d sign = _mm256_blendv_pd(zero, one, _mm256_cmp_pd(gv, zero, _CMP_GT_OQ));
+        sign = _mm256_blendv_pd(sign, _mm256_set1_pd(-1.), _mm256_cmp_pd(gv, zero, _CMP_LT_OQ));
+        _mm256_storeu_pd(&w[i], _mm256_fnmadd_pd(sign, d, _mm256_loadu_pd(&w[i])));
+        _mm256_storeu_pd(&step[i], d);
+        _mm256_storeu_pd(&former[i], gv);
+        _mm256_storeu_pd(&g[i], zero);
+    }
+    rprop_scalar(n - i, increase, decrease, minStep, maxStep, &w[i], &g[i], &step[i], &former[i]);
+}
+
+__attribute__((target("avx2,fma")))
+static void tanh_fast_avx2(int n, double *x)
+{
+    const __m256d sign = _mm256_set1_pd(-0.), one = _mm256_set1_pd(1.);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256d v = _mm256_loadu_pd(&x[i]);
+        __m256d a = _mm256_andnot_pd(sign, v);
+        __m256d x2 = _mm256_mul_pd(v, v);
+        __m256d p = _mm256_set1_pd(tanh_series[4]);
+        for (int c = 3; c >= 0; --c)
+            p = _mm256_fmadd_pd(p, x2, _mm256_set1_pd(tanh_series[c]));
+        __m256d small = _mm256_fmadd_pd(_mm256_mul_pd(v, x2), p, v);
+        __m256d y = _mm256_mul_pd(_mm256_min_pd(a, _mm256_set1_pd(TANH_CLAMP)), _mm256_set1_pd(-2.));
+        __m256d k = _mm256_floor_pd(_mm256_fmadd_pd(y, _mm256_set1_pd(TANH_LOG2E), _mm256_set1_pd(0.5)));
+        __m256d r = _mm256_fnmadd_pd(k, _mm256_set1_pd(TANH_LN2_LO), _mm256_fnmadd_pd(k, _mm256_set1_pd(TANH_LN2_HI), y));
+        p = _mm256_set1_pd(tanh_exp[TANH_EXP_DEGREE]);
+        for (int c = TANH_EXP_DEGREE - 1; c >= 0; --c)
+            p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(tanh_exp[c]));
+        __m256i bits = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(k));
+        bits = _mm256_slli_epi64(_mm256_add_epi64(bits, _mm256_set1_epi64x(1023)), 52);
+        p = _mm256_mul_pd(p, _mm256_castsi256_pd(bits));
+        p = _mm256_div_pd(_mm256_sub_pd(one, p), _mm256_add_pd(one, p));
+        p = _mm256_or_pd(p, _mm256_and_pd(sign, v));
+        _mm256_storeu_pd(&x[i], _mm256_blendv_pd(p, small, _mm256_cmp_pd(a, _mm256_set1_pd(TANH_SMALL), _CMP_LT_OQ)));
+    }
+    for (; i < n; ++i)
+        x[i] = tanh_fast_single(x[i]);
+}
+
+/* AVX-512 versions */
+
+/* The unmasked forms of some conversions and operations take an undefined source, which GCC 12 reports
+ * once inlined (-Wmaybe-uninitialized): their zero-masking forms are used with a full mask instead */
+#define KERNEL_ALL8 ((__mmask8) 0xFF)
+
+__attribute__((target("avx512f")))
+static inline void axpy_avx512_inline(int n, double a, const double *x, double *y)
+{
+    __m512d va = _mm512_set1_pd(a);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512d y0 = _mm512_fmadd_pd(va, _mm512_loadu_pd(&x[i]), _mm512_loadu_pd(&y[i]));
+        __m512d y1 = _mm512_fmadd_pd(va, _mm512_loadu_pd(&x[i + 8]), _mm512_loadu_pd(&y[i + 8]));
+        _mm512_storeu_pd(&y[i], y0);
+        _mm512_storeu_pd(&y[i + 8], y1);
+    }
+    if (i < n)
+    {
+        /* Masked tail */
+        __mmask8 mask = (n - i >= 8) ? (__mmask8) 0xFF : (__mmask8) ((1 << (n - i)) - 1);
+        __m512d y0 = _mm512_fmadd_pd(va, _mm512_maskz_loadu_pd(mask, &x[i]), _mm512_maskz_loadu_pd(mask, &y[i]));
+        _mm512_mask_storeu_pd(&y[i], mask, y0);
+        i += 8;
+        if (i < n)
+        {
+            mask = (__mmask8) ((1 << (n - i)) - 1);
+            y0 = _mm512_fmadd_pd(va, _mm512_maskz_loadu_pd(mask, &x[i]), _mm512_maskz_loadu_pd(mask, &y[i]));
+            _mm512_mask_storeu_pd(&y[i], mask, y0);
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+static void axpy_avx512(int n, double a, const double *x, double *y)
+{
+    axpy_avx512_inline(n, a, x, y);
+}
+
+__attribute__((target("avx512f")))
+static double dot_avx512(int n, const double *x, const double *y)
+{
+    __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        s0 = _mm512_fmadd_pd(_mm512_loadu_pd(&x[i]), _mm512_loadu_pd(&y[i]), s0);
+        s1 = _mm512_fmadd_pd(_mm512_loadu_pd(&x[i + 8]), _mm512_loadu_pd(&y[i + 8]), s1);
+    }
+    for (; i < n; i += 8)
+    {
+        __mmask8 mask = (n - i >= 8) ? (__mmask8) 0xFF : (__mmask8) ((1 << (n - i)) - 1);
+        s0 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(mask, &x[i]), _mm512_maskz_loadu_pd(mask, &y[i]), s0);
+    }
+    double tmp[8];
+    _mm512_storeu_pd(tmp, _mm512_add_pd(s0, s1));
+    return ((tmp[0] + tmp[4]) + (tmp[1] + tmp[5])) + ((tmp[2] + tmp[6]) + (tmp[3] + tmp[7]));
+}
+
+__attribute__((target("avx512f")))
+static void ger_avx512(int m, int n, const double *x, const double *y, double *A)
+{
+    for (int i = 0; i < m; ++i, A += n)
+        axpy_avx512_inline(n, x[i], y, A);
+}
+
+__attribute__((target("avx512f")))
+static void axpyf_avx512(int n, float a, const float *x, float *y)
+{
+    __m512 va = _mm512_set1_ps(a);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+        _mm512_storeu_ps(&y[i], _mm512_fmadd_ps(va, _mm512_loadu_ps(&x[i]), _mm512_loadu_ps(&y[i])));
+    if (i < n)
+    {
+        __mmask16 mask = (__mmask16) ((1 << (n - i)) - 1);
+        __m512 y0 = _mm512_fmadd_ps(va, _mm512_maskz_loadu_ps(mask, &x[i]), _mm512_maskz_loadu_ps(mask, &y[i]));
+        _mm512_mask_storeu_ps(&y[i], mask, y0);
+    }
+}
+
+__attribute__((target("avx512f")))
+static float dotf_avx512(int n, const float *x, const float *y)
+{
+    __m512 s0 = _mm512_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+        s0 = _mm512_fmadd_ps(_mm512_loadu_ps(&x[i]), _mm512_loadu_ps(&y[i]), s0);
+    if (i < n)
+    {
+        __mmask16 mask = (__mmask16) ((1 << (n - i)) - 1);
+        s0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, &x[i]), _mm512_maskz_loadu_ps(mask, &y[i]), s0);
+    }
+    float tmp[16];
+    _mm512_storeu_ps(tmp, s0);
+    for (i = 0; i < 8; ++i)
+        tmp[i] += tmp[i + 8];
+    return ((tmp[0] + tmp[4]) + (tmp[1] + tmp[5])) + ((tmp[2] + tmp[6]) + (tmp[3] + tmp[7]));
+}
+
+__attribute__((target("avx512f")))
+static inline void axpym_avx512_inline(int n, double a, const float *x, double *y)
+{
+    __m512d va = _mm512_set1_pd(a);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m512d y0 = _mm512_fmadd_pd(va, _mm512_maskz_cvtps_pd(KERNEL_ALL8, _mm256_loadu_ps(&x[i])), _mm512_loadu_pd(&y[i]));
+        _mm512_storeu_pd(&y[i], y0);
+    }
+    if (i < n)
+    {
+        /* Masked tail, the floats being loaded with a 16-bit mask */
+        __mmask8 mask = (__mmask8) ((1 << (n - i)) - 1);
+        __m512 x16 = _mm512_maskz_loadu_ps((__mmask16) mask, &x[i]);
+        __m256 x0 = _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(KERNEL_ALL8, _mm512_castps_pd(x16), 0));
+        __m512d y0 = _mm512_fmadd_pd(va, _mm512_maskz_cvtps_pd(KERNEL_ALL8, x0), _mm512_maskz_loadu_pd(mask, &y[i]));
+        _mm512_mask_storeu_pd(&y[i], mask, y0);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void axpym_avx512(int n, double a, const float *x, double *y)
+{
+    axpym_avx512_inline(n, a, x, y);
+}
+
+__attribute__((target("avx512f")))
+static void germ_avx512(int m, int n, const float *x, const float *y, double *A)
+{
+    for (int i = 0; i < m; ++i, A += n)
+        axpym_avx512_inline(n, x[i], y, A);
+}
+
+__attribute__((target("avx512f"))) KERNEL_NO_CONTRACT
+static void supersab_avx512(int n, double increase, double decrease, double *w, double *g, double *rates, double *former)
+{
+    const __m512d zero = _mm512_setzero_pd(), one = _mm512_set1_pd(1.);
+    const __m512d inc = _mm512_set1_pd(increase), dec = _mm512_set1_pd(decrease);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m512d gv = _mm512_loadu_pd(&g[i]);
+        __m512d p = _mm512_mul_pd(gv, _mm512_loadu_pd(&former[i]));
+        __m512d factor = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(p, zero, _CMP_LT_OQ), one, dec);
+        factor = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(p, zero, _CMP_GT_OQ), factor, inc);
+        __m512d r = _mm512_mul_pd(_mm512_loadu_pd(&rates[i]), factor);
+        _mm512_storeu_pd(&rates[i], r);
+        _mm512_storeu_pd(&w[i], _mm512_sub_pd(_mm512_loadu_pd(&w[i]), _mm512_mul_pd(r, gv)));
+        _mm512_storeu_pd(&former[i], gv);
+        _mm512_storeu_pd(&g[i], zero);
+    }
+    supersab_scalar(n - i, increase, decrease, &w[i], &g[i], &rates[i], &former[i]);
+}
+
+__attribute__((target("avx512f"))) KERNEL_NO_CONTRACT
+static void supersabm_avx512(int n, double increase, double decrease, float *w, double *g, float *rates, float *former)
+{
+    const __m512d zero = _mm512_setzero_pd(), one = _mm512_set1_pd(1.);
+    const __m512d inc = _mm512_set1_pd(increase), dec = _mm512_set1_pd(decrease);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 gf = _mm512_maskz_cvtpd_ps(KERNEL_ALL8, _mm512_loadu_pd(&g[i]));
+        __m512d p = _mm512_maskz_cvtps_pd(KERNEL_ALL8, _mm256_mul_ps(gf, _mm256_loadu_ps(&former[i])));
+        __m512d factor = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(p, zero, _CMP_LT_OQ), one, dec);
+        factor = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(p, zero, _CMP_GT_OQ), factor, inc);
+        __m256 r = _mm512_maskz_cvtpd_ps(KERNEL_ALL8, _mm512_mul_pd(_mm512_maskz_cvtps_pd(KERNEL_ALL8, _mm256_loadu_ps(&rates[i])), factor));
+        _mm256_storeu_ps(&rates[i], r);
+        _mm256_storeu_ps(&w[i], _mm256_sub_ps(_mm256_loadu_ps(&w[i]), _mm256_mul_ps(r, gf)));
+        _mm256_storeu_ps(&former[i], gf);
+        _mm512_storeu_pd(&g[i], zero);
+    }
+    supersabm_scalar(n - i, increase, decrease, &w[i], &g[i], &rates[i], &former[i]);
+}
+
+__attribute__((target("avx512f")))
+static void adam_avx512(int n, double rate, double beta1, double beta2, double epsilon, double *w, double *g, double *m, double *v)
+{
+    const __m512d b1 = _mm512_set1_pd(beta1), c1 = _mm512_set1_pd(1. - beta1);
+    const __m512d b2 = _mm512_set1_pd(beta2), c2 = _mm512_set1_pd(1. - beta2);
+    const __m512d r = _mm512_set1_pd(rate), eps = _mm512_set1_pd(epsilon);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m512d gv = _mm512_loadu_pd(&g[i]);
+        __m512d mv = _mm512_fmadd_pd(b1, _mm512_loadu_pd(&m[i]), _mm512_mul_pd(c1, gv));
+        __m512d vv = _mm512_fmadd_pd(b2, _mm512_loadu_pd(&v[i]), _mm512_mul_pd(c2, _mm512_mul_pd(gv, gv)));
+        __m512d d = _mm512_div_pd(_mm512_mul_pd(r, mv), _mm512_add_pd(_mm512_maskz_sqrt_pd(KERNEL_ALL8, vv), eps));
+        _mm512_storeu_pd(&w[i], _mm512_sub_pd(_mm512_loadu_pd(&w[i]), d));
+        _mm512_storeu_pd(&m[i], mv);
+        _mm512_storeu_pd(&v[i], vv);
+        _mm512_storeu_pd(&g[i], _mm512_setzero_pd());
+    }
+    adam_scalar(n - i, rate, beta1, beta2, epsilon, &w[i], &g[i], &m[i], &v[i]);
+}
+
+__attribute__((target("avx512f")))
+static void rmsprop_avx512(int n, double rate, double decay, double epsilon, double *w, double *g, double *v)
+{
+    const __m512d b = _mm512_set1_pd(decay), c = _mm512_set1_pd(1. - decay);
+    const __m512d r = _mm512_set1_pd(rate), eps = _mm512_set1_pd(epsilon);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m512d gv = _mm512_loadu_pd(&g[i]);
+        __m512d vv = _mm512_fmadd_pd(b, _mm512_loadu_pd(&v[i]), _mm512_mul_pd(c, _mm512_mul_pd(gv, gv)));
+        __m512d d = _mm512_div_pd(_mm512_mul_pd(r, gv), _mm512_add_pd(_mm512_maskz_sqrt_pd(KERNEL_ALL8, vv), eps));
+        _mm512_storeu_pd(&w[i], _mm512_sub_pd(_mm512_loadu_pd(&w[i]), d));
+        _mm512_storeu_pd(&v[i], vv);
+        _mm512_storeu_pd(&g[i], _mm512_setzero_pd());
+    }
+    rmsprop_scalar(n - i, rate, decay, epsilon, &w[i], &g[i], &v[i]);
+}
+
+__attribute__((target("avx512f")))
+static void nesterov_avx512(int n, double rate, double momentum, double *w, double *g, double *v)
+{
+    const __m512d r = _mm512_set1_pd(rate), mu = _mm512_set1_pd(momentum), mu1 = _mm512_set1_pd(1. + momentum);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m512d former = _mm512_loadu_pd(&v[i]);
+        __m512d vv = _mm512_fmsub_pd(mu, former, _mm512_mul_pd(r, _mm512_loadu_pd(&g[i])));
+        __m512d d = _mm512_fmsub_pd(mu1, vv, _mm512_mul_pd(mu, former));
+        _mm512_storeu_pd(&w[i], _mm512_add_pd(_mm512_loadu_pd(&w[i]), d));
+        _mm512_storeu_pd(&v[i], vv);
+        _mm512_storeu_pd(&g[i], _mm512_setzero_pd());
+    }
+    nesterov_scalar(n - i, rate, momentum, &w[i], &g[i], &v[i]);
+}
+
+__attribute__((target("avx512f")))
+static void rprop_avx512(int n, double increase, double decrease, double minStep, double maxStep,
+                         double *w, double *g, double *step, double *former)
+{
+    const __m512d zero = _mm512_setzero_pd(), one = _mm512_set1_pd(1.);
+    const __m512d inc = _mm512_set1_pd(increase), dec = _mm512_set1_pd(decrease);
+    const __m512d lo = _mm512_set1_pd(minStep), hi = _mm512_set1_pd(maxStep);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m512d gv = _mm512_loadu_pd(&g[i]);
+        __m512d p = _mm512_mul_pd(gv, _mm512_loadu_pd(&former[i]));
+        __mmask8 gt = _mm512_cmp_pd_mask(p, zero, _CMP_GT_OQ), lt = _mm512_cmp_pd_mask(p, zero, _CMP_LT_OQ);
+        __m512d d = _mm512_loadu_pd(&step[i]);
+        d = _mm512_mask_blend_pd(gt, d, _mm512_maskz_min_pd(KERNEL_ALL8, _mm512_mul_pd(d, inc), hi));
+        d = _mm512_mask_blend_pd(lt, d, _mm512_maskz_max_pd(KERNEL_ALL8, _mm512_mul_pd(d, dec), lo));
+        gv = _mm512_mask_blend_pd(lt, gv, zero);
+        __m512d sign = _mm512_maskz_mov_pd(_mm512_cmp_pd_mask(gv, zero, _CMP_GT_OQ), one);
+        sign = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(gv, zero, _CMP_LT_OQ), sign, _mm512_set1_pd(-1.));
+        _mm512_storeu_pd(&w[i], _mm512_fnmadd_pd(sign, d, _mm512_loadu_pd(&w[i])));
+        _mm512_storeu_pd(&step[i], d);
+        _mm512_storeu_pd(&former[i], gv);
+        _mm512_storeu_pd(&g[i], zero);
+    }
+    rprop_scalar(n - i, increase, decrease, minStep, maxStep, &w[i], &g[i], &step[i], &former[i]);
+}
+
+__attribute__((target("avx512f")))
+static void tanh_fast_avx512(int n, double *x)
+{
+    const __m512i sign = _mm512_set1_epi64(0x8000000000000000LL);
+    const __m512d one = _mm512_set1_pd(1.);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m512d v = _mm512_loadu_pd(&x[i]);
+        __m512d a = _mm512_abs_pd(v);
+        __m512d x2 = _mm512_mul_pd(v, v);
+        __m512d p = _mm512_set1_pd(tanh_series[4]);
+        for (int c = 3; c >= 0; --c)
+            p = _mm512_fmadd_pd(p, x2, _mm512_set1_pd(tanh_series[c]));
+        __m512d small = _mm512_fmadd_pd(_mm512_mul_pd(v, x2), p, v);
+        __m512d y = _mm512_mul_pd(_mm512_maskz_min_pd(KERNEL_ALL8, a, _mm512_set1_pd(TANH_CLAMP)), _mm512_set1_pd(-2.));
+        __m512d k = _mm512_maskz_roundscale_pd(KERNEL_ALL8, _mm512_fmadd_pd(y, _mm512_set1_pd(TANH_LOG2E), _mm512_set1_pd(0.5)),
+                                         _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+        __m512d r = _mm512_fnmadd_pd(k, _mm512_set1_pd(TANH_LN2_LO), _mm512_fnmadd_pd(k, _mm512_set1_pd(TANH_LN2_HI), y));
+        p = _mm512_set1_pd(tanh_exp[TANH_EXP_DEGREE]);
+        for (int c = TANH_EXP_DEGREE - 1; c >= 0; --c)
+            p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(tanh_exp[c]));
+        __m512i bits = _mm512_maskz_cvtepi32_epi64(KERNEL_ALL8, _mm512_maskz_cvtpd_epi32(KERNEL_ALL8, k));
+        bits = _mm512_maskz_slli_epi64(KERNEL_ALL8, _mm512_add_epi64(bits, _mm512_set1_epi64(1023)), 52);
+        p = _mm512_mul_pd(p, _mm512_castsi512_pd(bits));
+        p = _mm512_div_pd(_mm512_sub_pd(one, p), _mm512_add_pd(one, p));
+        p = _mm512_castsi512_pd(_mm512_or_si512(_mm512_castpd_si512(p), _mm512_and_si512(sign, _mm512_castpd_si512(v))));
+        __mmask8 mask = _mm512_cmp_pd_mask(a, _mm512_set1_pd(TANH_SMALL), _CMP_LT_OQ);
+        _mm512_storeu_pd(&x[i], _mm512_mask_blend_pd(mask, p, small));
+    }
+    for (; i < n; ++i)
+        x[i] = tanh_fast_single(x[i]);
+}
+
+#endif
+
+/* Runtime dispatch: the best version available on the CPU is selected before main(), by kernel_selection,
+ * so that the function pointers are never written while several threads use them. They start on the
+ * resolvers, which only run if a kernel is called by a static initializer before that. */
+
+static void axpy_resolve(int n, double a, const double *x, double *y);
+static double dot_resolve(int n, const double *x, const double *y);
+static void ger_resolve(int m, int n, const double *x, const double *y, double *A);
+static void dot_rows_resolve(int n, const double *w, const int *start, const double *x, const int *index, double *sums);
+static void dot_cols_resolve(int n, const double *w, const int *offset, const double *x, const int *index, double *sums);
+static void dot_samples_resolve(int n, const double *w, const int *offset, const double *x, int stride, const int *index,
+                                int count, double *sums);
+static void ger_rows_resolve(int n, double *y, const int *start, int count, int stride,
+                             const double *x, const int *index, const double *a);
+static void tanh_fast_resolve(int n, double *x);
+static void axpyf_resolve(int n, float a, const float *x, float *y);
+static float dotf_resolve(int n, const float *x, const float *y);
+static void axpym_resolve(int n, double a, const float *x, double *y);
+static void germ_resolve(int m, int n, const float *x, const float *y, double *A);
+static void supersab_resolve(int n, double increase, double decrease, double *w, double *g, double *rates, double *former);
+static void supersabm_resolve(int n, double increase, double decrease, float *w, double *g, float *rates, float *former);
+static void adam_resolve(int n, double rate, double beta1, double beta2, double epsilon, double *w, double *g, double *m, double *v);
+static void rmsprop_resolve(int n, double rate, double decay, double epsilon, double *w, double *g, double *v);
+static void nesterov_resolve(int n, double rate, double momentum, double *w, double *g, double *v);
+static void rprop_resolve(int n, double increase, double decrease, double minStep, double maxStep,
+                          double *w, double *g, double *step, double *former);
+
+static void (*axpy_ptr)(int, double, const double*, double*) = axpy_resolve;
+static double (*dot_ptr)(int, const double*, const double*) = dot_resolve;
+static void (*ger_ptr)(int, int, const double*, const double*, double*) = ger_resolve;
+static void (*dot_rows_ptr)(int, const double*, const int*, const double*, const int*, double*) = dot_rows_resolve;
+static void (*dot_cols_ptr)(int, const double*, const int*, const double*, const int*, double*) = dot_cols_resolve;
+static void (*dot_samples_ptr)(int, const double*, const int*, const double*, int, const int*, int, double*) = dot_samples_resolve;
+static void (*ger_rows_ptr)(int, double*, const int*, int, int, const double*, const int*, const double*) = ger_rows_resolve;
+static void (*tanh_fast_ptr)(int, double*) = tanh_fast_resolve;
+static void (*axpyf_ptr)(int, float, const float*, float*) = axpyf_resolve;
+static float (*dotf_ptr)(int, const float*, const float*) = dotf_resolve;
+static void (*axpym_ptr)(int, double, const float*, double*) = axpym_resolve;
+static void (*germ_ptr)(int, int, const float*, const float*, double*) = germ_resolve;
+static void (*supersab_ptr)(int, double, double, double*, double*, double*, double*) = supersab_resolve;
+static void (*supersabm_ptr)(int, double, double, float*, double*, float*, float*) = supersabm_resolve;
+static void (*adam_ptr)(int, double, double, double, double, double*, double*, double*, double*) = adam_resolve;
+static void (*rmsprop_ptr)(int, double, double, double, double*, double*, double*) = rmsprop_resolve;
+static void (*nesterov_ptr)(int, double, double, double*, double*, double*) = nesterov_resolve;
+static void (*rprop_ptr)(int, double, double, double, double, double*, double*, double*, double*) = rprop_resolve;
+static int current_level = -1;
+
+static int detect_level()
+{
+#if KERNEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return KERNEL_AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return KERNEL_AVX2;
+#endif
+    return KERNEL_SCALAR;
+}
+
+static void select_level(int level)
+{
+    switch (level)
+    {
+#if KERNEL_X86
+    case KERNEL_AVX512:
+        axpy_ptr = axpy_avx512;
+        dot_ptr = dot_avx512;
+        ger_ptr = ger_avx512;
+        /* Eight rows fill two AVX2 registers */
+        dot_rows_ptr = dot_rows_avx2;
+        dot_cols_ptr = dot_cols_avx2;
+        dot_samples_ptr = dot_samples_avx2;
+        ger_rows_ptr = ger_rows_avx2;
+        tanh_fast_ptr = tanh_fast_avx512;
+        axpyf_ptr = axpyf_avx512;
+        dotf_ptr = dotf_avx512;
+        axpym_ptr = axpym_avx512;
+        germ_ptr = germ_avx512;
+        supersab_ptr = supersab_avx512;
+        supersabm_ptr = supersabm_avx512;
+        adam_ptr = adam_avx512;
+        rmsprop_ptr = rmsprop_avx512;
+        nesterov_ptr = nesterov_avx512;
+        rprop_ptr = rprop_avx512;
+        break;
+    case KERNEL_AVX2:
+        axpy_ptr = axpy_avx2;
+        dot_ptr = dot_avx2;
+        ger_ptr = ger_avx2;
+        dot_rows_ptr = dot_rows_avx2;
+        dot_cols_ptr = dot_cols_avx2;
+        dot_samples_ptr = dot_samples_avx2;
+        ger_rows_ptr = ger_rows_avx2;
+        tanh_fast_ptr = tanh_fast_avx2;
+        axpyf_ptr = axpyf_avx2;
+        dotf_ptr = dotf_avx2;
+        axpym_ptr = axpym_avx2;
+        germ_ptr = germ_avx2;
+        supersab_ptr = supersab_avx2;
+        supersabm_ptr = supersabm_avx2;
+        adam_ptr = adam_avx2;
+        rmsprop_ptr = rmsprop_avx2;
+        nesterov_ptr = nesterov_avx2;
+        rprop_ptr = rprop_avx2;
+        break;
+#endif
+    default:
+        level = KERNEL_SCALAR;
+        axpy_ptr = axpy_scalar;
+        dot_ptr = dot_scalar;
+        ger_ptr = ger_scalar;
+        dot_rows_ptr = dot_rows_scalar;
+        dot_cols_ptr = dot_cols_scalar;
+        dot_samples_ptr = dot_samples_scalar;
+        ger_rows_ptr = ger_rows_scalar;
+        tanh_fast_ptr = tanh_fast_scalar;
+        axpyf_ptr = axpyf_scalar;
+        dotf_ptr = dotf_scalar;
+        axpym_ptr = axpym_scalar;
+        germ_ptr = germ_scalar;
+        supersab_ptr = supersab_scalar;
+        supersabm_ptr = supersabm_scalar;
+        adam_ptr = adam_scalar;
+        rmsprop_ptr = rmsprop_scalar;
+        nesterov_ptr = nesterov_scalar;
+        rprop_ptr = rprop_scalar;
+    }
+    current_level = level;
+}
+
+static void axpy_resolve(int n, double a, const double *x, double *y)
+{
+    select_level(detect_level());
+    axpy_ptr(n, a, x, y);
+}
+
+static double dot_resolve(int n, const double *x, const double *y)
+{
+    select_level(detect_level());
+    return dot_ptr(n, x, y);
+}
+
+static void ger_resolve(int m, int n, const double *x, const double *y, double *A)
+{
+    select_level(detect_level());
+    ger_ptr(m, n, x, y, A);
+}
+
+static void dot_rows_resolve(int n, const double *w, const int *start, const double *x, const int *index, double *sums)
+{
+    select_level(detect_level());
+    dot_rows_ptr(n, w, start, x, index, sums);
+}
+
+static void dot_cols_resolve(int n, const double *w, const int *offset, const double *x, const int *index, double *sums)
+{
+    select_level(detect_level());
+    dot_cols_ptr(n, w, offset, x, index, sums);
+}
+
+static void dot_samples_resolve(int n, const double *w, const int *offset, const double *x, int stride, const int *index,
+                                int count, double *sums)
+{
+    select_level(detect_level());
+    dot_samples_ptr(n, w, offset, x, stride, index, count, sums);
+}
+
+static void ger_rows_resolve(int n, double *y, const int *start, int count, int stride,
+                             const double *x, const int *index, const double *a)
+{
+    select_level(detect_level());
+    ger_rows_ptr(n, y, start, count, stride, x, index, a);
+}
+
+static void tanh_fast_resolve(int n, double *x)
+{
+    select_level(detect_level());
+    tanh_fast_ptr(n, x);
+}
+
+static void axpyf_resolve(int n, float a, const float *x, float *y)
+{
+    select_level(detect_level());
+    axpyf_ptr(n, a, x, y);
+}
+
+static float dotf_resolve(int n, const float *x, const float *y)
+{
+    select_level(detect_level());
+    return dotf_ptr(n, x, y);
+}
+
+static void axpym_resolve(int n, double a, const float *x, double *y)
+{
+    select_level(detect_level());
+    axpym_ptr(n, a, x, y);
+}
+
+static void germ_resolve(int m, int n, const float *x, const float *y, double *A)
+{
+    select_level(detect_level());
+    germ_ptr(m, n, x, y, A);
+}
+
+static void supersab_resolve(int n, double increase, double decrease, double *w, double *g, double *rates, double *former)
+{
+    select_level(detect_level());
+    supersab_ptr(n, increase, decrease, w, g, rates, former);
+}
+
+static void supersabm_resolve(int n, double increase, double decrease, float *w, double *g, float *rates, float *former)
+{
+    select_level(detect_level());
+    supersabm_ptr(n, increase, decrease, w, g, rates, former);
+}
+
+static void adam_resolve(int n, double rate, double beta1, double beta2, double epsilon, double *w, double *g, double *m, double *v)
+{
+    select_level(detect_level());
+    adam_ptr(n, rate, beta1, beta2, epsilon, w, g, m, v);
+}
+
+static void rmsprop_resolve(int n, double rate, double decay, double epsilon, double *w, double *g, double *v)
+{
+    select_level(detect_level());
+    rmsprop_ptr(n, rate, decay, epsilon, w, g, v);
+}
+
+static void nesterov_resolve(int n, double rate, double momentum, double *w, double *g, double *v)
+{
+    select_level(detect_level());
+    nesterov_ptr(n, rate, momentum, w, g, v);
+}
+
+static void rprop_resolve(int n, double increase, double decrease, double minStep, double maxStep,
+                          double *w, double *g, double *step, double *former)
+{
+    select_level(detect_level());
+    rprop_ptr(n, increase, decrease, minStep, maxStep, w, g, step, former);
+}
+
+/* Selection of the kernels, before main() */
+static struct KernelSelection
+{
+    KernelSelection()
+    {
+        if (current_level < 0)
+            select_level(detect_level());
+    }
+} kernel_selection;
+
+/* Table of kernel_tanh_table, filled before main() */
+static struct TanhTable
+{
+    double values[KERNEL_TANH_TABLE_SIZE + 2];
+    TanhTable()
+    {
+        for (int i = KERNEL_TANH_TABLE_SIZE + 1; i >= 0; --i)
+            values[i] = tanh(i * (KERNEL_TANH_TABLE_MAX / KERNEL_TANH_TABLE_SIZE));
+    }
+} tanh_table;
+
+/*!
+    \relates BasicPerceptron
+
+    Adds \a a times the vector \a x to the vector \a y, both of size \a n.
+
+    The fastest version supported by the CPU (AVX-512, AVX2 or scalar) is selected when the program starts.
+*/
+void kernel_axpy(int n, double a, const double *x, double *y)
+{
+    axpy_ptr(n, a, x, y);
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Returns the dot product of the vectors \a x and \a y, both of size \a n.
+*/
+double kernel_dot(int n, const double *x, const double *y)
+{
+    return dot_ptr(n, x, y);
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Adds the outer product of \a x (size \a m) and \a y (size \a n) to the
+    row-major matrix \a A of size (\a m, \a n).
+
+    This is the gradient update of a layer, \a A having the layout of the Perceptron weights.
+*/
+void kernel_ger(int m, int n, const double *x, const double *y, double *A)
+{
+    ger_ptr(m, n, x, y, A);
+}
+
+/*!
+    \relates BrainPlan
+
+    Adds to each of the \c KERNEL_ROWS values of \a sums the dot product of the row \c r of \a w,
+    made of the \a n values starting at \a w [\a start [\c r]], and of the values of \a x
+    given by \a index: \a sums [\c r] += \a w [\a start [\c r] + \c k] * \a x [\a index [\c k]].
+
+    The rows are computed in parallel, but the additions of each row are made one after the other,
+    in the order of \c k and without FMA, so the results are those of a plain loop
+    whatever the instruction set.
+*/
+void kernel_dot_rows(int n, const double *w, const int *start, const double *x, const int *index, double *sums)
+{
+    dot_rows_ptr(n, w, start, x, index, sums);
+}
+
+/*!
+    \relates BrainPlan
+
+    Adds to each of the \c KERNEL_ROWS values of \a sums the dot product of the column \c r of \a w,
+    made of the \a n values \a w [\a offset [\c k] + \c r], and of the values of \a x given by \a index:
+    \a sums [\c r] += \a w [\a offset [\c k] + \c r] * \a x [\a index [\c k]].
+
+    This is kernel_dot_rows() for the transposed matrix, whose columns are read
+    \c KERNEL_ROWS values at a time; the results are the same whatever the instruction set.
+*/
+void kernel_dot_cols(int n, const double *w, const int *offset, const double *x, const int *index, double *sums)
+{
+    dot_cols_ptr(n, w, offset, x, index, sums);
+}
+
+/*!
+    \relates BrainPlan
+
+    Adds to each of the \a count values of \a sums the dot product of the \a n weights of \a w given by
+    \a offset (or the first \a n ones if \a offset is \c NULL) and of the values of a sample given by \a index,
+    the values of the samples being \a stride apart in \a x:
+    \a sums [\c s] += \a w [\a offset [\c k]] * \a x [\c s * \a stride + \a index [\c k]].
+
+    This is the product of a sparse row by several vectors at once: each weight is loaded once for all
+    the samples, and each sample is summed in the order of \c k, so the results are the same whatever
+    the instruction set.
+*/
+void kernel_dot_samples(int n, const double *w, const int *offset, const double *x, int stride, const int *index,
+                        int count, double *sums)
+{
+    dot_samples_ptr(n, w, offset, x, stride, index, count, sums);
+}
+
+/*!
+    \relates BrainPlan
+
+    Adds to each of the \c KERNEL_ROWS rows of \a y, made of the \a n values starting at
+    \a y [\a start [\c r]], the products of \a a [\c r] and of the values of \a x given by \a index,
+    for \a count samples whose values are \a stride apart in \a x and \a a:
+    \a y [\a start [\c r] + \c k] += \a x [\c s * \a stride + \a index [\c k]] * \a a [\c s * \a stride + \c r].
+
+    Each value of \a y is loaded once and receives the samples one after the other, so the results
+    are those of a loop over the samples, whatever the instruction set.
+*/
+void kernel_ger_rows(int n, double *y, const int *start, int count, int stride,
+                     const double *x, const int *index, const double *a)
+{
+    ger_rows_ptr(n, y, start, count, stride, x, index, a);
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Replaces each of the \a n values of \a x by its hyperbolic tangent, using the \c tanh function of libm.
+*/
+void kernel_tanh(int n, double *x)
+{
+    for (int i = 0; i < n; ++i)
+        x[i] = tanh(x[i]);
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Replaces each of the \a n values of \a x by its hyperbolic tangent, using a vectorized approximation:
+    an odd polynomial near zero, and a rational function of a polynomial approximation of \c exp elsewhere.
+
+    \note The maximal relative error is about 1e-15 (a few ulp), and the values whose
+    absolute value is greater than 20 are rounded to -1 or 1.
+*/
+void kernel_tanh_fast(int n, double *x)
+{
+    tanh_fast_ptr(n, x);
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Replaces each of the \a n values of \a x by its hyperbolic tangent, using a linear interpolation
+    in a table of \c KERNEL_TANH_TABLE_SIZE values covering [0, \c KERNEL_TANH_TABLE_MAX].
+
+    \note The maximal absolute error is about 4e-7.
+*/
+void kernel_tanh_table(int n, double *x)
+{
+    const double scale = KERNEL_TANH_TABLE_SIZE / KERNEL_TANH_TABLE_MAX;
+    const double *values = tanh_table.values;
+    double a, f, t;
+    int j;
+    for (int i = 0; i < n; ++i)
+    {
+        a = fabs(x[i]);
+        if (a >= KERNEL_TANH_TABLE_MAX)
+        {
+            t = 1.;
+        } else {
+            f = a * scale;
+            j = (int) f;
+            f -= j;
+            t = values[j] + f * (values[j + 1] - values[j]);
+        }
+        x[i] = (x[i] < 0) ? -t : t;
+    }
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Single-precision version of kernel_axpy().
+*/
+void kernel_axpy(int n, float a, const float *x, float *y)
+{
+    axpyf_ptr(n, a, x, y);
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Mixed-precision version of kernel_axpy(), accumulating the single-precision vector \a x
+    into the double-precision vector \a y.
+*/
+void kernel_axpy(int n, double a, const float *x, double *y)
+{
+    axpym_ptr(n, a, x, y);
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Single-precision version of kernel_dot().
+*/
+float kernel_dot(int n, const float *x, const float *y)
+{
+    return dotf_ptr(n, x, y);
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Mixed-precision version of kernel_ger(), accumulating the outer product of the
+    single-precision vectors \a x and \a y into the double-precision matrix \a A.
+*/
+void kernel_ger(int m, int n, const float *x, const float *y, double *A)
+{
+    germ_ptr(m, n, x, y, A);
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Applies the Super-SAB rule to the \a n weights \a w, given their gradient \a g,
+    their learning rates \a rates and their previous gradient \a former.
+
+    Each learning rate is multiplied by \a increase if the gradient kept its sign,
+    and by \a decrease if it changed; the weight is then moved by the opposite of
+    the learning rate times the gradient. Finally, \a g is copied to \a former and reset to zero.
+
+    The factor of each learning rate is selected with masks instead of branches, and
+    the results are the same whatever the instruction set.
+*/
+void kernel_supersab(int n, double increase, double decrease, double *w, double *g, double *rates, double *former)
+{
+    supersab_ptr(n, increase, decrease, w, g, rates, former);
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Single-precision version of kernel_supersab(), the gradient \a g being accumulated in double precision.
+*/
+void kernel_supersab(int n, double increase, double decrease, float *w, double *g, float *rates, float *former)
+{
+    supersabm_ptr(n, increase, decrease, w, g, rates, former);
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Applies the Adam rule to the \a n weights \a w, given their gradient \a g and their
+    first and second moment estimates \a m and \a v, and resets \a g to zero.
+
+    \a rate is the learning rate, already corrected for the bias of the moment estimates,
+    \a beta1 and \a beta2 the decay rates of the moments and \a epsilon the term
+    that prevents the divisions by zero.
+*/
+void kernel_adam(int n, double rate, double beta1, double beta2, double epsilon, double *w, double *g, double *m, double *v)
+{
+    adam_ptr(n, rate, beta1, beta2, epsilon, w, g, m, v);
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Applies the RMSProp rule to the \a n weights \a w, given their gradient \a g and the
+    moving average \a v of its square, and resets \a g to zero.
+
+    \a rate is the learning rate, \a decay the decay rate of the average and \a epsilon
+    the term that prevents the divisions by zero.
+*/
+void kernel_rmsprop(int n, double rate, double decay, double epsilon, double *w, double *g, double *v)
+{
+    rmsprop_ptr(n, rate, decay, epsilon, w, g, v);
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Applies the Nesterov momentum rule to the \a n weights \a w, given their gradient \a g
+    and their velocity \a v, and resets \a g to zero.
+
+    \a rate is the learning rate and \a momentum the fraction of the velocity that is kept.
+*/
+void kernel_nesterov(int n, double rate, double momentum, double *w, double *g, double *v)
+{
+    nesterov_ptr(n, rate, momentum, w, g, v);
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Applies the iRprop- rule to the \a n weights \a w, given their gradient \a g,
+    their step sizes \a step and their previous gradient \a former, and resets \a g to zero.
+
+    Each step size is multiplied by \a increase if the gradient kept its sign, and by
+    \a decrease if it changed, within [\a minStep, \a maxStep]; the weight is then moved
+    by its step size against the sign of the gradient. When the sign changed, the gradient
+    is forgotten and the weight does not move.
+*/
+void kernel_rprop(int n, double increase, double decrease, double minStep, double maxStep,
+                  double *w, double *g, double *step, double *former)
+{
+    rprop_ptr(n, increase, decrease, minStep, maxStep, w, g, step, former);
+}
+
+/* The single-precision versions of the optimizers convert the weights and the states
+ * to double precision by chunks, and run the double-precision kernels on them */
+
+static inline int chunk_load(int n, const float *src, double *dst)
+{
+    if (n > KERNEL_FLOAT_CHUNK)
+        n = KERNEL_FLOAT_CHUNK;
+    for (int i = 0; i < n; ++i)
+        dst[i] = src[i];
+    return n;
+}
+
+static inline void chunk_store(int n, const double *src, float *dst)
+{
+    for (int i = 0; i < n; ++i)
+        dst[i] = (float) src[i];
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Single-precision version of kernel_adam(), the gradient \a g being accumulated in double precision.
+*/
+void kernel_adam(int n, double rate, double beta1, double beta2, double epsilon, float *w, double *g, float *m, float *v)
+{
+    double bw[KERNEL_FLOAT_CHUNK], bm[KERNEL_FLOAT_CHUNK], bv[KERNEL_FLOAT_CHUNK];
+    int size;
+    for (int i = 0; i < n; i += size)
+    {
+        size = chunk_load(n - i, &w[i], bw);
+        chunk_load(size, &m[i], bm);
+        chunk_load(size, &v[i], bv);
+        adam_ptr(size, rate, beta1, beta2, epsilon, bw, &g[i], bm, bv);
+        chunk_store(size, bw, &w[i]);
+        chunk_store(size, bm, &m[i]);
+        chunk_store(size, bv, &v[i]);
+    }
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Single-precision version of kernel_rmsprop(), the gradient \a g being accumulated in double precision.
+*/
+void kernel_rmsprop(int n, double rate, double decay, double epsilon, float *w, double *g, float *v)
+{
+    double bw[KERNEL_FLOAT_CHUNK], bv[KERNEL_FLOAT_CHUNK];
+    int size;
+    for (int i = 0; i < n; i += size)
+    {
+        size = chunk_load(n - i, &w[i], bw);
+        chunk_load(size, &v[i], bv);
+        rmsprop_ptr(size, rate, decay, epsilon, bw, &g[i], bv);
+        chunk_store(size, bw, &w[i]);
+        chunk_store(size, bv, &v[i]);
+    }
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Single-precision version of kernel_nesterov(), the gradient \a g being accumulated in double precision.
+*/
+void kernel_nesterov(int n, double rate, double momentum, float *w, double *g, float *v)
+{
+    double bw[KERNEL_FLOAT_CHUNK], bv[KERNEL_FLOAT_CHUNK];
+    int size;
+    for (int i = 0; i < n; i += size)
+    {
+        size = chunk_load(n - i, &w[i], bw);
+        chunk_load(size, &v[i], bv);
+        nesterov_ptr(size, rate, momentum, bw, &g[i], bv);
+        chunk_store(size, bw, &w[i]);
+        chunk_store(size, bv, &v[i]);
+    }
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Single-precision version of kernel_rprop(), the gradient \a g being accumulated in double precision.
+*/
+void kernel_rprop(int n, double increase, double decrease, double minStep, double maxStep,
+                  float *w, double *g, float *step, float *former)
+{
+    double bw[KERNEL_FLOAT_CHUNK], bs[KERNEL_FLOAT_CHUNK], bf[KERNEL_FLOAT_CHUNK];
+    int size;
+    for (int i = 0; i < n; i += size)
+    {
+        size = chunk_load(n - i, &w[i], bw);
+        chunk_load(size, &step[i], bs);
+        chunk_load(size, &former[i], bf);
+        rprop_ptr(size, increase, decrease, minStep, maxStep, bw, &g[i], bs, bf);
+        chunk_store(size, bw, &w[i]);
+        chunk_store(size, bs, &step[i]);
+        chunk_store(size, bf, &former[i]);
+    }
+}
+
+/* Applies a double-precision tanh kernel to single-precision values, by chunks */
+static void tanh_float(int n, float *x, void (*fun)(int, double*))
+{
+    double buffer[KERNEL_FLOAT_CHUNK];
+    int size;
+    for (int i = 0; i < n; i += size)
+    {
+        size = (n - i < KERNEL_FLOAT_CHUNK) ? (n - i) : KERNEL_FLOAT_CHUNK;
+        for (int j = 0; j < size; ++j)
+            buffer[j] = x[i + j];
+        fun(size, buffer);
+        for (int j = 0; j < size; ++j)
+            x[i + j] = (float) buffer[j];
+    }
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Single-precision version of kernel_tanh(), using the \c tanhf function of libm.
+*/
+void kernel_tanh(int n, float *x)
+{
+    for (int i = 0; i < n; ++i)
+        x[i] = tanhf(x[i]);
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Single-precision version of kernel_tanh_fast().
+*/
+void kernel_tanh_fast(int n, float *x)
+{
+    tanh_float(n, x, tanh_fast_ptr);
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Single-precision version of kernel_tanh_table().
+*/
+void kernel_tanh_table(int n, float *x)
+{
+    tanh_float(n, x, kernel_tanh_table);
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Returns the instruction set used by the kernels:
+    \c KERNEL_SCALAR, \c KERNEL_AVX2 or \c KERNEL_AVX512.
+*/
+int kernel_level()
+{
+    if (current_level < 0)
+        select_level(detect_level());
+    return current_level;
+}
+
+/*!
+    \relates BasicPerceptron
+
+    Forces the kernels to use the instruction set \a level, if it is supported by the CPU
+    (else, the best supported one is used). A negative \a level restores the automatic selection.
+
+    \warning This function must not be called while a kernel is running in another thread.
+*/
+void kernel_force(int level)
+{
+    int best = detect_level();
+    select_level(((level < 0) || (level > best)) ? best : level);
+}
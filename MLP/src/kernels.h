@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2015, Rémi Bazin <bazin.remi@gmail.com>
+ * All rights reserved.
+ * See LICENSE for licensing details.
+ */
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+/* Instruction sets the kernels may use, selected at runtime */
+#define KERNEL_SCALAR 0
+#define KERNEL_AVX2 1
+#define KERNEL_AVX512 2
+
+/* Number of rows handled at once by kernel_dot_rows, kernel_dot_cols and kernel_ger_rows */
+#define KERNEL_ROWS 8
+
+/* Lookup table of kernel_tanh_table, covering [0, KERNEL_TANH_TABLE_MAX] */
+#define KERNEL_TANH_TABLE_SIZE 4096
+#define KERNEL_TANH_TABLE_MAX 8.
+
+/* y += a * x */
+void kernel_axpy(int n, double a, const double *x, double *y);
+/* Returns x . y */
+double kernel_dot(int n, const double *x, const double *y);
+/* A += x * y^T, A being a row-major (m, n) matrix */
+void kernel_ger(int m, int n, const double *x, const double *y, double *A);
+/* sums[r] += w[start[r] + k] * x[index[k]] for the KERNEL_ROWS rows r, each in the order of k */
+void kernel_dot_rows(int n, const double *w, const int *start, const double *x, const int *index, double *sums);
+/* sums[r] += w[offset[k] + r] * x[index[k]] for the KERNEL_ROWS columns r, each in the order of k */
+void kernel_dot_cols(int n, const double *w, const int *offset, const double *x, const int *index, double *sums);
+/* sums[s] += w[offset[k]] * x[s * stride + index[k]] for the count samples s, each in the order of k,
+ * w[k] being used if offset is NULL */
+void kernel_dot_samples(int n, const double *w, const int *offset, const double *x, int stride, const int *index,
+                        int count, double *sums);
+/* y[start[r] + k] += x[s * stride + index[k]] * a[s * stride + r] for the KERNEL_ROWS rows r,
+ * the count samples s being added one after the other */
+void kernel_ger_rows(int n, double *y, const int *start, int count, int stride,
+                     const double *x, const int *index, const double *a);
+/* Super-SAB update of n weights, resetting the gradient g */
+void kernel_supersab(int n, double increase, double decrease, double *w, double *g, double *rates, double *former);
+/* Updates of n weights by the other optimizers, resetting the gradient g */
+void kernel_adam(int n, double rate, double beta1, double beta2, double epsilon, double *w, double *g, double *m, double *v);
+void kernel_rmsprop(int n, double rate, double decay, double epsilon, double *w, double *g, double *v);
+void kernel_nesterov(int n, double rate, double momentum, double *w, double *g, double *v);
+void kernel_rprop(int n, double increase, double decrease, double minStep, double maxStep,
+                  double *w, double *g, double *step, double *former);
+/* x = tanh(x), using libm, a vectorized approximation or a lookup table */
+void kernel_tanh(int n, double *x);
+void kernel_tanh_fast(int n, double *x);
+void kernel_tanh_table(int n, double *x);
+
+/* Single-precision versions, and mixed-precision ones accumulating in double */
+void kernel_axpy(int n, float a, const float *x, float *y);
+void kernel_axpy(int n, double a, const float *x, double *y);
+float kernel_dot(int n, const float *x, const float *y);
+void kernel_ger(int m, int n, const float *x, const float *y, double *A);
+void kernel_supersab(int n, double increase, double decrease, float *w, double *g, float *rates, float *former);
+void kernel_adam(int n, double rate, double beta1, double beta2, double epsilon, float *w, double *g, float *m, float *v);
+void kernel_rmsprop(int n, double rate, double decay, double epsilon, float *w, double *g, float *v);
+void kernel_nesterov(int n, double rate, double momentum, float *w, double *g, float *v);
+void kernel_rprop(int n, double increase, double decrease, double minStep, double maxStep,
+                  float *w, double *g, float *step, float *former);
+void kernel_tanh(int n, float *x);
+void kernel_tanh_fast(int n, float *x);
+void kernel_tanh_table(int n, float *x);
+
+int kernel_level();
+void kernel_force(int level);
+
+#endif // KERNELS_H
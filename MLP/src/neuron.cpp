@@ -20,6 +20,11 @@
 */
 
 #include "neuron.h"
+#include "brainplan.h"
+#include "optimizer.h"
+#ifdef __unix__
+ #include "threadpool.h"
+#endif
 
 #include <math.h>
 
@@ -39,7 +44,7 @@
     If at least one is not provided, \a activ is supposed to be the identity and \a deriv the constant 1.
 */
 Neuron::Neuron(NEURON_FUN activ, NEURON_FUN deriv)
-    : activ(activ), a(0), a_step(false)
+    : activ(activ), a(0), a_step(false), planIndex(-1)
 #if NEURON_ENABLE_LEARNING
     , deriv(deriv), connectedTo(0), waitingFor(0), sum(0)
 #endif
@@ -104,11 +109,24 @@ void Neuron::train(double expectedOutput)
         backwardConnections[i].e += backwardConnections.at(i).source->learnMistakes(myInfluence * backwardConnections.at(i).weight) * myInfluence;
 }
 
-void Neuron::learn()
+/* With an optimizer, learning_rate and former_e hold its two states */
+void Neuron::learn(const Optimizer *optimizer, bool reset)
 {
     if (--waitingFor > 0)
         return;
     waitingFor = connectedTo;
+    if (reset)
+        resetLearning(optimizer);
+    if (optimizer)
+    {
+        for (int i = backwardConnections.length() - 1; i >= 0; --i)
+        {
+            Connection &c = backwardConnections[i];
+            optimizer->update(1, &c.weight, &c.e, &c.learning_rate, &c.former_e);
+            c.source->learn(optimizer, reset);
+        }
+        return;
+    }
     double e, tmp;
     for (int i = backwardConnections.length() - 1; i >= 0; --i)
     {
@@ -126,7 +144,19 @@ void Neuron::learn()
         backwardConnections[i].weight -= tmp * e;
         backwardConnections[i].former_e = e;
         backwardConnections[i].e = 0;
-        backwardConnections.at(i).source->learn();
+        backwardConnections.at(i).source->learn(optimizer, reset);
+    }
+}
+
+/* Initializes the states of the connections for another optimizer, NULL being the built-in Super-SAB */
+void Neuron::resetLearning(const Optimizer *optimizer)
+{
+    double init1 = optimizer ? optimizer->initialState(0) : NEURON_DEFAULT_LEARNING_RATE;
+    double init2 = optimizer ? optimizer->initialState(1) : 0.;
+    for (int i = backwardConnections.length() - 1; i >= 0; --i)
+    {
+        backwardConnections[i].learning_rate = init1;
+        backwardConnections[i].former_e = init2;
     }
 }
 
@@ -209,13 +239,28 @@ double Neuron::tanh_deriv(double ax)
     of the perceptron corresponding to the - supposed already built - network of neurons.
 */
 BrainInterface::BrainInterface(QList<Neuron *> inputNeurons, QList<Neuron *> outputNeurons)
-    : inputNeurons(inputNeurons), outputNeurons(outputNeurons), currentStep(false), previous(NULL)
+    : inputNeurons(inputNeurons), outputNeurons(outputNeurons), currentStep(false), previous(NULL), plan(NULL), planBuffer(NULL), t_count(1)
 #if NEURON_ENABLE_LEARNING
-    , error(0)
+    , error(0), optimizer(NULL), optimizerChanged(false)
 #endif
 {
 }
 
+/*!
+    Destructs the brain interface, as well as its optimizer.
+
+    \note The neurons are not deleted; see deleteBrain().
+    If the brain is compiled, its weights are written back to the neurons first.
+*/
+BrainInterface::~BrainInterface()
+{
+    decompile();
+#if NEURON_ENABLE_LEARNING
+    if (optimizer)
+        delete optimizer;
+#endif
+}
+
 /*!
     Runs the network on the given \a inputValues and returns the output values.
 */
@@ -223,11 +268,21 @@ QList<double> BrainInterface::run(QList<double> inputValues) const
 {
     if (inputValues.length() != inputNeurons.length())
         return QList<double>();
+    QList<double> result;
+    result.reserve(outputNeurons.length());
+    if (plan)
+    {
+        double *outputs = &planBuffer[inputNeurons.length()];
+        for (int i = inputNeurons.length() - 1; i >= 0; --i)
+            planBuffer[i] = inputValues.at(i);
+        plan->run(1, planBuffer, outputs);
+        for (int i = 0; i < outputNeurons.length(); ++i)
+            result.append(outputs[i]);
+        return result;
+    }
     currentStep = !currentStep;
     for (int i = inputNeurons.length() - 1; i >= 0; --i)
         inputNeurons.at(i)->setValue(inputValues.at(i), currentStep);
-    QList<double> result;
-    result.reserve(outputNeurons.length());
     for (int i = 0; i < outputNeurons.length(); ++i)
         result.append(outputNeurons.at(i)->getValue(currentStep));
     return result;
@@ -253,6 +308,16 @@ void BrainInterface::train(QList<double> inputValues, QList<double> outputValues
 #if NEURON_ENABLE_LEARNING
     if ((inputValues.length() != inputNeurons.length()) || (outputValues.length() != outputNeurons.length()))
         return;
+    if (plan)
+    {
+        double *outputs = &planBuffer[inputNeurons.length()];
+        for (int i = inputNeurons.length() - 1; i >= 0; --i)
+            planBuffer[i] = inputValues.at(i);
+        for (int i = outputNeurons.length() - 1; i >= 0; --i)
+            outputs[i] = outputValues.at(i);
+        error = plan->train(1, planBuffer, outputs, error);
+        return;
+    }
     currentStep = !currentStep;
     for (int i = inputNeurons.length() - 1; i >= 0; --i)
         inputNeurons.at(i)->setValue(inputValues.at(i), currentStep);
@@ -263,6 +328,79 @@ void BrainInterface::train(QList<double> inputValues, QList<double> outputValues
 #endif
 }
 
+/*!
+    Runs the network on \a n samples at once.
+
+    \a inputs contains the \a n input vectors one after the other (one value per input neuron),
+    and the \a n output vectors are written the same way to \a outputs (one value per output neuron),
+    which must have been allocated by the caller.
+
+    If the network is compiled, the samples are computed together by blocks of
+    \c BRAINPLAN_PENDING_SAMPLES, so that each weight is read from memory once per block;
+    the results are the same as those of run().
+
+    \sa compile()
+*/
+void BrainInterface::runBatch(int n, const double *inputs, double *outputs) const
+{
+    if (n <= 0)
+        return;
+    if (plan)
+    {
+        plan->run(n, inputs, outputs);
+        return;
+    }
+    int nInputs = inputNeurons.length(), nOutputs = outputNeurons.length();
+    for (int s = 0; s < n; ++s)
+    {
+        currentStep = !currentStep;
+        for (int i = nInputs - 1; i >= 0; --i)
+            inputNeurons.at(i)->setValue(inputs[s * nInputs + i], currentStep);
+        for (int i = 0; i < nOutputs; ++i)
+            outputs[s * nOutputs + i] = outputNeurons.at(i)->getValue(currentStep);
+    }
+}
+
+/*!
+    Trains the network on \a n couples of input and output vectors, stored one after the other
+    in \a inputs and \a outputs as for runBatch().
+
+    This is the same as calling train() on each couple, in order, without building any list;
+    if the network is compiled, the samples are computed together as in runBatch().
+
+    \note The macro value \c NEURON_ENABLE_LEARNING needs to be true (default value)
+    for this function to operate.
+
+    \sa learn()
+*/
+void BrainInterface::trainBatch(int n, const double *inputs, const double *outputs)
+{
+#if NEURON_ENABLE_LEARNING
+    if (n <= 0)
+        return;
+    if (plan)
+    {
+        error = plan->train(n, inputs, outputs, error);
+        return;
+    }
+    int nInputs = inputNeurons.length(), nOutputs = outputNeurons.length();
+    for (int s = 0; s < n; ++s)
+    {
+        currentStep = !currentStep;
+        for (int i = nInputs - 1; i >= 0; --i)
+            inputNeurons.at(i)->setValue(inputs[s * nInputs + i], currentStep);
+        for (int i = nOutputs - 1; i >= 0; --i)
+            error += sqr(outputNeurons.at(i)->getValue(currentStep) - outputs[s * nOutputs + i]);
+        for (int i = nOutputs - 1; i >= 0; --i)
+            outputNeurons.at(i)->train(outputs[s * nOutputs + i]);
+    }
+#else
+    Q_UNUSED(n)
+    Q_UNUSED(inputs)
+    Q_UNUSED(outputs)
+#endif
+}
+
 /*!
     Computes a learning step based on the previous calls to the train function.
 
@@ -274,8 +412,18 @@ void BrainInterface::train(QList<double> inputValues, QList<double> outputValues
 double BrainInterface::learn()
 {
 #if NEURON_ENABLE_LEARNING
-    for (int i = outputNeurons.length() - 1; i >= 0; --i)
-        outputNeurons.at(i)->learn();
+    if (optimizer)
+        optimizer->nextStep();
+    if (plan)
+    {
+        plan->learn(optimizer, optimizerChanged);
+    } else {
+        /* An output that feeds other neurons is reached through them */
+        for (int i = outputNeurons.length() - 1; i >= 0; --i)
+            if (!outputNeurons.at(i)->connectedTo)
+                outputNeurons.at(i)->learn(optimizer, optimizerChanged);
+    }
+    optimizerChanged = false;
     double result = error;
     error = 0;
     return result;
@@ -284,6 +432,136 @@ double BrainInterface::learn()
 #endif
 }
 
+/*!
+    Replaces the rule used by learn() to update the weights by \a optimizer.
+
+    The brain interface takes the ownership of \a optimizer, and deletes the previous one.
+    The states of the connections (learning rates, moments...) are reset at the next call to learn().
+    Passing \c NULL restores the built-in Super-SAB rule.
+
+    \note The macro value \c NEURON_ENABLE_LEARNING needs to be true (default value)
+    for this function to operate.
+
+    \sa Optimizer
+*/
+void BrainInterface::setOptimizer(Optimizer *optimizer)
+{
+#if NEURON_ENABLE_LEARNING
+    if (this->optimizer)
+        delete this->optimizer;
+    this->optimizer = optimizer;
+    optimizerChanged = true;
+#else
+    delete optimizer;
+#endif
+}
+
+/*!
+    Compiles the network into a flat plan, which run(), train() and learn() then use instead of
+    walking the neurons recursively.
+
+    The neurons the outputs depend on are sorted in topological order, and their connections are
+    stored in contiguous arrays, so that evaluating the network is a loop over these arrays.
+    The weights are held by the plan until decompile() is called.
+
+    Returns \c true on success, \c false if the network contains a loop.
+
+    \warning The network must not be modified (with Neuron::connectTo()) while it is compiled.
+
+    \note Complexity is O(number of neurons + number of connections).
+
+    \sa decompile()
+*/
+bool BrainInterface::compile()
+{
+    decompile();
+    plan = BrainPlan::compile(inputNeurons, outputNeurons);
+    if (!plan)
+        return false;
+    plan->setThreads(t_count);
+    planBuffer = new double[inputNeurons.length() + outputNeurons.length()];
+    return true;
+}
+
+/*!
+    Writes the weights of the compiled plan back to the neurons, and goes back to
+    the recursive evaluation of the network, which can then be modified again.
+
+    Does nothing if the network is not compiled.
+
+    \sa compile()
+*/
+void BrainInterface::decompile()
+{
+    if (!plan)
+        return;
+    plan->decompile();
+    delete plan;
+    delete[] planBuffer;
+    plan = NULL;
+    planBuffer = NULL;
+}
+
+/*!
+    \fn bool BrainInterface::isCompiled() const
+
+    Returns \c true if the network is compiled, \c false otherwise.
+
+    \sa compile()
+*/
+
+/*!
+    Returns an inference-only copy of the network with its current weights, or \c NULL if the network
+    contains a loop. The caller takes the ownership of the returned FrozenBrain.
+
+    The frozen brain takes 12 bytes per connection, without any of the training state of the neurons,
+    and its outputs are exactly those of run(). It shares nothing with the network, which can then be
+    trained or deleted, and can be run by several threads at once.
+
+    The network is compiled for the copy if it is not already, but stays as it is.
+
+    \sa FrozenBrain, compile()
+*/
+FrozenBrain *BrainInterface::freeze() const
+{
+    if (plan)
+        return plan->freeze();
+    BrainPlan *tmp = BrainPlan::compile(inputNeurons, outputNeurons);
+    if (!tmp)
+        return NULL;
+    FrozenBrain *brain = tmp->freeze();
+    delete tmp;
+    return brain;
+}
+
+/*!
+    Makes run() and train() of a compiled network use \a n_threads threads of the global ThreadPool.
+    If \a n_threads is 0 or negative, all the threads of the pool are used; if it is 1,
+    the network is computed by the calling thread only.
+
+    The neurons of a level of the network (those whose sources are all at lower levels) are computed
+    in parallel, then the next level; the gradient is computed the same way, from the last level.
+    Only the levels that have at least \c BRAINPLAN_PARALLEL_THRESHOLD connections are split,
+    as synchronizing the threads costs more than computing the small ones.
+    The results are the same whatever the number of threads.
+
+    \note This only applies to compiled networks: see compile().
+
+    \note This function only works on UNIX (else, it does nothing).
+*/
+void BrainInterface::multithreaded(int n_threads)
+{
+#ifdef __unix__
+    if (n_threads <= 0)
+        n_threads = ThreadPool::globalInstance()->countThreads();
+    t_count = (n_threads > 1) ? n_threads : 1;
+    if (plan)
+        plan->setThreads(t_count);
+#else
+    (void) n_threads;
+#endif
+}
+
 /*!
     Deletes the brain.
 
@@ -296,8 +574,10 @@ double BrainInterface::learn()
 */
 void BrainInterface::deleteBrain()
 {
+    decompile();
     for (int i = outputNeurons.length() - 1; i >= 0; --i)
-        outputNeurons.at(i)->brainDelete(this);
+        if (!outputNeurons.at(i)->connectedTo)
+            outputNeurons.at(i)->brainDelete(this);
     if (previous)
     {
         delete previous;
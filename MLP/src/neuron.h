@@ -20,10 +20,14 @@
 typedef double (*NEURON_FUN) (double);
 
 class BrainInterface;
+class BrainPlan;
+class FrozenBrain;
+class Optimizer;
 
 class Neuron
 {
     friend class BrainInterface;
+    friend class BrainPlan;
 private:
     struct Connection
     {
@@ -42,9 +46,10 @@ private: /* Accessed from BrainInterface */
     void brainDelete(BrainInterface *brain);
 #if NEURON_ENABLE_LEARNING
     void train(double expectedOutput);
-    void learn();
+    void learn(const Optimizer *optimizer, bool reset);
 private:
     double learnMistakes(double influence);
+    void resetLearning(const Optimizer *optimizer);
 #endif
 public:
     static double linear_activ(double x);
@@ -58,6 +63,8 @@ private:
     QList<Connection> backwardConnections;
     double a;
     bool a_step;
+    /* Index of the neuron while a BrainPlan is being built */
+    int planIndex;
 #if NEURON_ENABLE_LEARNING
     NEURON_FUN deriv;
     int connectedTo, waitingFor;
@@ -70,18 +77,38 @@ class BrainInterface
     friend class Neuron;
 public:
     BrainInterface(QList<Neuron*> inputNeurons, QList<Neuron*> outputNeurons);
+    ~BrainInterface();
     QList<double> run(QList<double> inputValues) const;
     void train(QList<double> inputValues, QList<double> outputValues);
+    void runBatch(int n, const double *inputs, double *outputs) const;
+    void trainBatch(int n, const double *inputs, const double *outputs);
     double learn();
+    void setOptimizer(Optimizer *optimizer);
+    bool compile();
+    void decompile();
+    inline bool isCompiled() const { return plan != NULL; }
+    FrozenBrain *freeze() const;
+    void multithreaded(int n_threads = 0);
     void deleteBrain();
 private: /* Accessed from Neuron */
     void deleteLater(Neuron *neuron);
+private:
+    BrainInterface(const BrainInterface &other);
+    BrainInterface &operator=(const BrainInterface &other);
 private:
     QList<Neuron*> inputNeurons, outputNeurons;
     mutable bool currentStep;
     Neuron *previous;
+    /* Flat version of the network once compiled, and buffer for its inputs and outputs */
+    BrainPlan *plan;
+    double *planBuffer;
+    /* Number of threads computing the large levels of the plan */
+    int t_count;
 #if NEURON_ENABLE_LEARNING
     double error;
+    Optimizer *optimizer;
+    /* Whether the states of the connections must be initialized for a new optimizer */
+    bool optimizerChanged;
 #endif
 };
 
@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2015, Rémi Bazin <bazin.remi@gmail.com>
+ * All rights reserved.
+ * See LICENSE for licensing details.
+ */
+
+/*!
+    \class Optimizer
+    \inmodule NetNeurons
+    \ingroup NetNeurons
+
+    \brief Optimizer is the interface of the rules that update the weights from their gradient.
+
+    Each weight comes with two state values, whose meaning depends on the optimizer
+    (learning rate, previous gradient, moments...). The update functions work on
+    contiguous arrays of weights, gradients and states, and use the vectorized kernels.
+
+    The available optimizers are SuperSABOptimizer (the default one), AdamOptimizer,
+    RMSPropOptimizer, NesterovOptimizer and RPROPOptimizer.
+
+    \sa BasicPerceptron::setOptimizer(), BrainInterface::setOptimizer()
+*/
+
+#include "optimizer.h"
+#include "kernels.h"
+
+#include <math.h>
+
+/*!
+    Destructs the optimizer.
+*/
+Optimizer::~Optimizer()
+{
+}
+
+/*!
+    Returns the value the state \a slot (0 or 1) of each weight is initialized with.
+
+    The default implementation returns 0.
+*/
+double Optimizer::initialState(int slot) const
+{
+    (void) slot;
+    return 0;
+}
+
+/*!
+    Called once at the beginning of each learning step, before the weights are updated.
+
+    The default implementation does nothing.
+*/
+void Optimizer::nextStep()
+{
+}
+
+/*!
+    \fn void Optimizer::update(int n, double *w, double *g, double *state1, double *state2) const
+
+    Updates the \a n weights \a w given their gradient \a g and their states \a state1 and \a state2,
+    and resets \a g to zero.
+
+    This function may be called at the same time from several threads on different ranges of weights.
+*/
+
+/*!
+    \fn void Optimizer::update(int n, float *w, double *g, float *state1, float *state2) const
+
+    Single-precision version of update(), the gradient \a g being accumulated in double precision.
+*/
+
+/*!
+    \class SuperSABOptimizer
+    \inmodule NetNeurons
+    \ingroup NetNeurons
+
+    \brief SuperSABOptimizer implements the Super-SAB rule, with one adaptive learning rate per weight.
+
+    Each learning rate is multiplied by \c increase when the gradient keeps its sign
+    from one step to the next, and by \c decrease when it changes.
+    The states are the learning rate and the previous gradient.
+*/
+
+/*!
+    Constructs a Super-SAB optimizer whose learning rates start at \a rate, and are multiplied by
+    \a increase or \a decrease.
+*/
+SuperSABOptimizer::SuperSABOptimizer(double rate, double increase, double decrease)
+    : rate(rate), increase(increase), decrease(decrease)
+{
+}
+
+/*!
+    \reimp
+*/
+double SuperSABOptimizer::initialState(int slot) const
+{
+    return slot ? 0. : rate;
+}
+
+/*!
+    \reimp
+*/
+void SuperSABOptimizer::update(int n, double *w, double *g, double *state1, double *state2) const
+{
+    kernel_supersab(n, increase, decrease, w, g, state1, state2);
+}
+
+/*!
+    \reimp
+*/
+void SuperSABOptimizer::update(int n, float *w, double *g, float *state1, float *state2) const
+{
+    kernel_supersab(n, increase, decrease, w, g, state1, state2);
+}
+
+/*!
+    \class AdamOptimizer
+    \inmodule NetNeurons
+    \ingroup NetNeurons
+
+    \brief AdamOptimizer implements the Adam rule, which scales the steps by moving averages
+    of the gradient and of its square.
+
+    The states are the first and second moment estimates.
+*/
+
+/*!
+    Constructs an Adam optimizer with the learning rate \a rate, the decay rates \a beta1 and \a beta2
+    of the moments and the term \a epsilon that prevents the divisions by zero.
+*/
+AdamOptimizer::AdamOptimizer(double rate, double beta1, double beta2, double epsilon)
+    : rate(rate), beta1(beta1), beta2(beta2), epsilon(epsilon), beta1_t(1.), beta2_t(1.), rate_t(rate)
+{
+}
+
+/*!
+    \reimp
+*/
+void AdamOptimizer::nextStep()
+{
+    beta1_t *= beta1;
+    beta2_t *= beta2;
+    rate_t = rate * sqrt(1. - beta2_t) / (1. - beta1_t);
+}
+
+/*!
+    \reimp
+*/
+void AdamOptimizer::update(int n, double *w, double *g, double *state1, double *state2) const
+{
+    kernel_adam(n, rate_t, beta1, beta2, epsilon, w, g, state1, state2);
+}
+
+/*!
+    \reimp
+*/
+void AdamOptimizer::update(int n, float *w, double *g, float *state1, float *state2) const
+{
+    kernel_adam(n, rate_t, beta1, beta2, epsilon, w, g, state1, state2);
+}
+
+/*!
+    \class RMSPropOptimizer
+    \inmodule NetNeurons
+    \ingroup NetNeurons
+
+    \brief RMSPropOptimizer implements the RMSProp rule, which divides the steps by a moving
+    average of the magnitude of the gradient.
+
+    The first state is the moving average of the square of the gradient; the second one is not used.
+*/
+
+/*!
+    Constructs a RMSProp optimizer with the learning rate \a rate, the decay rate \a decay
+    of the average and the term \a epsilon that prevents the divisions by zero.
+*/
+RMSPropOptimizer::RMSPropOptimizer(double rate, double decay, double epsilon)
+    : rate(rate), decay(decay), epsilon(epsilon)
+{
+}
+
+/*!
+    \reimp
+*/
+void RMSPropOptimizer::update(int n, double *w, double *g, double *state1, double *state2) const
+{
+    (void) state2;
+    kernel_rmsprop(n, rate, decay, epsilon, w, g, state1);
+}
+
+/*!
+    \reimp
+*/
+void RMSPropOptimizer::update(int n, float *w, double *g, float *state1, float *state2) const
+{
+    (void) state2;
+    kernel_rmsprop(n, rate, decay, epsilon, w, g, state1);
+}
+
+/*!
+    \class NesterovOptimizer
+    \inmodule NetNeurons
+    \ingroup NetNeurons
+
+    \brief NesterovOptimizer implements the gradient descent with Nesterov momentum.
+
+    The first state is the velocity of the weight; the second one is not used.
+*/
+
+/*!
+    Constructs a Nesterov momentum optimizer with the learning rate \a rate and the momentum \a momentum.
+*/
+NesterovOptimizer::NesterovOptimizer(double rate, double momentum)
+    : rate(rate), momentum(momentum)
+{
+}
+
+/*!
+    \reimp
+*/
+void NesterovOptimizer::update(int n, double *w, double *g, double *state1, double *state2) const
+{
+    (void) state2;
+    kernel_nesterov(n, rate, momentum, w, g, state1);
+}
+
+/*!
+    \reimp
+*/
+void NesterovOptimizer::update(int n, float *w, double *g, float *state1, float *state2) const
+{
+    (void) state2;
+    kernel_nesterov(n, rate, momentum, w, g, state1);
+}
+
+/*!
+    \class RPROPOptimizer
+    \inmodule NetNeurons
+    \ingroup NetNeurons
+
+    \brief RPROPOptimizer implements the iRprop- rule, which only uses the sign of the gradient.
+
+    Each weight moves by its own step size, which grows while the gradient keeps its sign
+    and shrinks when it changes. The states are the step size and the previous gradient.
+*/
+
+/*!
+    Constructs a RPROP optimizer whose step sizes start at \a initialStep, are multiplied
+    by \a increase or \a decrease, and are kept within [\a minStep, \a maxStep].
+*/
+RPROPOptimizer::RPROPOptimizer(double initialStep, double increase, double decrease, double minStep, double maxStep)
+    : initialStep(initialStep), increase(increase), decrease(decrease), minStep(minStep), maxStep(maxStep)
+{
+}
+
+/*!
+    \reimp
+*/
+double RPROPOptimizer::initialState(int slot) const
+{
+    return slot ? 0. : initialStep;
+}
+
+/*!
+    \reimp
+*/
+void RPROPOptimizer::update(int n, double *w, double *g, double *state1, double *state2) const
+{
+    kernel_rprop(n, increase, decrease, minStep, maxStep, w, g, state1, state2);
+}
+
+/*!
+    \reimp
+*/
+void RPROPOptimizer::update(int n, float *w, double *g, float *state1, float *state2) const
+{
+    kernel_rprop(n, increase, decrease, minStep, maxStep, w, g, state1, state2);
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2015, Rémi Bazin <bazin.remi@gmail.com>
+ * All rights reserved.
+ * See LICENSE for licensing details.
+ */
+
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#define OPTIMIZER_SUPERSAB_RATE 0.1
+#define OPTIMIZER_SUPERSAB_INCREASE 1.5
+#define OPTIMIZER_SUPERSAB_DECREASE 0.4
+
+#define OPTIMIZER_ADAM_RATE 0.001
+#define OPTIMIZER_ADAM_BETA1 0.9
+#define OPTIMIZER_ADAM_BETA2 0.999
+#define OPTIMIZER_EPSILON 1e-8
+
+#define OPTIMIZER_RMSPROP_RATE 0.001
+#define OPTIMIZER_RMSPROP_DECAY 0.9
+
+#define OPTIMIZER_NESTEROV_RATE 0.01
+#define OPTIMIZER_NESTEROV_MOMENTUM 0.9
+
+#define OPTIMIZER_RPROP_STEP 0.1
+#define OPTIMIZER_RPROP_INCREASE 1.2
+#define OPTIMIZER_RPROP_DECREASE 0.5
+#define OPTIMIZER_RPROP_MIN_STEP 1e-6
+#define OPTIMIZER_RPROP_MAX_STEP 50.
+
+class Optimizer
+{
+public:
+    virtual ~Optimizer();
+    virtual double initialState(int slot) const;
+    virtual void nextStep();
+    virtual void update(int n, double *w, double *g, double *state1, double *state2) const = 0;
+    virtual void update(int n, float *w, double *g, float *state1, float *state2) const = 0;
+};
+
+class SuperSABOptimizer : public Optimizer
+{
+public:
+    SuperSABOptimizer(double rate = OPTIMIZER_SUPERSAB_RATE, double increase = OPTIMIZER_SUPERSAB_INCREASE,
+                      double decrease = OPTIMIZER_SUPERSAB_DECREASE);
+    double initialState(int slot) const;
+    void update(int n, double *w, double *g, double *state1, double *state2) const;
+    void update(int n, float *w, double *g, float *state1, float *state2) const;
+private:
+    double rate, increase, decrease;
+};
+
+class AdamOptimizer : public Optimizer
+{
+public:
+    AdamOptimizer(double rate = OPTIMIZER_ADAM_RATE, double beta1 = OPTIMIZER_ADAM_BETA1,
+                  double beta2 = OPTIMIZER_ADAM_BETA2, double epsilon = OPTIMIZER_EPSILON);
+    void nextStep();
+    void update(int n, double *w, double *g, double *state1, double *state2) const;
+    void update(int n, float *w, double *g, float *state1, float *state2) const;
+private:
+    double rate, beta1, beta2, epsilon;
+    /* Powers of the betas at the current step, and the corrected learning rate */
+    double beta1_t, beta2_t, rate_t;
+};
+
+class RMSPropOptimizer : public Optimizer
+{
+public:
+    RMSPropOptimizer(double rate = OPTIMIZER_RMSPROP_RATE, double decay = OPTIMIZER_RMSPROP_DECAY,
+                     double epsilon = OPTIMIZER_EPSILON);
+    void update(int n, double *w, double *g, double *state1, double *state2) const;
+    void update(int n, float *w, double *g, float *state1, float *state2) const;
+private:
+    double rate, decay, epsilon;
+};
+
+class NesterovOptimizer : public Optimizer
+{
+public:
+    NesterovOptimizer(double rate = OPTIMIZER_NESTEROV_RATE, double momentum = OPTIMIZER_NESTEROV_MOMENTUM);
+    void update(int n, double *w, double *g, double *state1, double *state2) const;
+    void update(int n, float *w, double *g, float *state1, float *state2) const;
+private:
+    double rate, momentum;
+};
+
+class RPROPOptimizer : public Optimizer
+{
+public:
+    RPROPOptimizer(double initialStep = OPTIMIZER_RPROP_STEP, double increase = OPTIMIZER_RPROP_INCREASE,
+                   double decrease = OPTIMIZER_RPROP_DECREASE, double minStep = OPTIMIZER_RPROP_MIN_STEP,
+                   double maxStep = OPTIMIZER_RPROP_MAX_STEP);
+    double initialState(int slot) const;
+    void update(int n, double *w, double *g, double *state1, double *state2) const;
+    void update(int n, float *w, double *g, float *state1, float *state2) const;
+private:
+    double initialStep, increase, decrease, minStep, maxStep;
+};
+
+#endif // OPTIMIZER_H
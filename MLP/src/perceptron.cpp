@@ -5,11 +5,21 @@
  */
 
 /*!
-    \class Perceptron
+    \class BasicPerceptron
     \inmodule NetNeurons
     \ingroup NetNeurons
 
-    \brief Perceptron is a simple interface for managing multilayer perceptrons.
+    \brief BasicPerceptron is a simple interface for managing multilayer perceptrons.
+
+    \c T is the type of the weights and of the values of the neurons, and \c A the type
+    in which the gradient is accumulated during the training. Two versions are available:
+
+    \list
+    \li Perceptron, which uses \c double everywhere;
+    \li PerceptronF, which stores the weights and the values as \c float, halving the memory
+    and doubling the width of the vectorized kernels, while the gradient is still summed
+    over the samples in \c double.
+    \endlist
 
     If you are looking for something more customizable, yet less efficient,
     you might want to take a look at the Neuron and BrainInterface classes.
@@ -18,48 +28,34 @@
     \sa BrainInterface
 */
 
+/*!
+    \typedef Perceptron
+    \relates BasicPerceptron
+
+    Double-precision multilayer perceptron.
+*/
+
+/*!
+    \typedef PerceptronF
+    \relates BasicPerceptron
+
+    Single-precision multilayer perceptron, which accumulates its gradient in double precision.
+*/
+
 #include "perceptron.h"
+#include "kernels.h"
+#include "optimizer.h"
+#include "dataset.h"
 
 #include <string.h>
+#include <stdlib.h>
 #include <math.h>
 #include <stdio.h>
 
-/* Let's find a portable way of counting the number of cores */
 #ifdef __unix__
- #ifdef __linux__
-  #include <unistd.h>
-  #define PERCEPTRON_DEFAULT_THREADS() sysconf(_SC_NPROCESSORS_CONF)
- #else
-  #if __cplusplus > 199711L
-   #include <thread>
-   #define PERCEPTRON_DEFAULT_THREADS() std::thread::hardware_concurrency();
-  #else
-   #include <sys/param.h>
-   #ifdef BSD
-    #include <sys/types.h>
-    #include <sys/sysctl.h>
-    int PERCEPTRON_DEFAULT_THREADS()
-    {
-        int mib[4], numCPU;
-        size_t len = sizeof(numCPU);
-        mib[0] = CTL_HW;
-        mib[1] = HW_AVAILCPU;
-        sysctl(mib, 2, &numCPU, &len, NULL, 0);
-        if (numCPU < 1)
-        {
-            mib[1] = HW_NCPU;
-            sysctl(mib, 2, &numCPU, &len, NULL, 0);
-            if (numCPU < 1)
-                numCPU = 1
-        }
-        return numCPU;
-    }
-   #else
-    #warning Unable to retrieve the available number of threads; defaulting to 2.
-    #define PERCEPTRON_DEFAULT_THREADS() 2
-   #endif
-  #endif
- #endif
+ #include "threadpool.h"
+ #include <sys/mman.h>
+ #include <sys/stat.h>
 #endif
 
 /* C++ Double expansion trick */
@@ -78,6 +74,18 @@
  #endif
 #endif
 
+/* Header of the files written by save(), followed by the weights as they are stored in the arena */
+#define PERCEPTRON_FILE_MAGIC "NNPERCEP"
+#define PERCEPTRON_BYTE_ORDER 0x01020304
+
+struct PerceptronFileHeader
+{
+    char magic[8];
+    int version, byteOrder, scalarSize, arenaAlign;
+    int nInputs, nOutputs, nHiddenSize, nHiddenLayers, activation;
+    char padding[PERCEPTRON_ARENA_ALIGN - 8 - 9 * sizeof(int)];
+};
+
 /*!
     Constructs a multilayer perceptron.
 
@@ -87,21 +95,33 @@
 
     \note After a call to this constructor, all the weights are initialized to one.
 
+    \note The weights of all the layers are stored in a single memory block aligned
+    on \c PERCEPTRON_ARENA_ALIGN bytes, to which the training state is appended by the first
+    call to train().
+
     \note Complexity is O((\c nInputs + \c nOutputs + \c nHiddenLayers * \c nHiddenSize) * \c nHiddenSize)
     both in time and memory (space needed for the class instance).
 */
-Perceptron::Perceptron(int nInputs, int nOutputs, int nHiddenSize, int nHiddenLayers)
-    : nInputs(nInputs), nOutputs(nOutputs), nHiddenSize(nHiddenSize), nHiddenLayers(nHiddenLayers), weights(NULL), grad(NULL), main_v_data(NULL)
+template <typename T, typename A>
+BasicPerceptron<T, A>::BasicPerceptron(int nInputs, int nOutputs, int nHiddenSize, int nHiddenLayers)
+    : nInputs(nInputs), nOutputs(nOutputs), nHiddenSize(nHiddenSize), nHiddenLayers(nHiddenLayers), activation(PERCEPTRON_TANH_EXACT), weights(NULL), grad(NULL), arena(NULL), mapping(NULL), optimizer(NULL), main_v_data(NULL), batch_workspace(NULL), epoch_order(NULL), epoch_size(0)
 {
     int productSize;
-    double init_weight;
+    T init_weight;
+#ifdef __unix__
+    t_count = 0;
+#endif
     if ((nInputs <= 0) || (nOutputs <= 0) || (nHiddenSize <= 0) || (nHiddenLayers <= 0))
     {
         ERROR("In Perceptron::Perceptron, the inputs should be strictly greater than 0.");
         return;
     }
-    weights = new double*[nHiddenLayers + 1];
-    weights[0] = new double[(productSize = (nInputs + 1) * nHiddenSize)];
+    arenaCount = 0;
+    for (int i = nHiddenLayers; i >= 0; --i)
+        arenaCount += arenaLayerSize(i);
+    if (!allocArena(false))
+        return;
+    productSize = (nInputs + 1) * nHiddenSize;
     init_weight = 1. / (nInputs + 1);
     for (int j = productSize; --j >= 0;)
         weights[0][j] = init_weight;
@@ -109,24 +129,39 @@ Perceptron::Perceptron(int nInputs, int nOutputs, int nHiddenSize, int nHiddenLa
     init_weight = 1. / (nHiddenSize + 1);
     for (int i = nHiddenLayers; --i;)
     {
-        weights[i] = new double[productSize];
         for (int j = productSize; --j >= 0;)
             weights[i][j] = init_weight;
     }
-    weights[nHiddenLayers] = new double[(productSize = (nHiddenSize + 1) * nOutputs)];
+    productSize = (nHiddenSize + 1) * nOutputs;
     for (int j = productSize; --j >= 0;)
         weights[nHiddenLayers][j] = init_weight;
+}
+
 #ifdef __unix__
-    threads = NULL;
-#endif
+
+/* Constructs a perceptron whose weights are read from a file mapped by load() */
+template <typename T, typename A>
+BasicPerceptron<T, A>::BasicPerceptron(int nInputs, int nOutputs, int nHiddenSize, int nHiddenLayers, char *mapping, size_t mappingSize)
+    : nInputs(nInputs), nOutputs(nOutputs), nHiddenSize(nHiddenSize), nHiddenLayers(nHiddenLayers), activation(PERCEPTRON_TANH_EXACT), weights(NULL), grad(NULL), mapping(mapping), mappingSize(mappingSize), optimizer(NULL), main_v_data(NULL), batch_workspace(NULL), epoch_order(NULL), epoch_size(0)
+{
+    t_count = 0;
+    arenaCount = 0;
+    for (int i = nHiddenLayers; i >= 0; --i)
+        arenaCount += arenaLayerSize(i);
+    arena = mapping + sizeof(PerceptronFileHeader);
+    weights = new T*[nHiddenLayers + 1];
+    setLayers(weights, reinterpret_cast<T*>(arena));
 }
 
+#endif
+
 /*!
     Destructs the multilayer perceptron.
 
     \note Complexity is O(\c nHiddenLayers).
 */
-Perceptron::~Perceptron()
+template <typename T, typename A>
+BasicPerceptron<T, A>::~BasicPerceptron()
 {
 #ifdef __unix__
     killThreads();
@@ -136,27 +171,26 @@ Perceptron::~Perceptron()
         freeNeurons(main_v_data);
         freeNeurons(main_g_data);
     }
+    if (batch_workspace)
+        delete batch_workspace;
+    if (epoch_order)
+        delete[] epoch_order;
+    if (optimizer)
+        delete optimizer;
     if (!weights)
         return;
-    for (int i = nHiddenLayers + 1; i--;)
-        delete[] weights[i];
     delete[] weights;
     if (grad)
     {
-        for (int i = nHiddenLayers + 1; i--;)
-        {
-            delete[] grad[i];
-            delete[] learning_rates[i];
-            delete[] former_grad[i];
-        }
         delete[] grad;
-        delete[] learning_rates;
-        delete[] former_grad;
+        delete[] state1;
+        delete[] state2;
     }
+    freeArena();
 }
 
 /*!
-    \fn bool Perceptron::hasError() const
+    \fn template <typename T, typename A> bool BasicPerceptron<T, A>::hasError() const
 
     Checks whether or not an error happened during the creation of the perceptron.
 
@@ -168,77 +202,272 @@ Perceptron::~Perceptron()
     \note Complexity is O(1).
 */
 
+/*!
+    Selects the implementation of the tanh activation of the hidden neurons, used both
+    for calculating and training, according to \a mode:
+
+    \list
+    \li \c PERCEPTRON_TANH_EXACT uses the \c tanh function of libm (default).
+    \li \c PERCEPTRON_TANH_FAST uses a vectorized approximation, with a relative error of a few ulp.
+    \li \c PERCEPTRON_TANH_TABLE uses a lookup table with linear interpolation, with an absolute error
+    of about 4e-7; it is the fastest one, and is accurate enough for most inference tasks.
+    \endlist
+
+    \note Complexity is O(1).
+
+    \sa getActivation(), kernel_tanh_fast(), kernel_tanh_table()
+*/
+template <typename T, typename A>
+void BasicPerceptron<T, A>::setActivation(int mode)
+{
+    if ((mode < PERCEPTRON_TANH_EXACT) || (mode > PERCEPTRON_TANH_TABLE))
+    {
+        ERROR("In Perceptron::setActivation, unknown activation mode.");
+        return;
+    }
+    activation = mode;
+}
+
+/*!
+    \fn template <typename T, typename A> int BasicPerceptron<T, A>::getActivation() const
+
+    Returns the implementation of the tanh activation currently used.
+
+    \sa setActivation()
+*/
+
 /*!
     Calculates the output of the multilayer perceptron on the given input values vector \a input.
 
     \note It is the responsibility of the user to delete the array that is returned.
 
+    \note This function allocates memory on each call; when called repeatedly,
+    the overload using a PerceptronWorkspace is faster, and calculateBatch() even more so.
+
     \note Complexity is O((\c nInputs + \c nOutputs + \c nHiddenLayers * \c nHiddenSize) * \c nHiddenSize).
 */
-double *Perceptron::calculate(double * input) const
+template <typename T, typename A>
+T *BasicPerceptron<T, A>::calculate(T * input) const
 {
     if (!weights)
     {
         ERROR("In Perceptron::calculate, the perceptron has errors.");
         return NULL;
     }
-    double tmp;
-    double *outputs = new double[nHiddenSize];
-    double *tmpPtr = (nHiddenLayers > 1) ? (new double[nHiddenSize]) : NULL;
-    int hiddenSpace = sizeof(double) * nHiddenSize;
-    memset(outputs, 0, hiddenSpace);
-    int offset = 0;
-    for (int i = 0; i < nInputs; ++i)
+    Workspace workspace(*this, 1);
+    return calculate(input, new T[nOutputs], workspace);
+}
+
+/*!
+    Calculates the output of the multilayer perceptron on the given input values vector \a input,
+    writes it to \a output and returns \a output.
+
+    \a output must have been allocated by the caller with at least \c nOutputs values.
+    The intermediate values are stored in \a workspace, so that this function does not allocate any memory.
+
+    This function is reentrant: several threads may use the same perceptron at the same time,
+    as long as each one of them uses its own workspace and that the perceptron is not trained meanwhile.
+
+    Returns \c NULL if the perceptron has errors or if \a workspace was created for another perceptron size.
+
+    \note Complexity is O((\c nInputs + \c nOutputs + \c nHiddenLayers * \c nHiddenSize) * \c nHiddenSize).
+
+    \sa PerceptronWorkspace
+*/
+template <typename T, typename A>
+T *BasicPerceptron<T, A>::calculate(const T *input, T *output, Workspace &workspace) const
+{
+    if (!weights)
     {
-        tmp = input[i];
-        for (int j = 0; j < nHiddenSize; ++j)
-            outputs[j] += weights[0][offset++] * tmp;
+        ERROR("In Perceptron::calculate, the perceptron has errors.");
+        return NULL;
     }
-    for (int j = 0; j < nHiddenSize; ++j)
-        outputs[j] += weights[0][offset++];
-    for (int k = 1; k < nHiddenLayers; ++k)
+    if (workspace.nHiddenSize != nHiddenSize)
+    {
+        ERROR("In Perceptron::calculate, the workspace does not match the perceptron.");
+        return NULL;
+    }
+    forwardBlock(1, input, output, workspace.data, &workspace.data[nHiddenSize]);
+    return output;
+}
+
+/* Computes dst = src * w on n samples, src being (n, nSrc) and dst (n, nDst), both row-major.
+ * The weights are walked in panels of PERCEPTRON_BATCH_KBLOCK rows so that each panel is
+ * loaded from memory once for the whole block of samples. */
+template <typename T>
+static void layerProduct(int n, const T *src, int nSrc, const T *w, int nDst, T *dst)
+{
+    const T *sptr, *wptr;
+    T *dptr;
+    int i, i1, j;
+    memset(dst, 0, sizeof(T) * n * nDst);
+    for (int i0 = 0; i0 < nSrc; i0 = i1)
     {
-        input = outputs;
-        outputs = tmpPtr;
-        tmpPtr = input;
-        memset(outputs, 0, hiddenSpace);
-        offset = 0;
-        for (int i = 0; i < nHiddenSize; ++i)
+        i1 = i0 + PERCEPTRON_BATCH_KBLOCK;
+        if (i1 > nSrc)
+            i1 = nSrc;
+        for (int b = 0; b < n; ++b)
         {
-            tmp = tanh(input[i]);
-            for (int j = 0; j < nHiddenSize; ++j)
-                outputs[j] += weights[k][offset++] * tmp;
+            sptr = &src[b * nSrc];
+            dptr = &dst[b * nDst];
+            wptr = &w[i0 * nDst];
+            for (i = i0; i < i1; ++i)
+            {
+                kernel_axpy(nDst, sptr[i], wptr, dptr);
+                wptr += nDst;
+            }
         }
-        for (int j = 0; j < nHiddenSize; ++j)
-            outputs[j] += weights[k][offset++];
     }
-    if (nHiddenLayers > 1)
-        delete[] input;
-    input = outputs;
-    outputs = new double[nOutputs];
-    memset(outputs, 0, sizeof(double) * nOutputs);
-    offset = 0;
-    for (int i = 0; i < nHiddenSize; ++i)
+    /* The bias is added last */
+    wptr = &w[nSrc * nDst];
+    for (int b = 0; b < n; ++b)
     {
-        tmp = tanh(input[i]);
-        for (int j = 0; j < nOutputs; ++j)
-            outputs[j] += weights[nHiddenLayers][offset++] * tmp;
+        dptr = &dst[b * nDst];
+        for (j = 0; j < nDst; ++j)
+            dptr[j] += wptr[j];
     }
-    for (int j = 0; j < nOutputs; ++j)
-        outputs[j] += weights[nHiddenLayers][offset++];
-    return outputs;
+}
+
+/* Applies the activation of the hidden neurons */
+template <typename T, typename A>
+void BasicPerceptron<T, A>::layerTanh(int size, T *data) const
+{
+    switch (activation)
+    {
+    case PERCEPTRON_TANH_FAST:
+        kernel_tanh_fast(size, data);
+        break;
+    case PERCEPTRON_TANH_TABLE:
+        kernel_tanh_table(size, data);
+        break;
+    default:
+        kernel_tanh(size, data);
+    }
+}
+
+/* Computes the outputs of n <= block size samples, using cur and next as hidden buffers */
+template <typename T, typename A>
+void BasicPerceptron<T, A>::forwardBlock(int n, const T *inputs, T *outputs, T *cur, T *next) const
+{
+    T *tmpPtr;
+    int hiddenBlock = n * nHiddenSize;
+    layerProduct(n, inputs, nInputs, weights[0], nHiddenSize, cur);
+    for (int k = 1; k < nHiddenLayers; ++k)
+    {
+        layerTanh(hiddenBlock, cur);
+        layerProduct(n, cur, nHiddenSize, weights[k], nHiddenSize, next);
+        tmpPtr = cur;
+        cur = next;
+        next = tmpPtr;
+    }
+    layerTanh(hiddenBlock, cur);
+    layerProduct(n, cur, nHiddenSize, weights[nHiddenLayers], nOutputs, outputs);
 }
 
 /*!
-    Launches a number of threads for the training to be multithreaded.
+    Calculates the outputs of the multilayer perceptron on \a n input vectors at once.
+
+    \a inputs contains the \a n input vectors one after the other (\c nInputs values each),
+    and the \a n output vectors are written the same way to \a outputs (\c nOutputs values each),
+    which must have been allocated by the caller.
+
+    The samples are processed by blocks of \c PERCEPTRON_BATCH_BLOCK, each layer being
+    computed as a matrix product over the whole block, which is much faster than
+    calling calculate() on every sample.
 
-    The parameter \a n_threads lets you specify the number of threads you want to use
-    in order to compute each training step. If \a n_threads is less than 1,
-    the number of available CPU is used.
+    \note The intermediate values are stored in workspaces owned by the perceptron,
+    which are only allocated on the first call. This function is therefore not reentrant;
+    use the overload taking a PerceptronWorkspace if you need to.
+
+    \note If multithreadedTrain() was called beforehand, the samples are split in
+    as many parts, which are computed in the global ThreadPool.
+
+    \note Complexity is O(\a n * (\c nInputs + \c nOutputs + \c nHiddenLayers * \c nHiddenSize) * \c nHiddenSize).
+
+    \sa calculate()
+*/
+template <typename T, typename A>
+void BasicPerceptron<T, A>::calculateBatch(int n, const T *inputs, T *outputs)
+{
+    if (!weights)
+    {
+        ERROR("In Perceptron::calculateBatch, the perceptron has errors.");
+        return;
+    }
+#ifdef __unix__
+    if ((t_count > 1) && (n > PERCEPTRON_BATCH_BLOCK))
+    {
+        t_batch_n = n;
+        t_batch_in = inputs;
+        t_batch_out = outputs;
+        ThreadPool::globalInstance()->run(t_count, batchTask, (void*) this);
+        return;
+    }
+#endif
+    if (!batch_workspace)
+        batch_workspace = new Workspace(*this);
+    calculateBatch(n, inputs, outputs, *batch_workspace);
+}
+
+/*!
+    Calculates the outputs of the multilayer perceptron on \a n input vectors at once,
+    storing the intermediate values in \a workspace.
+
+    \a inputs contains the \a n input vectors one after the other (\c nInputs values each),
+    and the \a n output vectors are written the same way to \a outputs (\c nOutputs values each),
+    which must have been allocated by the caller.
+    The samples are processed by blocks of the size \a workspace was created with.
+
+    As the other overload of calculate() taking a workspace, this function does not allocate any memory
+    and is reentrant.
+
+    \note Complexity is O(\a n * (\c nInputs + \c nOutputs + \c nHiddenLayers * \c nHiddenSize) * \c nHiddenSize).
+
+    \sa PerceptronWorkspace
+*/
+template <typename T, typename A>
+void BasicPerceptron<T, A>::calculateBatch(int n, const T *inputs, T *outputs, Workspace &workspace) const
+{
+    if (!weights)
+    {
+        ERROR("In Perceptron::calculateBatch, the perceptron has errors.");
+        return;
+    }
+    if (workspace.nHiddenSize != nHiddenSize)
+    {
+        ERROR("In Perceptron::calculateBatch, the workspace does not match the perceptron.");
+        return;
+    }
+    int bn, block = workspace.blockSize;
+    T *cur = workspace.data, *next = &workspace.data[block * nHiddenSize];
+    for (int s = 0; s < n; s += block)
+    {
+        bn = n - s;
+        if (bn > block)
+            bn = block;
+        forwardBlock(bn, &inputs[s * nInputs], &outputs[s * nOutputs], cur, next);
+    }
+}
+
+/*!
+    Splits the training steps, as well as calculateBatch(), into \a n_threads parts
+    that are executed in the global ThreadPool.
+
+    If \a n_threads is less than 1, the number of threads of the global ThreadPool is used.
+
+    During a training step, each part processes a contiguous slice of the samples
+    and accumulates the gradient in its own buffers, which are then summed up in parallel,
+    each part handling a range of the weights and updating them right away.
+
+    \note The threads are shared by all the perceptrons of the process; use
+    ThreadPool::setGlobalThreads() to choose their number and whether they are bound to cores.
+
+    \note Each part holds a copy of the gradient, which takes as much memory as the weights.
 
     \note This function only works on UNIX (else, it does nothing).
 */
-void Perceptron::multithreadedTrain(int n_threads)
+template <typename T, typename A>
+void BasicPerceptron<T, A>::multithreadedTrain(int n_threads)
 {
 #ifdef __unix__
     killThreads();
@@ -248,56 +477,58 @@ void Perceptron::multithreadedTrain(int n_threads)
         return;
     }
     if (n_threads <= 0)
-        n_threads = PERCEPTRON_DEFAULT_THREADS();
+        n_threads = ThreadPool::globalInstance()->countThreads();
     if (n_threads <= 1)
         return;
 #if DEBUG_MODE
     fprintf(stderr, "Perceptron::multithreadedTrain: Using %d threads\n", n_threads);
 #endif
-    pthread_mutex_init(&grad_protect, NULL);
-    pthread_cond_init(&wait_end, NULL);
-    pthread_mutex_init(&cond_mutex, NULL);
-    pthread_cond_init(&cond, NULL);
-    pthread_cond_init(&nextc, NULL);
-    pthread_attr_t attr;
-    pthread_attr_init(&attr);
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-    t_exit = false;
-    t_inputs = 0;
-    t_outputs = 0;
-    threads = new pthread_t[(t_count = n_threads)];
+    t_count = n_threads;
+    t_v_data = new T**[n_threads];
+    t_g_data = new T**[n_threads];
+    t_grad = new A**[n_threads];
+    t_err = new double[n_threads];
+    t_workspace = new Workspace*[n_threads];
     while (--n_threads >= 0)
-        pthread_create(&threads[n_threads], &attr, thread_run, (void*) this);
-    pthread_attr_destroy(&attr);
+    {
+        /* The buffers are allocated by the first thread that uses them */
+        t_v_data[n_threads] = NULL;
+        t_workspace[n_threads] = NULL;
+    }
 #endif
 }
 
 /*!
-    Kills all the threads that have been created with multithreadedTrain.
+    Releases the buffers that have been allocated for the parts created with multithreadedTrain.
 
     This function is automatically called in the destructor, and is equivalent
     to calling multithreadedTrain(1).
 
     \sa multithreadedTrain()
 */
-void Perceptron::killThreads()
+template <typename T, typename A>
+void BasicPerceptron<T, A>::killThreads()
 {
 #ifdef __unix__
-    if (!threads)
+    if (!t_count)
         return;
-    pthread_mutex_lock(&cond_mutex);
-    t_exit = true;
-    pthread_cond_broadcast(&cond);
-    pthread_mutex_unlock(&cond_mutex);
     for (int i = t_count - 1; i >= 0; --i)
-        pthread_join(threads[i], NULL);
-    pthread_mutex_destroy(&cond_mutex);
-    pthread_cond_destroy(&cond);
-    pthread_cond_destroy(&nextc);
-    pthread_mutex_destroy(&grad_protect);
-    pthread_cond_destroy(&wait_end);
-    delete[] threads;
-    threads = NULL;
+    {
+        if (t_v_data[i])
+        {
+            freeNeurons(t_v_data[i]);
+            freeNeurons(t_g_data[i]);
+            freeGradient(t_grad[i]);
+        }
+        if (t_workspace[i])
+            delete t_workspace[i];
+    }
+    delete[] t_v_data;
+    delete[] t_g_data;
+    delete[] t_grad;
+    delete[] t_err;
+    delete[] t_workspace;
+    t_count = 0;
 #endif
 }
 
@@ -321,283 +552,786 @@ void Perceptron::killThreads()
 
     \sa multithreadedTrain()
 */
-double Perceptron::train(int size, double **inputs, double **outputs)
+template <typename T, typename A>
+double BasicPerceptron<T, A>::train(int size, T **inputs, T **outputs)
+{
+    Samples samples;
+    samples.inputs = inputs;
+    samples.outputs = outputs;
+    samples.base = NULL;
+    samples.order = NULL;
+    return trainStep(size, samples);
+}
+
+/*!
+    \overload
+
+    Trains the multilayer perceptron with the \a size samples stored one after the other at \a samples,
+    each one being made of its \c nInputs inputs followed by its \c nOutputs expected outputs.
+
+    This is the layout of the files of BasicDataset, which can therefore be used in place,
+    for instance from a file mapped in memory, without building arrays of pointers to the rows.
+*/
+template <typename T, typename A>
+double BasicPerceptron<T, A>::train(int size, const T *samples)
+{
+    Samples rows;
+    rows.inputs = NULL;
+    rows.outputs = NULL;
+    rows.base = samples;
+    rows.order = NULL;
+    return trainStep(size, rows);
+}
+
+/* One training step over the samples, followed by the update of the weights */
+template <typename T, typename A>
+double BasicPerceptron<T, A>::trainStep(int size, const Samples &samples)
 {
     if (!weights)
     {
         ERROR("In Perceptron::train, the perceptron has errors.");
         return -1;
     }
-    int productSize;
-    if (!grad)
-    {
-        int tmp = nHiddenLayers + 1;
-        grad = new double*[tmp];
-        learning_rates = new double*[tmp];
-        former_grad = new double*[tmp];
-        grad[0] = new double[(productSize = (nInputs + 1) * nHiddenSize)];
-        learning_rates[0] = new double[productSize];
-        former_grad[0] = new double[productSize];
-        tmp = sizeof(double) * productSize;
-        memset(grad[0], 0, tmp);
-        for (int j = productSize - 1; j >= 0; --j)
-            learning_rates[0][j] = PERCEPTRON_DEFAULT_LEARNING_RATE;
-        memset(former_grad[0], 0, tmp);
-        productSize = (nHiddenSize + 1) * nHiddenSize;
-        tmp = sizeof(double) * productSize;
-        for (int i = nHiddenLayers; --i;)
-        {
-            grad[i] = new double[productSize];
-            learning_rates[i] = new double[productSize];
-            former_grad[i] = new double[productSize];
-            memset(grad[i], 0, tmp);
-            for (int j = productSize - 1; j >= 0; --j)
-                learning_rates[i][j] = PERCEPTRON_DEFAULT_LEARNING_RATE;
-            memset(former_grad[i], 0, tmp);
-        }
-        grad[nHiddenLayers] = new double[(productSize = (nHiddenSize + 1) * nOutputs)];
-        learning_rates[nHiddenLayers] = new double[productSize];
-        former_grad[nHiddenLayers] = new double[productSize];
-        tmp = sizeof(double) * productSize;
-        memset(grad[nHiddenLayers], 0, tmp);
-        for (int j = productSize - 1; j >= 0; --j)
-            learning_rates[nHiddenLayers][j] = PERCEPTRON_DEFAULT_LEARNING_RATE;
-        memset(former_grad[nHiddenLayers], 0, tmp);
-    }
+    if ((!grad) && (!allocArena(true)))
+        return -1;
     err = 0;
 #ifdef __unix__
-    if (threads)
+    if (t_count)
     {
-        t_left = size;
-        pthread_mutex_lock(&cond_mutex);
-        while (size--)
+        ThreadPool *pool = ThreadPool::globalInstance();
+        t_size = size;
+        t_samples = samples;
+        pool->run(t_count, trainTask, (void*) this);
+        for (int i = 0; i < t_count; ++i)
         {
-            t_inputs = inputs[size];
-            t_outputs = outputs[size];
-            pthread_cond_signal(&cond);
-            do {
-                pthread_cond_wait(&nextc, &cond_mutex);
-            } while (t_inputs || t_outputs);
+            if (t_v_data[i])
+                continue;
+            /* A thread could not allocate its gradient: the gradients of the others are dropped */
+            for (int t = 0; t < t_count; ++t)
+                if (t_v_data[t])
+                    memset(t_grad[t][0], 0, arenaCount * sizeof(A));
+            return -1;
         }
-        pthread_mutex_unlock(&cond_mutex);
-        pthread_mutex_lock(&grad_protect);
-        while (true)
-        {
-            if (!t_left)
-                break;
-            pthread_cond_wait(&wait_end, &grad_protect);
-        }
-        pthread_mutex_unlock(&grad_protect);
-    } else {
-#else
-    {
-#endif
-        if (!main_v_data)
-        {
-            main_v_data = allocNeurons();
-            main_g_data = allocNeurons();
-        }
-        while (size--)
-            trainSingleInput(inputs[size], outputs[size], main_v_data, main_g_data);
+        /* The reduction also updates the weights: the step only counts for the optimizer from here */
+        optimizer->nextStep();
+        pool->run(t_count, reduceTask, (void*) this);
+        for (int i = 0; i < t_count; ++i)
+            err += t_err[i];
+        return err;
     }
-    for (int j = (nInputs + 1) * nHiddenSize - 1; j >= 0; --j)
-        trainSingleWeight(0, j);
-    productSize = (nHiddenSize + 1) * nHiddenSize;
-    for (int i = nHiddenLayers; --i;)
+#endif
+    if (!main_v_data)
     {
-        for (int j = productSize - 1; j >= 0; --j)
-            trainSingleWeight(i, j);
+        main_v_data = allocNeurons();
+        main_g_data = allocNeurons();
     }
-    for (int j = (nHiddenSize + 1) * nOutputs - 1; j >= 0; --j)
-        trainSingleWeight(nHiddenLayers, j);
+    while (size--)
+        err += trainSingleInput(sampleInput(samples, size), sampleOutput(samples, size), main_v_data, main_g_data, grad);
+    optimizer->nextStep();
+    updateWeights(0, arenaCount);
     return err;
 }
 
-#ifdef __unix__
+/*!
+    Trains the multilayer perceptron during one epoch of mini-batches.
 
-void *Perceptron::thread_run(void *obj)
+    The \a size samples of \a inputs and \a outputs are shuffled, then split in mini-batches
+    of \a batchSize samples; the weights are updated after each mini-batch, as if train() was
+    called on it. A \a batchSize of 1 gives a stochastic gradient descent, and a \a batchSize
+    of \a size a single step of train() over the shuffled samples.
+
+    Returns the sum of the errors of the mini-batches, each one being computed before its update.
+
+    \note Only the order of the samples is shuffled; the rows themselves are neither copied nor moved.
+    The shuffling uses rand(), and can therefore be made reproducible with srand().
+
+    \note The optimizer is applied once per mini-batch. With small mini-batches, the noise of
+    the gradient may fit AdamOptimizer or RMSPropOptimizer better than the default Super-SAB rule.
+
+    \sa train(), setOptimizer()
+*/
+template <typename T, typename A>
+double BasicPerceptron<T, A>::trainEpoch(int size, T **inputs, T **outputs, int batchSize)
+{
+    Samples samples;
+    samples.inputs = inputs;
+    samples.outputs = outputs;
+    samples.base = NULL;
+    return trainShuffled(size, samples, batchSize);
+}
+
+/*!
+    \overload
+
+    Trains the multilayer perceptron during one epoch of mini-batches of \a batchSize samples,
+    over the \a size samples stored one after the other at \a samples, each one being made of its
+    \c nInputs inputs followed by its \c nOutputs expected outputs.
+
+    \sa train(int, const T *)
+*/
+template <typename T, typename A>
+double BasicPerceptron<T, A>::trainEpoch(int size, const T *samples, int batchSize)
 {
-    Perceptron *my_this = reinterpret_cast<Perceptron*>(obj);
+    Samples rows;
+    rows.inputs = NULL;
+    rows.outputs = NULL;
+    rows.base = samples;
+    return trainShuffled(size, rows, batchSize);
+}
+
+/* Shuffles the order of the samples, then does one training step per mini-batch */
+template <typename T, typename A>
+double BasicPerceptron<T, A>::trainShuffled(int size, Samples &samples, int batchSize)
+{
+    if ((size <= 0) || (batchSize <= 0))
     {
-        /* Small thread check to avoid user tampering */
-        pthread_t self = pthread_self();
-        for (int i = my_this->t_count - 1; true; --i)
-        {
-            if (i < 0)
-                return NULL;
-            if (pthread_equal(self, my_this->threads[i]))
-                break;
-        }
+        ERROR("In Perceptron::trainEpoch, the sizes should be strictly greater than 0.");
+        return -1;
+    }
+    if (batchSize > size)
+        batchSize = size;
+    shuffleEpoch(size);
+    double result = 0, batchErr;
+    int n;
+    for (int start = 0; start < size; start += batchSize)
+    {
+        n = (size - start < batchSize) ? (size - start) : batchSize;
+        samples.order = &epoch_order[start];
+        batchErr = trainStep(n, samples);
+        if (batchErr < 0)
+            return -1;
+        result += batchErr;
+    }
+    return result;
+}
+
+/*!
+    \overload
+
+    Trains the multilayer perceptron during one epoch over the samples of \a dataset,
+    read from the beginning of its file, by mini-batches of \a batchSize samples.
+
+    The samples are shuffled within each chunk of the dataset; the chunks themselves are
+    used in the order of the file, while the next ones are decoded in the background.
+    The samples of each chunk are used where they are stored, which is directly inside
+    the file when the dataset is mapped in memory.
+
+    The mini-batches do not restart at each chunk: the samples that are left at the end of a chunk
+    are copied, then completed with the first ones of the next chunk. All the mini-batches therefore
+    have \a batchSize samples, except the last one of the epoch.
+
+    Returns the sum of the errors of the mini-batches, or -1 if the dataset could not be read.
+
+    \sa BasicDataset
+*/
+template <typename T, typename A>
+double BasicPerceptron<T, A>::trainEpoch(BasicDataset<T> &dataset, int batchSize)
+{
+    if ((dataset.getInputs() != nInputs) || (dataset.getOutputs() != nOutputs))
+    {
+        ERROR("In Perceptron::trainEpoch, the dataset does not match the perceptron.");
+        return -1;
     }
-    double *my_input, *my_output;
-    double **my_v_data, **my_g_data;
-    my_v_data = my_this->allocNeurons();
-    my_g_data = my_this->allocNeurons();
-    while (true)
+    if (batchSize <= 0)
     {
-        pthread_mutex_lock(&my_this->cond_mutex);
-        while (true)
+        ERROR("In Perceptron::trainEpoch, the sizes should be strictly greater than 0.");
+        return -1;
+    }
+    if (!dataset.rewind())
+        return -1;
+    int rowSize = nInputs + nOutputs, n, start, carried = 0;
+    /* Samples of the mini-batch left incomplete by the end of the previous chunks */
+    T *carry = new T[(size_t) batchSize * rowSize];
+    Samples rows, carryRows;
+    rows.inputs = carryRows.inputs = NULL;
+    rows.outputs = carryRows.outputs = NULL;
+    carryRows.base = carry;
+    carryRows.order = NULL;
+    double result = 0, batchErr = 0;
+    while ((batchErr >= 0) && ((n = dataset.next()) > 0))
+    {
+        shuffleEpoch(n);
+        rows.base = dataset.rows();
+        start = 0;
+        if (carried)
         {
-            if (my_this->t_exit)
+            for (; (start < n) && (carried < batchSize); ++start, ++carried)
+                memcpy(&carry[(size_t) carried * rowSize], rows.base + (size_t) epoch_order[start] * rowSize, rowSize * sizeof(T));
+            if (carried == batchSize)
             {
-                pthread_mutex_unlock(&my_this->cond_mutex);
-                my_this->freeNeurons(my_v_data);
-                my_this->freeNeurons(my_g_data);
-                pthread_exit(NULL);
+                batchErr = trainStep(batchSize, carryRows);
+                result += batchErr;
+                carried = 0;
             }
-            if (my_this->t_inputs && my_this->t_outputs)
-                break;
-            pthread_cond_wait(&my_this->cond, &my_this->cond_mutex);
         }
-        my_input = (double*) my_this->t_inputs;
-        my_output = (double*) my_this->t_outputs;
-        my_this->t_inputs = 0;
-        my_this->t_outputs = 0;
-        pthread_cond_signal(&my_this->nextc);
-        pthread_mutex_unlock(&my_this->cond_mutex);
-        my_this->trainSingleInput(my_input, my_output, my_v_data, my_g_data);
+        for (; (batchErr >= 0) && (start + batchSize <= n); start += batchSize)
+        {
+            rows.order = &epoch_order[start];
+            batchErr = trainStep(batchSize, rows);
+            result += batchErr;
+        }
+        for (; start < n; ++start, ++carried)
+            memcpy(&carry[(size_t) carried * rowSize], rows.base + (size_t) epoch_order[start] * rowSize, rowSize * sizeof(T));
     }
+    if ((batchErr >= 0) && (n == 0) && carried)
+    {
+        batchErr = trainStep(carried, carryRows);
+        result += batchErr;
+    }
+    delete[] carry;
+    return ((batchErr < 0) || (n < 0)) ? -1 : result;
 }
 
-#endif
+/* Shuffles the order of the size samples of trainEpoch */
+template <typename T, typename A>
+void BasicPerceptron<T, A>::shuffleEpoch(int size)
+{
+    allocEpoch(size);
+    /* Fisher-Yates shuffle, with enough random bits for large sets */
+    int j, tmp;
+    for (int i = size - 1; i > 0; --i)
+    {
+        j = (int) ((((unsigned long long) rand()) * ((unsigned long long) RAND_MAX + 1) + rand()) % (i + 1));
+        tmp = epoch_order[i];
+        epoch_order[i] = epoch_order[j];
+        epoch_order[j] = tmp;
+    }
+}
 
-inline double sqr(double x)
+/* Allocates the order of the samples of trainEpoch, if their number changed */
+template <typename T, typename A>
+void BasicPerceptron<T, A>::allocEpoch(int size)
 {
-    return x * x;
+    if (size == epoch_size)
+        return;
+    if (epoch_order)
+        delete[] epoch_order;
+    epoch_order = new int[size];
+    for (int i = 0; i < size; ++i)
+        epoch_order[i] = i;
+    epoch_size = size;
+}
+
+/* Applies the optimizer to the weights of the arena in [start, end).
+ * The padding between the layers is left unchanged, as its gradient is always zero. */
+template <typename T, typename A>
+void BasicPerceptron<T, A>::updateWeights(int start, int end)
+{
+    optimizer->update(end - start, &weights[0][start], &grad[0][start], &state1[0][start], &state2[0][start]);
+}
+
+/*!
+    Replaces the rule used by train() to update the weights by \a optimizer, which can be
+    a SuperSABOptimizer, an AdamOptimizer, a RMSPropOptimizer, a NesterovOptimizer or a RPROPOptimizer.
+
+    The perceptron takes the ownership of \a optimizer, and deletes the previous one.
+    If the perceptron has already been trained, the state of the optimizer (learning rates,
+    moments...) is reset. Passing \c NULL restores the default Super-SAB rule.
+
+    \note By default, the Super-SAB rule is used, with an initial learning rate of
+    \c PERCEPTRON_DEFAULT_LEARNING_RATE.
+
+    \sa Optimizer
+*/
+template <typename T, typename A>
+void BasicPerceptron<T, A>::setOptimizer(Optimizer *optimizer)
+{
+    if (this->optimizer)
+        delete this->optimizer;
+    this->optimizer = optimizer;
+    if (grad)
+        initOptimizerState();
 }
 
-void Perceptron::trainSingleInput(double *input, double *output, double **v_data, double **g_data)
+/*!
+    \fn template <typename T, typename A> Optimizer *BasicPerceptron<T, A>::getOptimizer() const
+
+    Returns the optimizer used by train(), or \c NULL if the default one has not been created yet.
+
+    \sa setOptimizer()
+*/
+
+/*!
+    Returns the size in bytes of the state of the perceptron, that is to say its weights, as well as
+    its training state (gradient and state of the optimizer) if train() has already been called.
+
+    \sa saveState(), loadState()
+*/
+template <typename T, typename A>
+size_t BasicPerceptron<T, A>::getStateSize() const
 {
-    double my_err = 0, tmp;
-    double *aptr, *wptr, *ptr3;
-    int hiddenSpace = sizeof(double) * nHiddenSize;
-    memset(v_data[0], 0, hiddenSpace);
-    int offset = 0;
-    aptr = v_data[0];
-    wptr = weights[0];
-    for (int i = 0; i < nInputs; ++i)
+    if (!weights)
+        return 0;
+    if (!grad)
+        return arenaCount * sizeof(T);
+    return arenaCount * (3 * sizeof(T) + sizeof(A));
+}
+
+/*!
+    Copies the state of the perceptron to \a buffer, which must hold at least getStateSize() bytes.
+
+    As all the parameters are stored in a single memory block, this is a single memcpy.
+
+    \sa getStateSize(), loadState()
+*/
+template <typename T, typename A>
+void BasicPerceptron<T, A>::saveState(void *buffer) const
+{
+    if (!weights)
     {
-        tmp = input[i];
-        for (int j = 0; j < nHiddenSize; ++j)
-            aptr[j] += wptr[offset++] * tmp;
+        ERROR("In Perceptron::saveState, the perceptron has errors.");
+        return;
     }
-    for (int j = 0; j < nHiddenSize; ++j)
-        aptr[j] = tanh(aptr[j] + wptr[offset++]);
-    for (int k = 1; k < nHiddenLayers; ++k)
+    memcpy(buffer, arena, getStateSize());
+}
+
+/*!
+    Restores a state of \a size bytes that was saved by saveState() from \a buffer.
+
+    The state must come from a perceptron of the same type and sizes. If it only contains
+    the weights, the training state of this perceptron is kept; if it contains a training state,
+    it is restored as well.
+
+    \sa getStateSize(), saveState()
+*/
+template <typename T, typename A>
+void BasicPerceptron<T, A>::loadState(const void *buffer, size_t size)
+{
+    if (!weights)
     {
-        aptr = v_data[k];
-        wptr = weights[k];
-        memset(v_data[k], 0, hiddenSpace);
-        offset = 0;
-        for (int i = 0; i < nHiddenSize; ++i)
-        {
-            tmp = v_data[k - 1][i];
-            for (int j = 0; j < nHiddenSize; ++j)
-                aptr[j] += wptr[offset++] * tmp;
-        }
-        for (int j = 0; j < nHiddenSize; ++j)
-            aptr[j] = tanh(aptr[j] + wptr[offset++]);
+        ERROR("In Perceptron::loadState, the perceptron has errors.");
+        return;
     }
-    memset(v_data[nHiddenLayers], 0, sizeof(double) * nOutputs);
-    offset = 0;
-    aptr = v_data[nHiddenLayers];
-    wptr = weights[nHiddenLayers];
-    for (int i = 0; i < nHiddenSize; ++i)
+    if (size == arenaCount * sizeof(T))
     {
-        tmp = v_data[nHiddenLayers - 1][i];
-        for (int j = 0; j < nOutputs; ++j)
-            aptr[j] += wptr[offset++] * tmp;
+        /* The weights of a mapped file are read-only */
+        if (mapping && (!allocArena(false)))
+            return;
+        memcpy(arena, buffer, size);
+    } else if (size == arenaCount * (3 * sizeof(T) + sizeof(A)))
+    {
+        if ((!grad) && (!allocArena(true)))
+            return;
+        memcpy(arena, buffer, size);
+    } else {
+        ERROR("In Perceptron::loadState, the state does not match the perceptron.");
     }
-    for (int j = 0; j < nOutputs; ++j)
-        my_err += sqr(g_data[nHiddenLayers][j] = (aptr[j] + wptr[offset++]) - output[j]);
-    // Note: (aptr[j] += wptr[offset++]) instead of just + if we want the real final value
-    aptr = g_data[nHiddenLayers];
-    offset = 0;
-    for (int i = 0; i < nHiddenSize; ++i)
-    {
-        tmp = 0;
-        for (int j = 0; j < nOutputs; ++j)
-            tmp += aptr[j] * wptr[offset++];
-        tmp *= 1. - sqr(v_data[nHiddenLayers - 1][i]);
-        g_data[nHiddenLayers - 1][i] = tmp;
-    }
-    for (int k = nHiddenLayers - 2; k >= 0; --k)
-    {
-        aptr = g_data[k + 1];
-        wptr = weights[k + 1];
-        offset = 0;
-        for (int i = 0; i < nHiddenSize; ++i)
-        {
-            tmp = 0;
-            for (int j = 0; j < nHiddenSize; ++j)
-                tmp += aptr[j] * wptr[offset++];
-            tmp *= 1. - sqr(v_data[k][i]);
-            g_data[k][i] = tmp;
-        }
+}
+
+/* Allocates the arena, with the training state if training is true, keeping the current weights */
+template <typename T, typename A>
+bool BasicPerceptron<T, A>::allocArena(bool training)
+{
+    size_t weightsSize = arenaCount * sizeof(T);
+    size_t size = training ? (arenaCount * (3 * sizeof(T) + sizeof(A))) : weightsSize;
+    void *ptr;
+    if (posix_memalign(&ptr, PERCEPTRON_ARENA_ALIGN, size))
+    {
+        ERROR("In Perceptron::allocArena, unable to allocate the parameters.");
+        return false;
+    }
+    char *data = reinterpret_cast<char*>(ptr);
+    if (arena)
+    {
+        memcpy(data, arena, weightsSize);
+        freeArena();
+    } else {
+        /* The padding between the layers is kept to zero */
+        memset(data, 0, weightsSize);
+        weights = new T*[nHiddenLayers + 1];
     }
+    arena = data;
+    setLayers(weights, reinterpret_cast<T*>(data));
+    if (!training)
+        return true;
+    memset(data + weightsSize, 0, size - weightsSize);
+    grad = new A*[nHiddenLayers + 1];
+    state1 = new T*[nHiddenLayers + 1];
+    state2 = new T*[nHiddenLayers + 1];
+    data += weightsSize;
+    setLayers(grad, reinterpret_cast<A*>(data));
+    data += arenaCount * sizeof(A);
+    setLayers(state1, reinterpret_cast<T*>(data));
+    data += weightsSize;
+    setLayers(state2, reinterpret_cast<T*>(data));
+    initOptimizerState();
+    return true;
+}
+
+/* Creates the default optimizer if needed, and fills the states with its initial values */
+template <typename T, typename A>
+void BasicPerceptron<T, A>::initOptimizerState()
+{
+    if (!optimizer)
+        optimizer = new SuperSABOptimizer(PERCEPTRON_DEFAULT_LEARNING_RATE, PERCEPTRON_INCREASE_LEARNING,
+                                          PERCEPTRON_DECREASE_LEARNING);
+    T init1 = optimizer->initialState(0), init2 = optimizer->initialState(1);
+    for (int j = arenaCount - 1; j >= 0; --j)
+    {
+        state1[0][j] = init1;
+        state2[0][j] = init2;
+    }
+}
+
+template <typename T, typename A>
+void BasicPerceptron<T, A>::freeArena()
+{
 #ifdef __unix__
-    if (threads)
-        pthread_mutex_lock(&grad_protect);
+    if (mapping)
+    {
+        munmap(mapping, mappingSize);
+        mapping = NULL;
+        return;
+    }
 #endif
-    aptr = grad[nHiddenLayers];
-    wptr = v_data[nHiddenLayers - 1];
-    ptr3 = g_data[nHiddenLayers];
-    offset = 0;
-    for (int i = 0; i < nHiddenSize; ++i)
+    free(arena);
+}
+
+/*!
+    Writes the weights of the perceptron to the file \a fileName, which can then be read by load().
+
+    The file contains a header holding the sizes of the perceptron, followed by the weights
+    exactly as they are stored in memory, each layer being aligned on \c PERCEPTRON_ARENA_ALIGN bytes.
+    The training state is not saved.
+
+    Returns \c true on success, \c false otherwise.
+
+    \note The format depends on the scalar type and on the byte order of the machine,
+    and is identified by \c PERCEPTRON_FILE_VERSION.
+
+    \sa load()
+*/
+template <typename T, typename A>
+bool BasicPerceptron<T, A>::save(const char *fileName) const
+{
+    if (!weights)
     {
-        for (int j = 0; j < nOutputs; ++j)
-            aptr[offset++] += ptr3[j] * wptr[i];
+        ERROR("In Perceptron::save, the perceptron has errors.");
+        return false;
     }
-    for (int j = 0; j < nOutputs; ++j)
-        aptr[offset++] += ptr3[j];
-    for (int k = nHiddenLayers; --k > 0;)
-    {
-        aptr = grad[k];
-        wptr = v_data[k - 1];
-        ptr3 = g_data[k];
-        offset = 0;
-        for (int i = 0; i < nHiddenSize; ++i)
-        {
-            for (int j = 0; j < nHiddenSize; ++j)
-                aptr[offset++] += ptr3[j] * wptr[i];
-        }
-        for (int j = 0; j < nHiddenSize; ++j)
-            aptr[offset++] += ptr3[j];
+    PerceptronFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PERCEPTRON_FILE_MAGIC, sizeof(header.magic));
+    header.version = PERCEPTRON_FILE_VERSION;
+    header.byteOrder = PERCEPTRON_BYTE_ORDER;
+    header.scalarSize = sizeof(T);
+    header.arenaAlign = PERCEPTRON_ARENA_ALIGN;
+    header.nInputs = nInputs;
+    header.nOutputs = nOutputs;
+    header.nHiddenSize = nHiddenSize;
+    header.nHiddenLayers = nHiddenLayers;
+    header.activation = activation;
+    FILE *file = fopen(fileName, "wb");
+    if (!file)
+    {
+        ERROR("In Perceptron::save, unable to open the file.");
+        return false;
+    }
+    bool success = (fwrite(&header, sizeof(header), 1, file) == 1)
+            && (fwrite(arena, sizeof(T), arenaCount, file) == (size_t) arenaCount);
+    if (fclose(file) || (!success))
+    {
+        ERROR("In Perceptron::save, unable to write the file.");
+        return false;
+    }
+    return true;
+}
+
+/*!
+    Creates a perceptron from the file \a fileName written by save().
+
+    On UNIX, the file is mapped in memory and the weights are used in place, without any copy:
+    loading takes constant time, and the processes that load the same file share its pages.
+    The weights are only copied to memory owned by the perceptron when they are modified,
+    that is to say on the first call to train() or loadState().
+
+    Returns \c NULL if the file cannot be read or was written by an incompatible perceptron;
+    else, it is the responsibility of the user to delete the returned perceptron.
+
+    \sa save()
+*/
+template <typename T, typename A>
+BasicPerceptron<T, A> *BasicPerceptron<T, A>::load(const char *fileName)
+{
+    PerceptronFileHeader header;
+    FILE *file = fopen(fileName, "rb");
+    if (!file)
+    {
+        ERROR("In Perceptron::load, unable to open the file.");
+        return NULL;
+    }
+    if ((fread(&header, sizeof(header), 1, file) != 1)
+            || memcmp(header.magic, PERCEPTRON_FILE_MAGIC, sizeof(header.magic))
+            || (header.version != PERCEPTRON_FILE_VERSION) || (header.byteOrder != PERCEPTRON_BYTE_ORDER))
+    {
+        ERROR("In Perceptron::load, the file is not a perceptron file.");
+        fclose(file);
+        return NULL;
     }
-    aptr = grad[0];
-    wptr = input;
-    ptr3 = g_data[0];
-    offset = 0;
-    for (int i = 0; i < nInputs; ++i)
+    if ((header.scalarSize != (int) sizeof(T)) || (header.arenaAlign != PERCEPTRON_ARENA_ALIGN)
+            || (header.nInputs <= 0) || (header.nOutputs <= 0) || (header.nHiddenSize <= 0) || (header.nHiddenLayers <= 0)
+            || (header.activation < PERCEPTRON_TANH_EXACT) || (header.activation > PERCEPTRON_TANH_TABLE))
+    {
+        ERROR("In Perceptron::load, the file does not match this type of perceptron.");
+        fclose(file);
+        return NULL;
+    }
+    BasicPerceptron *result;
+#ifdef __unix__
+    struct stat info;
+    void *ptr = MAP_FAILED;
+    if (!fstat(fileno(file), &info))
+        ptr = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    fclose(file);
+    if (ptr == MAP_FAILED)
+    {
+        ERROR("In Perceptron::load, unable to map the file.");
+        return NULL;
+    }
+    result = new BasicPerceptron(header.nInputs, header.nOutputs, header.nHiddenSize, header.nHiddenLayers,
+                                 reinterpret_cast<char*>(ptr), info.st_size);
+    if ((size_t) info.st_size < sizeof(header) + result->arenaCount * sizeof(T))
+#else
+    result = new BasicPerceptron(header.nInputs, header.nOutputs, header.nHiddenSize, header.nHiddenLayers);
+    bool success = (fread(result->arena, sizeof(T), result->arenaCount, file) == (size_t) result->arenaCount);
+    fclose(file);
+    if (!success)
+#endif
+    {
+        ERROR("In Perceptron::load, the file is truncated.");
+        delete result;
+        return NULL;
+    }
+    result->activation = header.activation;
+    return result;
+}
+
+/* Makes the layers of table point to the consecutive aligned layers starting at base */
+template <typename T, typename A> template <typename U>
+void BasicPerceptron<T, A>::setLayers(U **table, U *base)
+{
+    for (int k = 0; k <= nHiddenLayers; ++k)
     {
-        for (int j = 0; j < nHiddenSize; ++j)
-            aptr[offset++] += ptr3[j] * wptr[i];
+        table[k] = base;
+        base += arenaLayerSize(k);
     }
-    for (int j = 0; j < nHiddenSize; ++j)
-        aptr[offset++] += ptr3[j];
-    err += my_err;
+}
+
 #ifdef __unix__
-    if (threads)
+
+/* First phase of a training step: gradient over a contiguous slice of the samples */
+template <typename T, typename A>
+void BasicPerceptron<T, A>::trainTask(void *obj, int id)
+{
+    BasicPerceptron *my_this = reinterpret_cast<BasicPerceptron*>(obj);
+    if (!my_this->t_v_data[id])
     {
-        --t_left;
-        pthread_cond_signal(&wait_end);
-        pthread_mutex_unlock(&grad_protect);
+        /* On failure, t_v_data[id] stays NULL, which makes trainStep drop the step */
+        A **my_grad = my_this->allocGradient();
+        if (!my_grad)
+            return;
+        my_this->t_grad[id] = my_grad;
+        my_this->t_v_data[id] = my_this->allocNeurons();
+        my_this->t_g_data[id] = my_this->allocNeurons();
     }
+    T **my_v_data = my_this->t_v_data[id], **my_g_data = my_this->t_g_data[id];
+    A **my_grad = my_this->t_grad[id];
+    int start = (int) (((long long) my_this->t_size) * id / my_this->t_count);
+    int end = (int) (((long long) my_this->t_size) * (id + 1) / my_this->t_count);
+    A my_err = 0;
+    while (end-- > start)
+        my_err += my_this->trainSingleInput(my_this->sampleInput(my_this->t_samples, end), my_this->sampleOutput(my_this->t_samples, end),
+                                            my_v_data, my_g_data, my_grad);
+    my_this->t_err[id] = my_err;
+}
+
+/* Second phase of a training step: reduction of the gradients and update over a range of the weights */
+template <typename T, typename A>
+void BasicPerceptron<T, A>::reduceTask(void *obj, int id)
+{
+    reinterpret_cast<BasicPerceptron*>(obj)->reduceGradients(id);
+}
+
+/* Batched calculation over a contiguous part of the samples, aligned on the blocks */
+template <typename T, typename A>
+void BasicPerceptron<T, A>::batchTask(void *obj, int id)
+{
+    BasicPerceptron *my_this = reinterpret_cast<BasicPerceptron*>(obj);
+    int blocks = (my_this->t_batch_n + PERCEPTRON_BATCH_BLOCK - 1) / PERCEPTRON_BATCH_BLOCK;
+    int start = (int) (((long long) blocks) * id / my_this->t_count) * PERCEPTRON_BATCH_BLOCK;
+    int end = (int) (((long long) blocks) * (id + 1) / my_this->t_count) * PERCEPTRON_BATCH_BLOCK;
+    if (end > my_this->t_batch_n)
+        end = my_this->t_batch_n;
+    if (start >= end)
+        return;
+    if (!my_this->t_workspace[id])
+        my_this->t_workspace[id] = new Workspace(*my_this);
+    my_this->calculateBatch(end - start, &my_this->t_batch_in[start * my_this->nInputs],
+                            &my_this->t_batch_out[start * my_this->nOutputs], *my_this->t_workspace[id]);
+}
+
+/* Sums the per-thread gradients into grad and updates the weights, for the part of the arena
+ * that belongs to thread id; the parts are aligned so that no cache line is shared */
+template <typename T, typename A>
+void BasicPerceptron<T, A>::reduceGradients(int id)
+{
+    int blocks = arenaCount / arenaAlign();
+    int start = (int) (((long long) blocks) * id / t_count) * arenaAlign();
+    int end = (int) (((long long) blocks) * (id + 1) / t_count) * arenaAlign();
+    A sum, *dst = grad[0], *src;
+    for (int j = start; j < end; ++j)
+    {
+        sum = dst[j];
+        for (int t = 0; t < t_count; ++t)
+        {
+            src = t_grad[t][0];
+            sum += src[j];
+            src[j] = 0;
+        }
+        dst[j] = sum;
+    }
+    updateWeights(start, end);
+}
+
 #endif
+
+template <typename T>
+inline T sqr(T x)
+{
+    return x * x;
 }
 
-double **Perceptron::allocNeurons()
+/* Computes the gradient for one sample, adds it to grad_acc and returns the error */
+template <typename T, typename A>
+A BasicPerceptron<T, A>::trainSingleInput(const T *input, const T *output, T **v_data, T **g_data, A **grad_acc)
 {
-    double **result = new double*[nHiddenLayers + 1];
-    result[nHiddenLayers] = new double[nOutputs];
+    A my_err = 0;
+    T *src, *gptr, *wptr;
+    int k, nSrc, nDst;
+    /* Forward pass */
+    layerProduct(1, input, nInputs, weights[0], nHiddenSize, v_data[0]);
+    layerTanh(nHiddenSize, v_data[0]);
+    for (k = 1; k < nHiddenLayers; ++k)
+    {
+        layerProduct(1, v_data[k - 1], nHiddenSize, weights[k], nHiddenSize, v_data[k]);
+        layerTanh(nHiddenSize, v_data[k]);
+    }
+    layerProduct(1, v_data[nHiddenLayers - 1], nHiddenSize, weights[nHiddenLayers], nOutputs, v_data[nHiddenLayers]);
+    gptr = g_data[nHiddenLayers];
+    src = v_data[nHiddenLayers];
+    for (int j = 0; j < nOutputs; ++j)
+        my_err += sqr((A) (gptr[j] = src[j] - output[j]));
+    /* Backward pass */
+    for (k = nHiddenLayers; k > 0; --k)
+    {
+        nDst = (k == nHiddenLayers) ? nOutputs : nHiddenSize;
+        wptr = weights[k];
+        gptr = g_data[k - 1];
+        src = v_data[k - 1];
+        for (int i = 0; i < nHiddenSize; ++i, wptr += nDst)
+            gptr[i] = kernel_dot(nDst, g_data[k], wptr) * (1 - sqr(src[i]));
+    }
+    /* Gradient: outer product of the sources and the errors, plus the errors for the bias */
+    for (k = nHiddenLayers; k >= 0; --k)
+    {
+        nSrc = k ? nHiddenSize : nInputs;
+        nDst = (k == nHiddenLayers) ? nOutputs : nHiddenSize;
+        kernel_ger(nSrc, nDst, k ? v_data[k - 1] : input, g_data[k], grad_acc[k]);
+        kernel_axpy(nDst, 1., g_data[k], &grad_acc[k][nSrc * nDst]);
+    }
+    return my_err;
+}
+
+template <typename T, typename A>
+T **BasicPerceptron<T, A>::allocNeurons()
+{
+    T **result = new T*[nHiddenLayers + 1];
+    result[nHiddenLayers] = new T[nOutputs];
     for (int i = nHiddenLayers - 1; i >= 0; --i)
-        result[i] = new double[nHiddenSize];
+        result[i] = new T[nHiddenSize];
     return result;
 }
 
-void Perceptron::freeNeurons(double **ptr)
+template <typename T, typename A>
+void BasicPerceptron<T, A>::freeNeurons(T **ptr)
 {
     for (int i = nHiddenLayers; i >= 0; --i)
         delete[] ptr[i];
     delete[] ptr;
 }
+
+/* Allocates a zeroed gradient with the layout of the arena, or returns NULL on failure */
+template <typename T, typename A>
+A **BasicPerceptron<T, A>::allocGradient()
+{
+    void *ptr;
+    if (posix_memalign(&ptr, PERCEPTRON_ARENA_ALIGN, arenaCount * sizeof(A)))
+    {
+        ERROR("In Perceptron::allocGradient, unable to allocate the gradient.");
+        return NULL;
+    }
+    A **result = new A*[nHiddenLayers + 1];
+    memset(ptr, 0, arenaCount * sizeof(A));
+    setLayers(result, reinterpret_cast<A*>(ptr));
+    return result;
+}
+
+template <typename T, typename A>
+void BasicPerceptron<T, A>::freeGradient(A **ptr)
+{
+    free(ptr[0]);
+    delete[] ptr;
+}
+
+
+/*!
+    \class BasicPerceptronWorkspace
+    \inmodule NetNeurons
+    \ingroup NetNeurons
+
+    \brief BasicPerceptronWorkspace holds the intermediate values needed to run a BasicPerceptron.
+
+    Giving a workspace to BasicPerceptron::calculate() or BasicPerceptron::calculateBatch() avoids
+    any memory allocation during the calculation, and lets several threads share
+    the same perceptron, each one of them using its own workspace.
+
+    It is usually used through the PerceptronWorkspace and PerceptronWorkspaceF typedefs,
+    matching the Perceptron and PerceptronF ones.
+
+    \sa BasicPerceptron
+*/
+
+/*!
+    Constructs a workspace for perceptrons that have the same hidden layer size as \a perceptron.
+
+    The workspace lets BasicPerceptron::calculateBatch() process blocks of \a blockSize samples at once
+    (BasicPerceptron::calculate() only needs a block size of 1).
+
+    \note Memory usage is O(\a blockSize * \c nHiddenSize).
+*/
+template <typename T, typename A>
+BasicPerceptronWorkspace<T, A>::BasicPerceptronWorkspace(const BasicPerceptron<T, A> &perceptron, int blockSize)
+    : nHiddenSize(perceptron.nHiddenSize), blockSize((blockSize > 0) ? blockSize : 1)
+{
+    data = new T[2 * this->blockSize * nHiddenSize];
+}
+
+/*!
+    Destructs the workspace.
+*/
+template <typename T, typename A>
+BasicPerceptronWorkspace<T, A>::~BasicPerceptronWorkspace()
+{
+    delete[] data;
+}
+
+/*!
+    \fn template <typename T, typename A> int BasicPerceptronWorkspace<T, A>::getBlockSize() const
+
+    Returns the number of samples that this workspace lets BasicPerceptron::calculateBatch() process at once.
+*/
+
+template class BasicPerceptron<double, double>;
+template class BasicPerceptron<float, double>;
+template class BasicPerceptronWorkspace<double, double>;
+template class BasicPerceptronWorkspace<float, double>;
@@ -11,73 +11,213 @@
 #define PERCEPTRON_INCREASE_LEARNING 1.5
 #define PERCEPTRON_DECREASE_LEARNING 0.4
 
-/* pthread support needed for multithreading. */
-#ifdef __unix__
- #include <pthread.h>
-#else
- #warning This library does not work on non-unix OS.
+/* Number of samples computed together by calculateBatch */
+#define PERCEPTRON_BATCH_BLOCK 32
+/* Number of weight rows kept in cache while iterating over a block of samples */
+#define PERCEPTRON_BATCH_KBLOCK 64
+
+/* Alignment in bytes of the parameter arena and of each layer inside it */
+#define PERCEPTRON_ARENA_ALIGN 64
+
+/* Version of the file format written by save() */
+#define PERCEPTRON_FILE_VERSION 1
+
+/* Implementations of the tanh activation of the hidden neurons */
+#define PERCEPTRON_TANH_EXACT 0
+#define PERCEPTRON_TANH_FAST 1
+#define PERCEPTRON_TANH_TABLE 2
+
+#ifndef __unix__
+ #warning Multithreading is only supported on unix OS.
 #endif
 
 #define DEBUG_MODE 0
 
-class Perceptron
+#include <stddef.h>
+
+template <typename T, typename A> class BasicPerceptronWorkspace;
+template <typename T> class BasicDataset;
+class Optimizer;
+
+/* T is the type of the weights and of the neuron values, A the type in which the gradient is accumulated */
+template <typename T, typename A>
+class BasicPerceptron
 {
+    friend class BasicPerceptronWorkspace<T, A>;
 public:
-    Perceptron(int nInputs, int nOutputs, int nHiddenSize, int nHiddenLayers);
-    ~Perceptron();
+    typedef BasicPerceptronWorkspace<T, A> Workspace;
+    BasicPerceptron(int nInputs, int nOutputs, int nHiddenSize, int nHiddenLayers);
+    ~BasicPerceptron();
     inline bool hasError() const;
-    double *calculate(double *input) const;
+    void setActivation(int mode);
+    inline int getActivation() const { return activation; }
+    T *calculate(T *input) const;
+    T *calculate(const T *input, T *output, Workspace &workspace) const;
+    void calculateBatch(int n, const T *inputs, T *outputs);
+    void calculateBatch(int n, const T *inputs, T *outputs, Workspace &workspace) const;
     void multithreadedTrain(int n_threads = 0);
     void killThreads();
-    double train(int size, double **inputs, double **outputs);
+    void setOptimizer(Optimizer *optimizer);
+    inline Optimizer *getOptimizer() const { return optimizer; }
+    double train(int size, T **inputs, T **outputs);
+    double train(int size, const T *samples);
+    double trainEpoch(int size, T **inputs, T **outputs, int batchSize);
+    double trainEpoch(int size, const T *samples, int batchSize);
+    double trainEpoch(BasicDataset<T> &dataset, int batchSize);
+    size_t getStateSize() const;
+    void saveState(void *buffer) const;
+    void loadState(const void *buffer, size_t size);
+    bool save(const char *fileName) const;
+    static BasicPerceptron *load(const char *fileName);
+private:
+    /* Samples of a training step: either arrays of row pointers, or rows of nInputs + nOutputs
+     * values starting at base; if order is set, the i-th sample is the row order[i] */
+    struct Samples
+    {
+        T **inputs, **outputs;
+        const T *base;
+        const int *order;
+    };
 private:
 #ifdef __unix__
-    static void *thread_run(void *obj);
+    BasicPerceptron(int nInputs, int nOutputs, int nHiddenSize, int nHiddenLayers, char *mapping, size_t mappingSize);
+#endif
+    BasicPerceptron(const BasicPerceptron &other);
+    BasicPerceptron &operator=(const BasicPerceptron &other);
+#ifdef __unix__
+    static void trainTask(void *obj, int id);
+    static void reduceTask(void *obj, int id);
+    static void batchTask(void *obj, int id);
+    void reduceGradients(int id);
 #endif
-    inline void trainSingleWeight(const int &i1, const int &i2);
-    void trainSingleInput(double *input, double *output, double **v_data, double **g_data);
-    double **allocNeurons();
-    void freeNeurons(double **ptr);
+    inline int layerSize(int k) const;
+    static inline int arenaAlign();
+    inline int arenaLayerSize(int k) const;
+    bool allocArena(bool training);
+    void freeArena();
+    void initOptimizerState();
+    template <typename U> void setLayers(U **table, U *base);
+    void layerTanh(int size, T *data) const;
+    inline const T *sampleInput(const Samples &samples, int i) const;
+    inline const T *sampleOutput(const Samples &samples, int i) const;
+    double trainStep(int size, const Samples &samples);
+    double trainShuffled(int size, Samples &samples, int batchSize);
+    void updateWeights(int start, int end);
+    void allocEpoch(int size);
+    void shuffleEpoch(int size);
+    A trainSingleInput(const T *input, const T *output, T **v_data, T **g_data, A **grad_acc);
+    void forwardBlock(int n, const T *inputs, T *outputs, T *cur, T *next) const;
+    T **allocNeurons();
+    void freeNeurons(T **ptr);
+    A **allocGradient();
+    void freeGradient(A **ptr);
 private:
-    int nInputs, nOutputs, nHiddenSize, nHiddenLayers;
-    double **weights;
+    int nInputs, nOutputs, nHiddenSize, nHiddenLayers, activation;
+    T **weights;
     /* weights: First index is layer interval, second index is (source * nDestination + destination) */
     /* The last source is the bias */
-    double **grad, **learning_rates, **former_grad;
+    A **grad;
+    /* Two values per weight whose meaning depends on the optimizer; for Super-SAB,
+     * the learning rate and the gradient of the previous step */
+    T **state1, **state2;
+    /* All of the above point into the arena, which holds one block per tensor (weights, grad,
+     * state1, state2), each one of arenaCount values; the training tensors
+     * are only present once train() has been called */
+    char *arena;
+    int arenaCount;
+    /* File mapped by load(), holding the weights until the arena is reallocated */
+    char *mapping;
+    size_t mappingSize;
+    Optimizer *optimizer;
 #ifdef __unix__
-    pthread_t *threads;
+    /* Number of parts the work is split into, and buffers of each part */
     int t_count;
-    volatile int t_left;
-    pthread_mutex_t grad_protect;
-    pthread_cond_t cond, nextc, wait_end;
-    pthread_mutex_t cond_mutex;
-    volatile bool t_exit;
+    T ***t_v_data, ***t_g_data;
+    A ***t_grad;
+    double *t_err;
+    Workspace **t_workspace;
+    /* Current training step or batched calculation */
+    int t_size, t_batch_n;
+    Samples t_samples;
+    const T *t_batch_in;
+    T *t_batch_out;
 #endif
-    double err, **main_v_data, **main_g_data;
-    volatile double *t_inputs, *t_outputs;
+    double err;
+    T **main_v_data, **main_g_data;
+    Workspace *batch_workspace;
+    /* Order of the samples during an epoch of trainEpoch */
+    int *epoch_order;
+    int epoch_size;
+};
+
+template <typename T, typename A>
+class BasicPerceptronWorkspace
+{
+    friend class BasicPerceptron<T, A>;
+public:
+    BasicPerceptronWorkspace(const BasicPerceptron<T, A> &perceptron, int blockSize = PERCEPTRON_BATCH_BLOCK);
+    ~BasicPerceptronWorkspace();
+    inline int getBlockSize() const { return blockSize; }
+private:
+    BasicPerceptronWorkspace(const BasicPerceptronWorkspace &other);
+    BasicPerceptronWorkspace &operator=(const BasicPerceptronWorkspace &other);
+private:
+    int nHiddenSize, blockSize;
+    T *data;
 };
 
-inline bool Perceptron::hasError() const
+/* Double precision, as well as single precision with a double-precision gradient */
+typedef BasicPerceptron<double, double> Perceptron;
+typedef BasicPerceptron<float, double> PerceptronF;
+typedef BasicPerceptronWorkspace<double, double> PerceptronWorkspace;
+typedef BasicPerceptronWorkspace<float, double> PerceptronWorkspaceF;
+
+template <typename T, typename A>
+inline bool BasicPerceptron<T, A>::hasError() const
 {
     return !weights;
 }
 
-inline void Perceptron::trainSingleWeight(const int &i1, const int &i2)
+template <typename T, typename A>
+inline const T *BasicPerceptron<T, A>::sampleInput(const Samples &samples, int i) const
 {
-    double g = grad[i1][i2];
-    double tmp = g * former_grad[i1][i2];
-    if (tmp > 0)
-    {
-        tmp = (learning_rates[i1][i2] *= PERCEPTRON_INCREASE_LEARNING);
-    } else if (tmp < 0)
-    {
-        tmp = (learning_rates[i1][i2] *= PERCEPTRON_DECREASE_LEARNING);
-    } else {
-        tmp = learning_rates[i1][i2];
-    }
-    weights[i1][i2] -= tmp * g;
-    former_grad[i1][i2] = g;
-    grad[i1][i2] = 0;
+    if (samples.order)
+        i = samples.order[i];
+    if (samples.base)
+        return samples.base + (size_t) i * (nInputs + nOutputs);
+    return samples.inputs[i];
+}
+
+template <typename T, typename A>
+inline const T *BasicPerceptron<T, A>::sampleOutput(const Samples &samples, int i) const
+{
+    if (samples.order)
+        i = samples.order[i];
+    if (samples.base)
+        return samples.base + (size_t) i * (nInputs + nOutputs) + nInputs;
+    return samples.outputs[i];
+}
+
+template <typename T, typename A>
+inline int BasicPerceptron<T, A>::layerSize(int k) const
+{
+    if (k == 0)
+        return (nInputs + 1) * nHiddenSize;
+    return (nHiddenSize + 1) * ((k == nHiddenLayers) ? nOutputs : nHiddenSize);
+}
+
+/* Number of values of the smallest type that fill an aligned block */
+template <typename T, typename A>
+inline int BasicPerceptron<T, A>::arenaAlign()
+{
+    return PERCEPTRON_ARENA_ALIGN / ((sizeof(T) < sizeof(A)) ? sizeof(T) : sizeof(A));
+}
+
+/* Layer size rounded up so that each layer starts on an aligned address */
+template <typename T, typename A>
+inline int BasicPerceptron<T, A>::arenaLayerSize(int k) const
+{
+    return (layerSize(k) + arenaAlign() - 1) / arenaAlign() * arenaAlign();
 }
 
 #endif // PERCEPTRON_H
@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2015, Rémi Bazin <bazin.remi@gmail.com>
+ * All rights reserved.
+ * See LICENSE for licensing details.
+ */
+
+/*!
+    \class ThreadPool
+    \inmodule NetNeurons
+    \ingroup NetNeurons
+
+    \brief ThreadPool is a pool of persistent worker threads with work stealing.
+
+    Each worker owns a deque of tasks. It executes the tasks of its own deque first,
+    and steals tasks from the other workers when its deque is empty.
+    The thread that submits some work also helps executing it until it is done.
+
+    A process-wide pool is available through globalInstance(), and is shared by
+    all the perceptrons, so that several trained models do not oversubscribe the cores.
+    The Matrix products may also use it when \c MATRIX_USE_THREADPOOL is defined.
+
+    \sa BasicPerceptron::multithreadedTrain()
+*/
+
+#include "threadpool.h"
+
+#include <string.h>
+#include <stdio.h>
+
+/* Let's find a portable way of counting the number of cores */
+#ifdef __unix__
+ #ifdef __linux__
+  #include <unistd.h>
+  #include <sched.h>
+  #define THREADPOOL_DEFAULT_THREADS() sysconf(_SC_NPROCESSORS_CONF)
+ #else
+  #if __cplusplus > 199711L
+   #include <thread>
+   #define THREADPOOL_DEFAULT_THREADS() std::thread::hardware_concurrency()
+  #else
+   #include <sys/param.h>
+   #ifdef BSD
+    #include <sys/types.h>
+    #include <sys/sysctl.h>
+    static int THREADPOOL_DEFAULT_THREADS()
+    {
+        int mib[4], numCPU;
+        size_t len = sizeof(numCPU);
+        mib[0] = CTL_HW;
+        mib[1] = HW_AVAILCPU;
+        sysctl(mib, 2, &numCPU, &len, NULL, 0);
+        if (numCPU < 1)
+        {
+            mib[1] = HW_NCPU;
+            sysctl(mib, 2, &numCPU, &len, NULL, 0);
+            if (numCPU < 1)
+                numCPU = 1;
+        }
+        return numCPU;
+    }
+   #else
+    #warning Unable to retrieve the available number of threads; defaulting to 2.
+    #define THREADPOOL_DEFAULT_THREADS() 2
+   #endif
+  #endif
+ #endif
+#endif
+
+/* Worker of the current thread, if any */
+static __thread void *current_worker = NULL;
+
+static pthread_mutex_t global_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ThreadPool *global_pool = NULL;
+
+/*!
+    \typedef THREADPOOL_FUN
+    \relates ThreadPool
+
+    Function pointer type of the tasks, taking a user argument and the index of the task.
+*/
+
+/*!
+    Constructs a thread pool.
+
+    \a n_threads is the number of threads that execute the tasks, including the thread
+    that submits them; \a n_threads - 1 worker threads are therefore created.
+    If \a n_threads is less than 1, the number of available CPU is used.
+
+    If \a pinThreads is \c true, each worker thread is bound to a single core (Linux only).
+*/
+ThreadPool::ThreadPool(int n_threads, bool pinThreads)
+    : next_worker(0), pending(0), sleepers(0), t_exit(false)
+{
+    if (n_threads <= 0)
+        n_threads = defaultThreads();
+    n_workers = n_threads - 1;
+    pthread_mutex_init(&sleep_mutex, NULL);
+    pthread_cond_init(&wake, NULL);
+    pthread_cond_init(&done, NULL);
+    if (n_workers <= 0)
+    {
+        n_workers = 0;
+        workers = NULL;
+        return;
+    }
+    workers = new Worker[n_workers];
+    for (int i = 0; i < n_workers; ++i)
+    {
+        workers[i].pool = this;
+        workers[i].id = i;
+        pthread_mutex_init(&workers[i].mutex, NULL);
+        workers[i].tasks = new Task[THREADPOOL_INITIAL_DEQUE];
+        workers[i].front = 0;
+        workers[i].size = 0;
+        workers[i].capacity = THREADPOOL_INITIAL_DEQUE;
+    }
+#ifdef __linux__
+    int n_cpu = defaultThreads();
+#endif
+    for (int i = 0; i < n_workers; ++i)
+    {
+        pthread_create(&workers[i].thread, NULL, thread_run, (void*) &workers[i]);
+#ifdef __linux__
+        if (pinThreads)
+        {
+            /* The core 0 is left to the thread that submits the tasks */
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET((i + 1) % n_cpu, &set);
+            pthread_setaffinity_np(workers[i].thread, sizeof(set), &set);
+        }
+#else
+        (void) pinThreads;
+#endif
+    }
+}
+
+/*!
+    Destructs the thread pool, after having stopped all its threads.
+
+    \warning No task should be running in the pool at that time.
+*/
+ThreadPool::~ThreadPool()
+{
+    pthread_mutex_lock(&sleep_mutex);
+    t_exit = true;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&sleep_mutex);
+    for (int i = n_workers - 1; i >= 0; --i)
+    {
+        pthread_join(workers[i].thread, NULL);
+        pthread_mutex_destroy(&workers[i].mutex);
+        delete[] workers[i].tasks;
+    }
+    if (workers)
+        delete[] workers;
+    pthread_cond_destroy(&done);
+    pthread_cond_destroy(&wake);
+    pthread_mutex_destroy(&sleep_mutex);
+}
+
+/*!
+    \fn int ThreadPool::countThreads() const
+
+    Returns the number of threads that execute the tasks, including the submitting thread.
+*/
+
+/*!
+    Executes \c {fun(arg, i)} for each i in [0, \a n) and returns when all of them are done.
+
+    The tasks \a fun are spread among the workers, and the calling thread helps executing them.
+    This function may be called from several threads at the same time, as well as from
+    inside a task.
+*/
+void ThreadPool::run(int n, THREADPOOL_FUN fun, void *arg)
+{
+    if (n <= 0)
+        return;
+    if ((!n_workers) || (n == 1))
+    {
+        for (int i = 0; i < n; ++i)
+            fun(arg, i);
+        return;
+    }
+    Worker *self = reinterpret_cast<Worker*>(current_worker);
+    if (self && (self->pool != this))
+        self = NULL;
+    Batch batch;
+    batch.left = n;
+    Task task;
+    task.fun = fun;
+    task.arg = arg;
+    task.batch = &batch;
+    int start = __sync_fetch_and_add(&next_worker, 1);
+    for (int i = 0; i < n; ++i)
+    {
+        task.index = i;
+        push(self ? self : &workers[(start + i) % n_workers], task);
+    }
+    pthread_mutex_lock(&sleep_mutex);
+    if (sleepers)
+        pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&sleep_mutex);
+    while (batch.left)
+    {
+        if (findTask(self, task))
+        {
+            execute(task);
+            continue;
+        }
+        pthread_mutex_lock(&sleep_mutex);
+        while (batch.left && (!pending))
+            pthread_cond_wait(&done, &sleep_mutex);
+        pthread_mutex_unlock(&sleep_mutex);
+    }
+}
+
+/*!
+    Returns the process-wide thread pool, creating it with the default number of threads if needed.
+
+    \sa setGlobalThreads()
+*/
+ThreadPool *ThreadPool::globalInstance()
+{
+    pthread_mutex_lock(&global_mutex);
+    if (!global_pool)
+        global_pool = new ThreadPool();
+    pthread_mutex_unlock(&global_mutex);
+    return global_pool;
+}
+
+/*!
+    Replaces the process-wide thread pool by a new one with \a n_threads threads,
+    bound to their cores if \a pinThreads is \c true.
+
+    \warning No task should be running in the global pool at that time.
+
+    \sa globalInstance()
+*/
+void ThreadPool::setGlobalThreads(int n_threads, bool pinThreads)
+{
+    pthread_mutex_lock(&global_mutex);
+    if (global_pool)
+        delete global_pool;
+    global_pool = new ThreadPool(n_threads, pinThreads);
+    pthread_mutex_unlock(&global_mutex);
+}
+
+/*!
+    Returns the number of available CPU.
+*/
+int ThreadPool::defaultThreads()
+{
+    int result = THREADPOOL_DEFAULT_THREADS();
+    return (result > 0) ? result : 1;
+}
+
+void *ThreadPool::thread_run(void *obj)
+{
+    Worker *self = reinterpret_cast<Worker*>(obj);
+    ThreadPool *pool = self->pool;
+    current_worker = (void*) self;
+    Task task;
+    while (true)
+    {
+        if (pool->findTask(self, task))
+        {
+            pool->execute(task);
+            continue;
+        }
+        pthread_mutex_lock(&pool->sleep_mutex);
+        while ((!pool->pending) && (!pool->t_exit))
+        {
+            ++pool->sleepers;
+            pthread_cond_wait(&pool->wake, &pool->sleep_mutex);
+            --pool->sleepers;
+        }
+        if (pool->t_exit)
+        {
+            pthread_mutex_unlock(&pool->sleep_mutex);
+            return NULL;
+        }
+        pthread_mutex_unlock(&pool->sleep_mutex);
+    }
+}
+
+void ThreadPool::push(Worker *worker, const Task &task)
+{
+    __sync_fetch_and_add(&pending, 1);
+    pthread_mutex_lock(&worker->mutex);
+    if (worker->size == worker->capacity)
+    {
+        Task *tasks = new Task[worker->capacity * 2];
+        for (int i = 0; i < worker->size; ++i)
+            tasks[i] = worker->tasks[(worker->front + i) % worker->capacity];
+        delete[] worker->tasks;
+        worker->tasks = tasks;
+        worker->front = 0;
+        worker->capacity *= 2;
+    }
+    worker->tasks[(worker->front + worker->size) % worker->capacity] = task;
+    ++worker->size;
+    pthread_mutex_unlock(&worker->mutex);
+}
+
+bool ThreadPool::popBack(Worker *worker, Task &task)
+{
+    pthread_mutex_lock(&worker->mutex);
+    if (!worker->size)
+    {
+        pthread_mutex_unlock(&worker->mutex);
+        return false;
+    }
+    --worker->size;
+    task = worker->tasks[(worker->front + worker->size) % worker->capacity];
+    pthread_mutex_unlock(&worker->mutex);
+    __sync_fetch_and_sub(&pending, 1);
+    return true;
+}
+
+bool ThreadPool::stealFront(Worker *worker, Task &task)
+{
+    pthread_mutex_lock(&worker->mutex);
+    if (!worker->size)
+    {
+        pthread_mutex_unlock(&worker->mutex);
+        return false;
+    }
+    task = worker->tasks[worker->front];
+    worker->front = (worker->front + 1) % worker->capacity;
+    --worker->size;
+    pthread_mutex_unlock(&worker->mutex);
+    __sync_fetch_and_sub(&pending, 1);
+    return true;
+}
+
+/* Takes a task from the deque of self if possible, else steals one from another worker */
+bool ThreadPool::findTask(Worker *self, Task &task)
+{
+    if (!pending)
+        return false;
+    if (self && popBack(self, task))
+        return true;
+    int start = self ? (self->id + 1) : 0;
+    for (int i = 0; i < n_workers; ++i)
+    {
+        Worker *victim = &workers[(start + i) % n_workers];
+        if ((victim != self) && stealFront(victim, task))
+            return true;
+    }
+    return false;
+}
+
+void ThreadPool::execute(const Task &task)
+{
+    task.fun(task.arg, task.index);
+    if (__sync_sub_and_fetch(&task.batch->left, 1) == 0)
+    {
+        pthread_mutex_lock(&sleep_mutex);
+        pthread_cond_broadcast(&done);
+        pthread_mutex_unlock(&sleep_mutex);
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2015, Rémi Bazin <bazin.remi@gmail.com>
+ * All rights reserved.
+ * See LICENSE for licensing details.
+ */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+/* pthread support needed for multithreading. */
+#ifdef __unix__
+ #include <pthread.h>
+#else
+ #warning This library does not work on non-unix OS.
+#endif
+
+#define THREADPOOL_INITIAL_DEQUE 64
+
+typedef void (*THREADPOOL_FUN) (void *arg, int index);
+
+class ThreadPool
+{
+private:
+    struct Batch
+    {
+        volatile int left;
+    };
+    struct Task
+    {
+        THREADPOOL_FUN fun;
+        void *arg;
+        int index;
+        Batch *batch;
+    };
+    struct Worker
+    {
+        ThreadPool *pool;
+        int id;
+        pthread_t thread;
+        pthread_mutex_t mutex;
+        /* Circular deque: the owner works at the back, thieves steal at the front */
+        Task *tasks;
+        int front, size, capacity;
+    };
+public:
+    ThreadPool(int n_threads = 0, bool pinThreads = false);
+    ~ThreadPool();
+    inline int countThreads() const { return n_workers + 1; }
+    void run(int n, THREADPOOL_FUN fun, void *arg);
+    static ThreadPool *globalInstance();
+    static void setGlobalThreads(int n_threads, bool pinThreads = false);
+    static int defaultThreads();
+private:
+    ThreadPool(const ThreadPool &other);
+    ThreadPool &operator=(const ThreadPool &other);
+    static void *thread_run(void *obj);
+    void push(Worker *worker, const Task &task);
+    bool popBack(Worker *worker, Task &task);
+    bool stealFront(Worker *worker, Task &task);
+    bool findTask(Worker *self, Task &task);
+    void execute(const Task &task);
+private:
+    int n_workers;
+    Worker *workers;
+    int next_worker;
+    volatile int pending;
+    int sleepers;
+    bool t_exit;
+    pthread_mutex_t sleep_mutex;
+    pthread_cond_t wake, done;
+};
+
+#endif // THREADPOOL_H
@@ -7,6 +7,8 @@
 
 #include "NetNeurons/neuron.h"
 #include "NetNeurons/perceptron.h"
+#include "NetNeurons/frozenbrain.h"
+#include "NetNeurons/dataset.h"
 
 #define HIDDEN_SIZE 400
 #define HIDDEN_LAYERS 3
@@ -27,6 +29,246 @@ double mfrand()
     return ((double) (rand() & 0x3FF)) / 0x400;
 }
 
+/* Network whose first output also feeds the third one */
+BrainInterface *sharedOutputNetwork()
+{
+    QList<Neuron*> inputNeurons, outputNeurons;
+    while (inputNeurons.length() < 3)
+        inputNeurons.append(new Neuron());
+    outputNeurons.append(new Neuron(Neuron::tanh_activ, Neuron::tanh_deriv));
+    outputNeurons.append(new Neuron());
+    outputNeurons.append(new Neuron());
+    for (int i = 0; i < 3; ++i)
+    {
+        inputNeurons.at(i)->connectTo(outputNeurons.at(0), 0.3 - 0.2 * i);
+        inputNeurons.at(i)->connectTo(outputNeurons.at(1), 0.1 + 0.1 * i);
+    }
+    inputNeurons.at(0)->connectTo(outputNeurons.at(2), 0.2);
+    inputNeurons.at(1)->connectTo(outputNeurons.at(2), -0.4);
+    outputNeurons.at(0)->connectTo(outputNeurons.at(2), 0.7);
+    return new BrainInterface(inputNeurons, outputNeurons);
+}
+
+/* Smaller version of the custom network of the learning loop, with two hidden layers of width neurons */
+BrainInterface *layeredNetwork(int width)
+{
+    QList<Neuron*> inputNeurons, stepFrom, stepTo, outputNeurons;
+    while (inputNeurons.length() < 5)
+        inputNeurons.append(new Neuron());
+    stepFrom = inputNeurons.mid(0, 4);
+    for (int i = 2; --i >= 0;)
+    {
+        while (stepTo.length() < width)
+            stepTo.append(new Neuron(Neuron::tanh_activ, Neuron::tanh_deriv));
+        for (int j = 0; j < stepTo.length(); ++j)
+        {
+            for (int k = 0; k < stepFrom.length(); ++k)
+                stepFrom.at(k)->connectTo(stepTo.at(j), ((j * 7 + k * 3) % 11 - 5) / (2.5 * width));
+            inputNeurons.last()->connectTo(stepTo.at(j), 0.1);
+        }
+        stepFrom = stepTo;
+        stepTo.clear();
+    }
+    while (outputNeurons.length() < 2)
+    {
+        Neuron *to = new Neuron();
+        for (int k = 0; k < stepFrom.length(); ++k)
+            stepFrom.at(k)->connectTo(to, ((k * 5 + outputNeurons.length()) % 7 - 3) / (1.25 * width));
+        inputNeurons.last()->connectTo(to, 0.1);
+        outputNeurons.append(to);
+    }
+    return new BrainInterface(inputNeurons, outputNeurons);
+}
+
+BrainInterface *smallLayeredNetwork()
+{
+    return layeredNetwork(16);
+}
+
+/* Wide enough for its hidden levels to be split among several threads */
+BrainInterface *wideLayeredNetwork()
+{
+    return layeredNetwork(80);
+}
+
+/* Largest difference between the n values of a and b */
+double maxDiff(int n, const double *a, const double *b)
+{
+    double diff = 0;
+    for (int i = n - 1; i >= 0; --i)
+        diff = qMax(diff, qAbs(a[i] - b[i]));
+    return diff;
+}
+
+/* Trains a recursive and a compiled copy of a network on the same samples, the compiled one with
+ * n_threads threads, and returns the largest difference between their errors and outputs, and those of
+ * their frozen copies; the outputs after the first step compare the gradients. The networks are also run
+ * between train and learn, while the compiled one keeps samples that are not added to the gradient yet. */
+double compareCompiled(BrainInterface *(*network)(), int nInputs, int nOutputs, int n_threads)
+{
+    BrainInterface *recursive = network(), *compiled = network();
+    compiled->compile();
+    compiled->multithreaded(n_threads);
+    int size = 40;
+    double *inputs = new double[size * nInputs], *outputs = new double[size * nOutputs];
+    double *recursiveOutputs = new double[size * nOutputs], *compiledOutputs = new double[size * nOutputs];
+    for (int i = 0; i < size; ++i)
+    {
+        for (int j = 0; j < nInputs - 1; ++j)
+            inputs[i * nInputs + j] = mfrand();
+        inputs[i * nInputs + nInputs - 1] = 1;
+        for (int j = 0; j < nOutputs; ++j)
+            outputs[i * nOutputs + j] = inputs[i * nInputs] - inputs[i * nInputs + 1] * (j + 1);
+    }
+    double diff = 0;
+    for (int step = 0; step < 5; ++step)
+    {
+        recursive->trainBatch(size, inputs, outputs);
+        compiled->trainBatch(size, inputs, outputs);
+        recursive->runBatch(size, inputs, recursiveOutputs);
+        compiled->runBatch(size, inputs, compiledOutputs);
+        diff = qMax(diff, maxDiff(size * nOutputs, recursiveOutputs, compiledOutputs));
+        diff = qMax(diff, qAbs(recursive->learn() - compiled->learn()));
+        recursive->runBatch(size, inputs, recursiveOutputs);
+        compiled->runBatch(size, inputs, compiledOutputs);
+        diff = qMax(diff, maxDiff(size * nOutputs, recursiveOutputs, compiledOutputs));
+    }
+    FrozenBrain *frozen[2] = { recursive->freeze(), compiled->freeze() };
+    for (int f = 0; f < 2; ++f)
+    {
+        FrozenBrain::Workspace workspace(*frozen[f]);
+        frozen[f]->runBatch(size, inputs, compiledOutputs, workspace);
+        diff = qMax(diff, maxDiff(size * nOutputs, recursiveOutputs, compiledOutputs));
+        delete frozen[f];
+    }
+    delete[] compiledOutputs;
+    delete[] recursiveOutputs;
+    delete[] outputs;
+    delete[] inputs;
+    compiled->deleteBrain();
+    delete compiled;
+    recursive->deleteBrain();
+    delete recursive;
+    return diff;
+}
+
+/* Saves a trained perceptron and loads it back: the loaded one must give the same outputs, and train
+ * like a perceptron holding the same weights in memory; truncated files and other scalar types are refused */
+bool testSaveLoad()
+{
+    const char *fileName = "test_perceptron.bin";
+    int size = 20;
+    double *samples = new double[size * 6], *inputs = new double[size * 4];
+    double *expected = new double[size * 2], *results = new double[size * 2];
+    for (int i = 0; i < size; ++i)
+    {
+        for (int j = 0; j < 4; ++j)
+            inputs[i * 4 + j] = samples[i * 6 + j] = mfrand();
+        test_fn(&samples[i * 6], &samples[i * 6 + 4]);
+    }
+    Perceptron *perceptron = new Perceptron(4, 2, 12, 2);
+    perceptron->setActivation(PERCEPTRON_TANH_FAST);
+    for (int step = 0; step < 3; ++step)
+        perceptron->train(size, samples);
+    perceptron->calculateBatch(size, inputs, expected);
+    bool success = perceptron->save(fileName);
+    delete perceptron;
+    Perceptron *loaded = Perceptron::load(fileName);
+    success = success && loaded && (loaded->getActivation() == PERCEPTRON_TANH_FAST);
+    if (success)
+    {
+        loaded->calculateBatch(size, inputs, results);
+        success = (maxDiff(size * 2, expected, results) == 0);
+        /* The first training step copies the weights out of the mapping */
+        size_t stateSize = loaded->getStateSize();
+        char *state = new char[stateSize];
+        loaded->saveState(state);
+        Perceptron *copy = new Perceptron(4, 2, 12, 2);
+        copy->setActivation(PERCEPTRON_TANH_FAST);
+        copy->loadState(state, stateSize);
+        delete[] state;
+        success = success && (loaded->train(size, samples) == copy->train(size, samples));
+        loaded->calculateBatch(size, inputs, results);
+        copy->calculateBatch(size, inputs, expected);
+        success = success && (maxDiff(size * 2, expected, results) == 0);
+        delete copy;
+    }
+    delete loaded;
+    /* A wrong scalar size, then a truncated file */
+    PerceptronF *other = PerceptronF::load(fileName);
+    success = success && !other;
+    delete other;
+    FILE *file = fopen(fileName, "rb");
+    char *data = new char[1 << 16];
+    size_t length = file ? fread(data, 1, 1 << 16, file) : 0;
+    if (file)
+        fclose(file);
+    file = fopen(fileName, "wb");
+    if (file)
+    {
+        fwrite(data, 1, length / 2, file);
+        fclose(file);
+    }
+    delete[] data;
+    loaded = Perceptron::load(fileName);
+    success = success && !loaded;
+    delete loaded;
+    remove(fileName);
+    delete[] results;
+    delete[] expected;
+    delete[] inputs;
+    delete[] samples;
+    return success;
+}
+
+/* Reads a CSV file by chunks that do not divide its number of rows, over two epochs, then a file
+ * with a malformed row, which must make next() fail */
+bool testDataset()
+{
+    const char *fileName = "test_dataset.csv";
+    FILE *file = fopen(fileName, "w");
+    if (!file)
+        return false;
+    fprintf(file, "first, second; result\n# comment\n");
+    for (int i = 0; i < 7; ++i)
+    {
+        if (i == 3)
+            fprintf(file, "\n");
+        fprintf(file, (i % 2) ? "%d;%lg %d\n" : "  %d, %lg,\t%d\r\n", i, i * 0.5, -i);
+    }
+    fclose(file);
+    Dataset dataset(2, 1, 3, 1);
+    bool success = dataset.open(fileName, DATASET_FORMAT_CSV);
+    int n, row;
+    for (int epoch = 0; success && (epoch < 2); ++epoch)
+    {
+        success = dataset.rewind();
+        row = 0;
+        while (success && ((n = dataset.next()) > 0))
+        {
+            success = (n == ((row < 6) ? 3 : 1));
+            for (int i = 0; i < n; ++i, ++row)
+            {
+                const double *values = &dataset.rows()[i * 3];
+                success = success && (values[0] == row) && (values[1] == row * 0.5) && (values[2] == -row)
+                        && (dataset.inputs()[i] == values) && (dataset.outputs()[i] == &values[2]);
+            }
+        }
+        success = success && (n == 0) && (row == 7);
+    }
+    dataset.close();
+    file = fopen(fileName, "w");
+    if (file)
+    {
+        fprintf(file, "1, 2, 3\n4, 5, 6\n7, five, 9\n");
+        fclose(file);
+    }
+    success = success && dataset.open(fileName, DATASET_FORMAT_CSV) && (dataset.next() == -1);
+    dataset.close();
+    remove(fileName);
+    return success;
+}
+
 void intSignalHandler(int sig)
 {
     Q_UNUSED(sig)
@@ -42,6 +284,19 @@ int main(int argc, char *argv[])
     sigemptyset(&sigInt.sa_mask);
     sigaction(SIGINT, &sigInt, NULL);
     srand(time(NULL));
+    printf("Comparing the compiled networks with the recursive ones...\n");
+    double diff = compareCompiled(smallLayeredNetwork, 5, 2, 1);
+    printf("  Layered network: %s (%lg)\n", (diff == 0) ? "identical" : "MISMATCH", diff);
+    diff = compareCompiled(wideLayeredNetwork, 5, 2, 4);
+    printf("  Wide layered network, 4 threads: %s (%lg)\n", (diff == 0) ? "identical" : "MISMATCH", diff);
+    /* The recursion adds the two parts of the delta of the shared output to the gradient separately */
+    diff = compareCompiled(sharedOutputNetwork, 3, 3, 1);
+    printf("  Shared output: %s (%lg)\n", (diff < 1e-9) ? "identical up to rounding" : "MISMATCH", diff);
+    fflush(stdout);
+    /* The files that must be refused make load() and the dataset print their errors */
+    printf("Saving and loading a perceptron: %s\n", testSaveLoad() ? "ok" : "FAILED");
+    printf("Reading a CSV dataset: %s\n", testDataset() ? "ok" : "FAILED");
+    fflush(stdout);
     printf("Simplified network initialization...\n");
     fflush(stdout);
     Perceptron *perceptron = new Perceptron(4, 2, HIDDEN_SIZE, HIDDEN_LAYERS);
@@ -84,10 +339,12 @@ int main(int argc, char *argv[])
     BrainInterface *interface = new BrainInterface(inputNeurons, outputNeurons);
     printf("Generating learning data...\n");
     fflush(stdout);
-    double **inputs, **outputs;
+    double **inputs, **outputs, *brainInputs, *brainOutputs;
     int size = LEARNING_SIZE;
     inputs = new double*[size];
     outputs = new double*[size];
+    brainInputs = new double[size * 5];
+    brainOutputs = new double[size * 2];
     for (int i = size; --i >= 0;)
     {
         inputs[i] = new double[4];
@@ -98,13 +355,21 @@ int main(int argc, char *argv[])
         inputs[i][0] = mfrand();
         test_fn(inputs[i], outputs[i]);
     }
+    for (int i = size; --i >= 0;)
+    {
+        double *row = &brainInputs[(size - 1 - i) * 5];
+        for (int j = 3; j >= 0; --j)
+            row[3 - j] = inputs[i][j];
+        row[4] = 1;
+        brainOutputs[(size - 1 - i) * 2] = outputs[i][0];
+        brainOutputs[(size - 1 - i) * 2 + 1] = outputs[i][1];
+    }
     printf("Learning: (Press Ctrl+C to stop)\n");
     fflush(stdout);
     tperceptron->multithreadedTrain();
     int step = 0;
     while (!endLoop)
     {
-        QList<double> inputValues, outputValues;
         printf("Learning step %d:\n", ++step);
         fflush(stdout);
         QTime timer;
@@ -119,18 +384,7 @@ int main(int argc, char *argv[])
         printf("  Threaded Perceptron: %d ms (%lf)\n", t, result);
         fflush(stdout);
         timer.start();
-        for (int i = size; --i >= 0;)
-        {
-            inputValues.reserve(5);
-            for (int j = 3; j >= 0; --j)
-                inputValues.append(inputs[i][j]);
-            inputValues.append(1);
-            outputValues.append(outputs[i][0]);
-            outputValues.append(outputs[i][1]);
-            interface->train(inputValues, outputValues);
-            inputValues.clear();
-            outputValues.clear();
-        }
+        interface->trainBatch(size, brainInputs, brainOutputs);
         result = interface->learn();
         t = timer.elapsed();
         printf("  BrainInterface: %d ms (%lf)\n", t, result);
@@ -16,9 +16,21 @@ TEMPLATE = app
 
 
 SOURCES += main.cpp \
+    NetNeurons/brainplan.cpp \
+    NetNeurons/dataset.cpp \
+    NetNeurons/frozenbrain.cpp \
+    NetNeurons/kernels.cpp \
     NetNeurons/neuron.cpp \
-    NetNeurons/perceptron.cpp
+    NetNeurons/optimizer.cpp \
+    NetNeurons/perceptron.cpp \
+    NetNeurons/threadpool.cpp
 
 HEADERS += \
+    NetNeurons/brainplan.h \
+    NetNeurons/dataset.h \
+    NetNeurons/frozenbrain.h \
+    NetNeurons/kernels.h \
     NetNeurons/neuron.h \
-    NetNeurons/perceptron.h
+    NetNeurons/optimizer.h \
+    NetNeurons/perceptron.h \
+    NetNeurons/threadpool.h